@@ -0,0 +1,261 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "Structures.h"
+
+struct DcelVertex {
+	double x;
+	double y;
+	int incident; // a half-edge leaving this vertex
+};
+
+struct DcelHalfEdge {
+	int origin;
+	int twin;
+	int next; // next half-edge around the face to the left
+	int prev;
+	int face;
+	int segment; // id of the segment this edge is part of
+	bool rightward; // whether the edge runs from the left endpoint of its segment towards the right one
+};
+
+/*
+ * Planar arrangement of the segments of a sweep as a doubly-connected edge list, built by the sweep itself as it
+ * processes events: a segment gets an open edge leaving its left endpoint, which is closed at the next crossing on
+ * the segment or at its right endpoint, where the next edge is opened. Segments are therefore split at their crossings
+ * in x order and nothing has to be sorted afterwards.
+ *
+ * Half-edges leaving each vertex are kept in counterclockwise order, from which next and prev are linked. At a
+ * crossing the order is known from the sweep line, whose neighbours give which segment is above the other before and
+ * after it. Endpoints, which several segments may share, insert their edges by angle. Multiple crossings at a single
+ * point are expected to come as distinct events and give coincident vertices.
+ */
+class Arrangement {
+private:
+	static constexpr double PI = 3.14159265358979323846;
+
+	vector<DcelVertex> vertices;
+	vector<DcelHalfEdge> halfEdges;
+	vector<vector<int>> around; // half-edges leaving each vertex, counterclockwise from the negative y axis
+	vector<int> open; // per segment id, the half-edge leaving its last vertex towards the right, or -1
+	unordered_map<uint64_t, vector<int>> endpointVertices; // vertices at endpoints, by hash of their coordinates
+	vector<int> faceEdge; // a half-edge of each face
+	vector<double> faceArea; // signed area of each face cycle
+
+	static uint64_t hashOf(Point p) {
+		double x = p.getX(), y = p.getY();
+		uint64_t a, b;
+		memcpy(&a, &x, sizeof(a));
+		memcpy(&b, &y, sizeof(b));
+		return a * 0x9E3779B97F4A7C15ULL ^ b;
+	}
+
+	int addVertex(Point p) {
+		vertices.push_back({ p.getX(), p.getY(), -1 });
+		around.push_back(vector<int>());
+		return (int)vertices.size() - 1;
+	}
+
+	int endpointVertex(Point p) {
+		vector<int>& candidates = endpointVertices[hashOf(p)];
+		for (int v : candidates)
+		{
+			if (vertices[v].x == p.getX() && vertices[v].y == p.getY())
+			{
+				return v;
+			}
+		}
+
+		int v = addVertex(p);
+		candidates.push_back(v);
+		return v;
+	}
+
+	// Adds the pair of half-edges along a segment from vertex origin, the rightward one first. Returns the rightward.
+	int addEdgePair(int segmentId, int origin) {
+		int edge = (int)halfEdges.size();
+		halfEdges.push_back({ origin, edge + 1, -1, -1, -1, segmentId, true });
+		halfEdges.push_back({ -1, edge, -1, -1, -1, segmentId, false });
+		return edge;
+	}
+
+	// Angle at which a half-edge leaves its origin, counterclockwise from the negative y axis.
+	double angleOf(int h) {
+		LineSegment* s = segmentStore[halfEdges[h].segment];
+		Point left = s->getLeftEndpoint(), right = s->getRightEndpoint();
+		double dx = right.getX() - left.getX(), dy = right.getY() - left.getY();
+		double angle = halfEdges[h].rightward ? atan2(dy, dx) : atan2(-dy, -dx);
+
+		return angle < -PI / 2 ? angle + 2 * PI : angle;
+	}
+
+	void setAround(int v, vector<int>& order) {
+		for (int h : order)
+		{
+			halfEdges[h].origin = v;
+		}
+		around[v] = order;
+		vertices[v].incident = order.empty() ? -1 : order[0];
+		link(v);
+	}
+
+	// Inserts a half-edge leaving v at its angle, as at endpoints shared by several segments.
+	void insertAround(int v, int h) {
+		halfEdges[h].origin = v;
+		double angle = angleOf(h);
+		vector<int>& order = around[v];
+
+		size_t position = 0;
+		while (position < order.size() && angleOf(order[position]) < angle)
+		{
+			position++;
+		}
+		order.insert(order.begin() + position, h);
+
+		vertices[v].incident = order[0];
+		link(v);
+	}
+
+	// Links the half-edges arriving at v to the next ones leaving it: each arriving edge turns into the first
+	// leaving edge clockwise from its twin.
+	void link(int v) {
+		vector<int>& order = around[v];
+		int d = (int)order.size();
+
+		for (int i = 0; i < d; i++)
+		{
+			int arriving = halfEdges[order[i]].twin;
+			int leaving = order[(i - 1 + d) % d];
+			halfEdges[arriving].next = leaving;
+			halfEdges[leaving].prev = arriving;
+		}
+	}
+
+public:
+	// Prepares the arrangement of the segments in segmentStore.
+	void start() {
+		vertices.clear();
+		halfEdges.clear();
+		around.clear();
+		endpointVertices.clear();
+		faceEdge.clear();
+		faceArea.clear();
+		open.assign(segmentStore.size(), -1);
+	}
+
+	// At the LEFT event of a segment: opens its first edge at its left endpoint.
+	void openSegment(LineSegment* s) {
+		int v = endpointVertex(s->getLeftEndpoint());
+		int edge = addEdgePair(s->getId(), v);
+		insertAround(v, edge);
+		open[s->getId()] = edge;
+	}
+
+	/*
+	 * At an INTERSECTION event: closes the open edges of both segments at a new vertex and opens the next ones. below
+	 * is the segment below the other just left of the crossing, which puts it above the other just right of it.
+	 */
+	void cross(LineSegment* below, LineSegment* above, Point p) {
+		int v = addVertex(p);
+		int belowEdge = addEdgePair(below->getId(), v);
+		int aboveEdge = addEdgePair(above->getId(), v);
+		int belowBack = halfEdges[open[below->getId()]].twin;
+		int aboveBack = halfEdges[open[above->getId()]].twin;
+		open[below->getId()] = belowEdge;
+		open[above->getId()] = aboveEdge;
+
+		vector<int> order;
+		if (below->isVertical() || above->isVertical())
+		{
+			setAround(v, order);
+			for (int h : { aboveEdge, belowEdge, aboveBack, belowBack })
+			{
+				insertAround(v, h);
+			}
+		}
+		else
+		{
+			// Counterclockwise from below: right of the crossing the segment that was below is now above.
+			order = { aboveEdge, belowEdge, aboveBack, belowBack };
+			setAround(v, order);
+		}
+	}
+
+	// At the RIGHT event of a segment: closes its open edge at its right endpoint.
+	void closeSegment(LineSegment* s) {
+		int v = endpointVertex(s->getRightEndpoint());
+		insertAround(v, halfEdges[open[s->getId()]].twin);
+		open[s->getId()] = -1;
+	}
+
+	/*
+	 * Once the sweep is done, labels the faces by walking the cycles of next pointers. Cycles going counterclockwise
+	 * bound a face from outside; the others are the outer boundaries of connected components, which are not nested
+	 * into the faces containing them.
+	 */
+	void finish() {
+		for (int h = 0; h < (int)halfEdges.size(); h++)
+		{
+			if (halfEdges[h].face != -1 || halfEdges[h].next == -1)
+			{
+				continue;
+			}
+
+			int face = (int)faceEdge.size();
+			double area = 0.0;
+			int e = h;
+			do
+			{
+				halfEdges[e].face = face;
+				DcelVertex& a = vertices[halfEdges[e].origin];
+				DcelVertex& b = vertices[halfEdges[halfEdges[e].twin].origin];
+				area += a.x * b.y - b.x * a.y;
+				e = halfEdges[e].next;
+			} while (e != h && e != -1 && halfEdges[e].face == -1);
+
+			faceEdge.push_back(h);
+			faceArea.push_back(area / 2);
+		}
+	}
+
+	// Checks that twins, next and prev are consistent and every edge is closed.
+	bool isValid() {
+		for (int h = 0; h < (int)halfEdges.size(); h++)
+		{
+			DcelHalfEdge& e = halfEdges[h];
+			if (e.origin == -1 || e.next == -1 || e.prev == -1 || halfEdges[e.twin].twin != h
+				|| halfEdges[e.next].prev != h || halfEdges[e.next].origin != halfEdges[e.twin].origin)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	vector<DcelVertex>& getVertices() {
+		return vertices;
+	}
+
+	vector<DcelHalfEdge>& getHalfEdges() {
+		return halfEdges;
+	}
+
+	int getFaceCount() {
+		return (int)faceEdge.size();
+	}
+
+	// Faces with a counterclockwise boundary, that is bounded faces.
+	int getBoundedFaceCount() {
+		int count = 0;
+		for (double area : faceArea)
+		{
+			count += area > 0.0;
+		}
+		return count;
+	}
+};
@@ -0,0 +1,977 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "Structures.h"
+#include "IntersectionKernel.h"
+#include "SweepStatusTree.h"
+#include "SweepEngine.h"
+#include "SpatialIndex.h"
+#include "InversionSweep.h"
+#include "SweepDispatcher.h"
+#include "KineticSweep.h"
+#include "PersistentStatus.h"
+
+/*
+ * Benchmarks run with "bentley_ottmann --bench <name> [size]", where name is kernel, status, queue,
+ * engine, window, crossover, range, memory, dispatch, orthogonal, kinetic, chains, persistent or order. Each benchmark
+ * prints one JSON object per line to the console, so that results of several runs can be collected and compared by
+ * scripts.
+ */
+
+// The sweep of bentley_ottmann.cpp, run without keeping its output.
+long long countIntersections(vector<LineSegment*>& segments);
+
+// Generates count segments with endpoints in [0, extent) and a length of at most maxLength.
+inline vector<LineSegment*> randomSegments(int count, double extent, double maxLength, unsigned seed) {
+	mt19937 generator(seed);
+	uniform_real_distribution<double> position(0.0, extent);
+	uniform_real_distribution<double> offset(-maxLength / 2, maxLength / 2);
+	vector<LineSegment*> segments;
+
+	for (int i = 0; i < count; i++)
+	{
+		double x = position(generator);
+		double y = position(generator);
+		segments.push_back(new LineSegment(Point(x, y), Point(x + offset(generator), y + offset(generator))));
+	}
+
+	return segments;
+}
+
+inline double elapsedNs(chrono::high_resolution_clock::time_point start) {
+	return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// Throughput of the batched intersection kernel at every supported level, against one getIntersectionPointWith per
+// pair.
+inline void benchmarkIntersectionKernel(int segmentCount) {
+	vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, 100.0, 1);
+	SegmentBatch batch(segments);
+
+	int pairCount = 1 << 22;
+	mt19937 generator(2);
+	uniform_int_distribution<int> index(0, segmentCount - 1);
+	vector<int> first(pairCount), second(pairCount);
+	vector<unsigned char> hits(pairCount);
+
+	for (int p = 0; p < pairCount; p++)
+	{
+		first[p] = index(generator);
+		second[p] = index(generator);
+	}
+
+	auto start = chrono::high_resolution_clock::now();
+	long long crossings = 0;
+	for (int p = 0; p < pairCount; p++)
+	{
+		Point* crossingPoint = segments[first[p]]->getIntersectionPointWith(segments[second[p]]);
+		if (crossingPoint != nullptr)
+		{
+			crossings++;
+			deleteCrossingPoint(crossingPoint);
+		}
+	}
+	double ns = elapsedNs(start);
+	cout << "{\"bench\": \"kernel\", \"level\": \"getIntersectionPointWith\", \"pairs\": " << pairCount
+		<< ", \"crossings\": " << crossings << ", \"pairs_per_ns\": " << pairCount / ns << "}" << endl;
+
+	KernelLevel levels[] = { KernelLevel::SCALAR, KernelLevel::SSE2, KernelLevel::AVX2 };
+	for (KernelLevel level : levels)
+	{
+		if (level > IntersectionKernel::bestLevel())
+		{
+			continue;
+		}
+
+		start = chrono::high_resolution_clock::now();
+		IntersectionKernel::testPairs(batch, first.data(), second.data(), pairCount, hits.data(), level);
+		ns = elapsedNs(start);
+
+		crossings = 0;
+		for (int p = 0; p < pairCount; p++)
+		{
+			crossings += hits[p];
+		}
+
+		cout << "{\"bench\": \"kernel\", \"level\": \"" << IntersectionKernel::levelName(level) << "\", \"pairs\": "
+			<< pairCount << ", \"crossings\": " << crossings << ", \"pairs_per_ns\": " << pairCount / ns << "}"
+			<< endl;
+	}
+}
+
+inline void printStatusResult(const char* structure, int activeCount, double insertNs, double neighbourNs,
+	double removeNs) {
+	cout << "{\"bench\": \"status\", \"structure\": \"" << structure << "\", \"active\": " << activeCount
+		<< ", \"insert_ns\": " << insertNs / activeCount << ", \"neighbours_ns\": " << neighbourNs / activeCount
+		<< ", \"remove_ns\": " << removeNs / activeCount << "}" << endl;
+}
+
+/*
+ * Cost per operation of the sweep status structures with activeCount segments crossing the sweep line at once: the
+ * pointer based BinarySearchTree, a std::set as used by the STL engine, and the cache-conscious SweepStatusTree.
+ * Every segment is inserted, has its neighbours looked up, and is removed, each phase in a random order.
+ */
+inline bool benchmarkStatusStructures(int activeCount) {
+	bool agree = true;
+	mt19937 generator(3);
+	uniform_real_distribution<double> slope(-0.4, 0.4);
+	vector<LineSegment*> segments;
+
+	for (int i = 0; i < activeCount; i++)
+	{
+		segments.push_back(new LineSegment(Point(0.0, i), Point(1.0, i + slope(generator))));
+	}
+
+	vector<int> insertOrder(activeCount), queryOrder(activeCount), removeOrder(activeCount);
+	for (int i = 0; i < activeCount; i++)
+	{
+		insertOrder[i] = queryOrder[i] = removeOrder[i] = i;
+	}
+	shuffle(insertOrder.begin(), insertOrder.end(), generator);
+	shuffle(queryOrder.begin(), queryOrder.end(), generator);
+	shuffle(removeOrder.begin(), removeOrder.end(), generator);
+
+	long long checksum = 0;
+
+	{
+		BinarySearchTree tree;
+
+		auto start = chrono::high_resolution_clock::now();
+		for (int i : insertOrder)
+		{
+			tree.add(segments[i], segments[i]->getLeftEndpoint());
+		}
+		double insertNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : queryOrder)
+		{
+			Node* node = tree.findNode(segments[i], segments[i]->getLeftEndpoint());
+			checksum += node->getSuccessor() != nullptr;
+			checksum += node->getPredecessor() != nullptr;
+		}
+		double neighbourNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : removeOrder)
+		{
+			tree.remove(segments[i], segments[i]->getLeftEndpoint());
+		}
+		double removeNs = elapsedNs(start);
+
+		printStatusResult("BinarySearchTree", activeCount, insertNs, neighbourNs, removeNs);
+	}
+
+	{
+		double sweepX = 0.0;
+		auto below = [&sweepX](LineSegment* a, LineSegment* b) {
+			double aSlope = (a->getRightEndpoint().getY() - a->getLeftEndpoint().getY())
+				/ (a->getRightEndpoint().getX() - a->getLeftEndpoint().getX());
+			double bSlope = (b->getRightEndpoint().getY() - b->getLeftEndpoint().getY())
+				/ (b->getRightEndpoint().getX() - b->getLeftEndpoint().getX());
+			return a->getLeftEndpoint().getY() + aSlope * (sweepX - a->getLeftEndpoint().getX())
+				< b->getLeftEndpoint().getY() + bSlope * (sweepX - b->getLeftEndpoint().getX());
+		};
+		set<LineSegment*, decltype(below)> tree(below);
+
+		auto start = chrono::high_resolution_clock::now();
+		for (int i : insertOrder)
+		{
+			tree.insert(segments[i]);
+		}
+		double insertNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : queryOrder)
+		{
+			auto it = tree.find(segments[i]);
+			checksum += next(it) != tree.end();
+			checksum += it != tree.begin();
+		}
+		double neighbourNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : removeOrder)
+		{
+			tree.erase(segments[i]);
+		}
+		double removeNs = elapsedNs(start);
+
+		printStatusResult("std::set", activeCount, insertNs, neighbourNs, removeNs);
+	}
+
+	{
+		SweepStatusTree tree;
+
+		auto start = chrono::high_resolution_clock::now();
+		for (int i : insertOrder)
+		{
+			tree.insert(makeStatusEntry(i, segments[i]->getLeftEndpoint(), segments[i]->getRightEndpoint()), 0.0,
+				0.0);
+		}
+		double insertNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : queryOrder)
+		{
+			checksum += tree.above(i) != -1;
+			checksum += tree.below(i) != -1;
+		}
+		double neighbourNs = elapsedNs(start);
+
+		start = chrono::high_resolution_clock::now();
+		for (int i : removeOrder)
+		{
+			tree.remove(i);
+		}
+		double removeNs = elapsedNs(start);
+
+		printStatusResult("SweepStatusTree", activeCount, insertNs, neighbourNs, removeNs);
+	}
+
+	if (checksum != 6LL * (activeCount - 1))
+	{
+		agree = false;
+		cerr << "Status structures disagree on the neighbours of some segments" << endl;
+	}
+
+	return agree;
+}
+
+/*
+ * Pushes eventCount intersection events at random points into an EventQueue, then pops them all, reporting the cost
+ * per operation and the peak memory of the queue array.
+ */
+inline bool benchmarkEventQueue(int eventCount) {
+	bool agree = true;
+	mt19937 generator(4);
+	uniform_real_distribution<double> position(0.0, 1000.0);
+	EventQueue queue(1);
+
+	auto start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < eventCount; i++)
+	{
+		queue.add(Event(Point(position(generator), position(generator)), nullptr, nullptr, Type::INTERSECTION));
+	}
+	double addNs = elapsedNs(start);
+
+	start = chrono::high_resolution_clock::now();
+	double lastX = -1.0;
+	bool ordered = true;
+	while (!queue.isEmpty())
+	{
+		Event e = queue.removeMin();
+		ordered = ordered && e.getX() >= lastX - POINT_EPSILON;
+		lastX = e.getX();
+	}
+	double removeNs = elapsedNs(start);
+
+	if (!ordered)
+	{
+		agree = false;
+		cerr << "EventQueue returned events out of order" << endl;
+	}
+
+	cout << "{\"bench\": \"queue\", \"events\": " << eventCount << ", \"event_bytes\": " << sizeof(Event)
+		<< ", \"peak_queue_bytes\": " << queue.getPeakBytes() << ", \"add_ns\": " << addNs / eventCount
+		<< ", \"remove_min_ns\": " << removeNs / eventCount << "}" << endl;
+	return agree;
+}
+
+template <typename Engine, typename Coord>
+inline void runEngineBenchmark(const char* combination, vector<Coord>& coordinates, Engine& engine,
+	long long (*crossingCount)(Engine&)) {
+	auto start = chrono::high_resolution_clock::now();
+	engine.run(SegmentView<Coord>(coordinates.data(), coordinates.size() / 4));
+	double ns = elapsedNs(start);
+
+	cout << "{\"bench\": \"engine\", \"combination\": \"" << combination << "\", \"segments\": "
+		<< coordinates.size() / 4 << ", \"crossings\": " << crossingCount(engine) << ", \"ms\": " << ns / 1e6 << "}"
+		<< endl;
+}
+
+/*
+ * Runs SweepEngine on the same random segments with several combinations of coordinate type, tolerance and sink.
+ * int64_t coordinates are the double coordinates scaled by 1000 and rounded.
+ */
+inline void benchmarkSweepEngine(int segmentCount) {
+	vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, 2000.0 / sqrt((double)segmentCount), 5);
+	vector<float> floats;
+	vector<double> doubles;
+	vector<long double> longDoubles;
+	vector<int64_t> integers;
+
+	for (LineSegment* segment : segments)
+	{
+		double c[4] = { segment->getP1().getX(), segment->getP1().getY(), segment->getP2().getX(),
+			segment->getP2().getY() };
+
+		for (double d : c)
+		{
+			floats.push_back((float)d);
+			doubles.push_back(d);
+			longDoubles.push_back(d);
+			integers.push_back((int64_t)llround(d * 1000));
+		}
+		delete segment;
+	}
+
+	SweepEngine<float, ExactTolerance, CountSink> floatCount;
+	runEngineBenchmark<decltype(floatCount), float>("float/exact/count", floats, floatCount,
+		[](decltype(floatCount)& e) { return e.getSink().count; });
+
+	SweepEngine<double, DefaultTolerance, CountSink> doubleCount;
+	runEngineBenchmark<decltype(doubleCount), double>("double/epsilon/count", doubles, doubleCount,
+		[](decltype(doubleCount)& e) { return e.getSink().count; });
+
+	SweepEngine<double, DefaultTolerance, CollectSink<double>> doubleCollect;
+	runEngineBenchmark<decltype(doubleCollect), double>("double/epsilon/collect", doubles, doubleCollect,
+		[](decltype(doubleCollect)& e) { return (long long)e.getSink().points.size(); });
+
+	SweepEngine<long double, DefaultTolerance, CollectSink<long double>> longDoubleCollect;
+	runEngineBenchmark<decltype(longDoubleCollect), long double>("long double/epsilon/collect", longDoubles,
+		longDoubleCollect, [](decltype(longDoubleCollect)& e) { return (long long)e.getSink().points.size(); });
+
+	SweepEngine<int64_t, ExactTolerance, CountSink> integerCount;
+	runEngineBenchmark<decltype(integerCount), int64_t>("int64/exact/count", integers, integerCount,
+		[](decltype(integerCount)& e) { return e.getSink().count; });
+}
+
+/*
+ * Latency of window queries on a SpatialIndex over segmentCount random segments, for windows covering 1/1024, 1/64
+ * and 1/4 of the extent, against one sweep of the whole set.
+ */
+inline void benchmarkWindowQueries(int segmentCount) {
+	double extent = 1000.0;
+	vector<LineSegment*> segments = randomSegments(segmentCount, extent, 4000.0 / sqrt((double)segmentCount), 6);
+
+	auto start = chrono::high_resolution_clock::now();
+	SpatialIndex index(segments);
+	double buildNs = elapsedNs(start);
+
+	vector<double> coordinates = toCoordinates(segments);
+
+	SweepEngine<double, DefaultTolerance, CountSink> engine;
+	start = chrono::high_resolution_clock::now();
+	engine.run(SegmentView<double>(coordinates.data(), segments.size()));
+	double fullNs = elapsedNs(start);
+
+	cout << "{\"bench\": \"window\", \"segments\": " << segmentCount << ", \"grid\": \"" << index.getColumns() << "x"
+		<< index.getRows() << "\", \"build_ms\": " << buildNs / 1e6 << ", \"full_sweep_ms\": " << fullNs / 1e6
+		<< ", \"full_crossings\": " << engine.getSink().count << "}" << endl;
+
+	mt19937 generator(7);
+	int queryCount = 1000;
+	for (double fraction : { 1.0 / 32, 1.0 / 8, 1.0 / 2 })
+	{
+		double side = extent * fraction;
+		uniform_real_distribution<double> corner(0.0, extent - side);
+		long long crossings = 0, candidates = 0;
+
+		start = chrono::high_resolution_clock::now();
+		for (int q = 0; q < queryCount; q++)
+		{
+			double x = corner(generator), y = corner(generator);
+			crossings += index.query(x, y, x + side, y + side).size();
+			candidates += index.getLastCandidateCount();
+		}
+		double ns = elapsedNs(start);
+
+		cout << "{\"bench\": \"window\", \"window_area\": " << fraction * fraction << ", \"queries\": " << queryCount
+			<< ", \"mean_candidates\": " << (double)candidates / queryCount << ", \"mean_crossings\": "
+			<< (double)crossings / queryCount << ", \"mean_query_us\": " << ns / queryCount / 1e3 << "}" << endl;
+	}
+
+	for (LineSegment* segment : segments)
+	{
+		delete segment;
+	}
+}
+
+/*
+ * SweepEngine against InversionSweep on segmentCount random segments, with segments lengthened step by step from
+ * sparse to nearly all pairs crossing, to find the number of intersections per segment at which InversionSweep wins.
+ */
+inline bool benchmarkCrossover(int segmentCount) {
+	bool agree = true;
+	for (double maxLength : { 2.0, 8.0, 32.0, 128.0, 512.0, 2000.0 })
+	{
+		vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, maxLength, 8);
+		vector<double> coordinates = toCoordinates(segments);
+		for (LineSegment* segment : segments)
+		{
+			delete segment;
+		}
+		SegmentView<double> view(coordinates.data(), segmentCount);
+
+		SweepEngine<double, DefaultTolerance, CountSink> engine;
+		auto start = chrono::high_resolution_clock::now();
+		engine.run(view);
+		double sweepNs = elapsedNs(start);
+
+		InversionSweep<CountSink> inversions;
+		start = chrono::high_resolution_clock::now();
+		inversions.run(view);
+		double inversionNs = elapsedNs(start);
+
+		if (engine.getSink().count != inversions.getSink().count)
+		{
+			agree = false;
+			cerr << "SweepEngine and InversionSweep disagree: " << engine.getSink().count << " and "
+				<< inversions.getSink().count << endl;
+		}
+
+		cout << "{\"bench\": \"crossover\", \"segments\": " << segmentCount << ", \"max_length\": " << maxLength
+			<< ", \"crossings\": " << engine.getSink().count << ", \"crossings_per_segment\": "
+			<< (double)engine.getSink().count / segmentCount << ", \"sweep_ms\": " << sweepNs / 1e6
+			<< ", \"inversion_ms\": " << inversionNs / 1e6 << "}" << endl;
+	}
+
+	return agree;
+}
+
+/*
+ * SweepEngine::runRange on slabs covering 1/64, 1/8 and 1/2 of the width of segmentCount random segments, against one
+ * run over the whole set.
+ */
+inline void benchmarkRangeSweep(int segmentCount) {
+	double extent = 1000.0;
+	vector<LineSegment*> segments = randomSegments(segmentCount, extent, 4000.0 / sqrt((double)segmentCount), 8);
+
+	vector<double> coordinates = toCoordinates(segments);
+	SegmentView<double> view(coordinates.data(), segments.size());
+
+	SweepEngine<double, DefaultTolerance, CountSink> engine;
+	auto start = chrono::high_resolution_clock::now();
+	engine.run(view);
+	double fullNs = elapsedNs(start);
+
+	cout << "{\"bench\": \"range\", \"segments\": " << segmentCount << ", \"full_sweep_ms\": " << fullNs / 1e6
+		<< ", \"full_crossings\": " << engine.getSink().count << "}" << endl;
+
+	for (double fraction : { 1.0 / 64, 1.0 / 8, 1.0 / 2 })
+	{
+		double x0 = extent * (1.0 - fraction) / 2;
+		SweepEngine<double, DefaultTolerance, CountSink> range;
+		start = chrono::high_resolution_clock::now();
+		range.runRange(view, x0, x0 + extent * fraction);
+		double ns = elapsedNs(start);
+
+		cout << "{\"bench\": \"range\", \"width\": " << fraction << ", \"crossings\": " << range.getSink().count
+			<< ", \"ms\": " << ns / 1e6 << "}" << endl;
+	}
+
+	for (LineSegment* segment : segments)
+	{
+		delete segment;
+	}
+}
+
+/*
+ * Memory used by the sweep of bentley_ottmann.cpp on random segments of increasing number, with the breakdown of
+ * sweepMemory, so that the memory of a job can be estimated from its size before it is scheduled. The crossings are
+ * checked against SweepEngine, as an estimate from a sweep that lost some of them would be too low. Sizes beyond the
+ * segment ids an Event can hold are rejected.
+ */
+inline bool benchmarkSweepMemory(int segmentCount) {
+	if (segmentCount > Event::MAX_SEGMENTS)
+	{
+		cerr << "The sweep holds at most " << Event::MAX_SEGMENTS << " segments, not " << segmentCount << endl;
+		return false;
+	}
+
+	bool agree = true;
+	// Doubling stops before count could overflow.
+	for (int count = max(1, segmentCount / 8); count > 0; count = count <= segmentCount / 2 ? 2 * count : 0)
+	{
+		vector<LineSegment*> segments = randomSegments(count, 1000.0, 4000.0 / sqrt((double)count), 9);
+		vector<double> coordinates = toCoordinates(segments);
+
+		auto start = chrono::high_resolution_clock::now();
+		long long crossings = countIntersections(segments);
+		double ns = elapsedNs(start);
+
+		SweepEngine<double, DefaultTolerance, CountSink> engine;
+		engine.run(SegmentView<double>(coordinates.data(), count));
+
+		if (engine.getSink().count != crossings)
+		{
+			agree = false;
+			cerr << "The sweep and SweepEngine disagree: " << crossings << " and " << engine.getSink().count << endl;
+		}
+
+		cout << "{\"bench\": \"memory\", \"segments\": " << count << ", \"crossings\": " << crossings << ", \"ms\": "
+			<< ns / 1e6 << ", \"memory\": " << sweepMemory.toJson() << "}" << endl;
+
+		for (LineSegment* segment : segments)
+		{
+			delete segment;
+		}
+	}
+
+	return agree;
+}
+
+/*
+ * SweepDispatcher on segmentCount random segments lengthened step by step as in the crossover benchmark: the estimated
+ * against the actual number of intersections, and the engine picked with its predicted time against the measured
+ * time of SweepEngine and InversionSweep.
+ */
+inline bool benchmarkDispatch(int segmentCount) {
+	bool agree = true;
+	for (double maxLength : { 2.0, 8.0, 32.0, 128.0, 512.0, 2000.0 })
+	{
+		vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, maxLength, 8);
+		vector<double> coordinates = toCoordinates(segments);
+		for (LineSegment* segment : segments)
+		{
+			delete segment;
+		}
+		SegmentView<double> view(coordinates.data(), segmentCount);
+
+		SweepDispatcher dispatcher(false);
+		dispatcher.run(view);
+
+		SweepEngine<double, DefaultTolerance, CountSink> engine;
+		auto start = chrono::high_resolution_clock::now();
+		engine.run(view);
+		double sweepNs = elapsedNs(start);
+
+		InversionSweep<CountSink> inversions;
+		start = chrono::high_resolution_clock::now();
+		inversions.run(view);
+		double inversionNs = elapsedNs(start);
+
+		SweepEstimate& estimate = dispatcher.getEstimate();
+		SweepDecision& decision = dispatcher.getDecision();
+		cout << "{\"bench\": \"dispatch\", \"segments\": " << segmentCount << ", \"max_length\": " << maxLength
+			<< ", \"crossings\": " << engine.getSink().count << ", \"estimated_crossings\": " << estimate.crossings
+			<< ", \"estimate_ms\": " << estimate.ms << ", \"engine\": \"" << sweepChoiceName(decision.engine)
+			<< "\", \"slabs\": " << decision.slabs << ", \"predicted_sweep_ms\": " << decision.sweepMs
+			<< ", \"sweep_ms\": " << sweepNs / 1e6 << ", \"predicted_inversion_ms\": " << decision.inversionsMs
+			<< ", \"inversion_ms\": " << inversionNs / 1e6 << ", \"dispatched_ms\": " << dispatcher.getRunMs() << "}"
+			<< endl;
+
+		if (dispatcher.getCount() != engine.getSink().count)
+		{
+			agree = false;
+			cerr << "SweepDispatcher and SweepEngine disagree: " << dispatcher.getCount() << " and "
+				<< engine.getSink().count << endl;
+		}
+	}
+
+	return agree;
+}
+
+/*
+ * OrthogonalSweep against SweepEngine and InversionSweep on segmentCount random horizontal and vertical segments, half
+ * of each, on an integer grid as in layouts, so that many endpoints share their x or y. All three must find the same
+ * crossings.
+ */
+inline bool benchmarkOrthogonal(int segmentCount) {
+	bool agree = true;
+	mt19937 generator(8);
+	uniform_int_distribution<int> position(0, 9999);
+	uniform_int_distribution<int> length(1, 400);
+	vector<double> coordinates;
+	for (int i = 0; i < segmentCount; i++)
+	{
+		double x = position(generator), y = position(generator), l = length(generator);
+		if (i % 2 == 0)
+		{
+			coordinates.insert(coordinates.end(), { x, y, x + l, y });
+		}
+		else
+		{
+			coordinates.insert(coordinates.end(), { x, y, x, y + l });
+		}
+	}
+	SegmentView<double> view(coordinates.data(), segmentCount);
+
+	OrthogonalSweep<CountSink> orthogonal;
+	auto start = chrono::high_resolution_clock::now();
+	orthogonal.run(view);
+	double orthogonalNs = elapsedNs(start);
+
+	SweepEngine<double, DefaultTolerance, CountSink> engine;
+	start = chrono::high_resolution_clock::now();
+	engine.run(view);
+	double sweepNs = elapsedNs(start);
+
+	InversionSweep<CountSink> inversions;
+	start = chrono::high_resolution_clock::now();
+	inversions.run(view);
+	double inversionNs = elapsedNs(start);
+
+	if (orthogonal.getSink().count != inversions.getSink().count)
+	{
+		agree = false;
+		cerr << "OrthogonalSweep and InversionSweep disagree: " << orthogonal.getSink().count << " and "
+			<< inversions.getSink().count << endl;
+	}
+	if (orthogonal.getSink().count != engine.getSink().count)
+	{
+		agree = false;
+		cerr << "OrthogonalSweep and SweepEngine disagree: " << orthogonal.getSink().count << " and "
+			<< engine.getSink().count << endl;
+	}
+
+	cout << "{\"bench\": \"orthogonal\", \"segments\": " << segmentCount << ", \"crossings\": "
+		<< orthogonal.getSink().count << ", \"orthogonal_ms\": " << orthogonalNs / 1e6 << ", \"sweep_ms\": "
+		<< sweepNs / 1e6 << ", \"inversion_ms\": " << inversionNs / 1e6 << "}" << endl;
+	return agree;
+}
+
+/*
+ * KineticSweep over frames of segmentCount random segments, 3% of them moving by up to a tenth of the segment length
+ * each frame, against a SweepEngine run over every frame.
+ */
+inline bool benchmarkKineticSweep(int segmentCount) {
+	bool agree = true;
+	double maxLength = 4000.0 / sqrt((double)segmentCount);
+	vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, maxLength, 8);
+	vector<double> coordinates = toCoordinates(segments);
+	for (LineSegment* segment : segments)
+	{
+		delete segment;
+	}
+	SegmentView<double> view(coordinates.data(), segmentCount);
+
+	KineticSweep kinetic;
+	kinetic.reset(view);
+	cout << "{\"bench\": \"kinetic\", \"segments\": " << segmentCount << ", \"first_frame_ms\": "
+		<< kinetic.getUpdateMs() << ", \"crossings\": " << kinetic.getCount() << "}" << endl;
+
+	mt19937 generator(9);
+	uniform_int_distribution<int> pick(0, segmentCount - 1);
+	uniform_real_distribution<double> step(-maxLength / 20, maxLength / 20);
+	SweepEngine<double, DefaultTolerance, CountSink> engine;
+
+	for (int frame = 1; frame <= 10; frame++)
+	{
+		for (int i = 0; i < segmentCount * 3 / 100; i++)
+		{
+			double* c = &coordinates[4 * (size_t)pick(generator)];
+			double dx = step(generator), dy = step(generator);
+			c[0] += dx;
+			c[1] += dy;
+			c[2] += dx + step(generator);
+			c[3] += dy + step(generator);
+		}
+
+		kinetic.update(view);
+
+		engine.getSink().count = 0;
+		auto start = chrono::high_resolution_clock::now();
+		engine.run(view);
+		double sweepNs = elapsedNs(start);
+
+		if ((long long)kinetic.getCount() != engine.getSink().count)
+		{
+			agree = false;
+			cerr << "KineticSweep and SweepEngine disagree: " << kinetic.getCount() << " and "
+				<< engine.getSink().count << endl;
+		}
+
+		cout << "{\"bench\": \"kinetic\", \"frame\": " << frame << ", \"moved\": " << kinetic.getMovedCount()
+			<< ", \"swaps\": " << kinetic.getSwapCount() << ", \"candidates\": " << kinetic.getCandidateCount()
+			<< ", \"added\": " << kinetic.getAdded().size() << ", \"removed\": " << kinetic.getRemoved().size()
+			<< ", \"crossings\": " << kinetic.getCount() << ", \"update_ms\": " << kinetic.getUpdateMs()
+			<< ", \"sweep_ms\": " << sweepNs / 1e6 << "}" << endl;
+	}
+
+	return agree;
+}
+
+// Edges of closed rings given by their vertices, x and y, and the index of the first vertex of each ring followed by
+// the vertex count.
+inline vector<double> ringEdges(const vector<double>& vertices, const vector<uint32_t>& starts) {
+	vector<double> edges;
+	for (size_t r = 0; r + 1 < starts.size(); r++)
+	{
+		for (uint32_t a = starts[r]; a < starts[r + 1]; a++)
+		{
+			uint32_t b = a + 1 < starts[r + 1] ? a + 1 : starts[r];
+			edges.insert(edges.end(), { vertices[2 * a], vertices[2 * a + 1], vertices[2 * b], vertices[2 * b + 1] });
+		}
+	}
+
+	return edges;
+}
+
+/*
+ * SweepEngine::runChains over random polygon rings of 16 edges, against run over the same edges given as separate
+ * segments, which has twice the events. Then both again over many small sets of rings with their vertices on a 6 by
+ * 6 grid, where vertices lie on other edges, edges overlap and several rings pass through one point.
+ */
+inline bool benchmarkChains(int edgeCount) {
+	bool agree = true;
+	const int ringSize = 16;
+	int ringCount = max(1, edgeCount / ringSize);
+	double radius = 2000.0 / sqrt((double)ringCount);
+	mt19937 generator(10);
+	uniform_real_distribution<double> position(0.0, 1000.0);
+	uniform_real_distribution<double> scale(0.2, 1.0);
+
+	vector<double> vertices;
+	vector<uint32_t> starts;
+	for (int r = 0; r < ringCount; r++)
+	{
+		double cx = position(generator), cy = position(generator);
+		starts.push_back((uint32_t)(vertices.size() / 2));
+		for (int v = 0; v < ringSize; v++)
+		{
+			double angle = 2 * 3.14159265358979 * v / ringSize, length = radius * scale(generator);
+			vertices.push_back(cx + length * cos(angle));
+			vertices.push_back(cy + length * sin(angle));
+		}
+	}
+	starts.push_back((uint32_t)(vertices.size() / 2));
+	vector<double> edges = ringEdges(vertices, starts);
+	unique_ptr<bool[]> closed(new bool[ringCount]);
+	fill(closed.get(), closed.get() + ringCount, true);
+
+	SweepEngine<double, DefaultTolerance, CountSink> chained;
+	auto start = chrono::high_resolution_clock::now();
+	chained.runChains(ChainView<double>(vertices.data(), starts.data(), closed.get(), ringCount));
+	double chainNs = elapsedNs(start);
+
+	SweepEngine<double, DefaultTolerance, CountSink> separate;
+	start = chrono::high_resolution_clock::now();
+	separate.run(SegmentView<double>(edges.data(), edges.size() / 4));
+	double separateNs = elapsedNs(start);
+
+	if (chained.getSink().count != separate.getSink().count)
+	{
+		agree = false;
+		cerr << "Chain and separate edge sweeps disagree: " << chained.getSink().count << " and "
+			<< separate.getSink().count << endl;
+	}
+
+	cout << "{\"bench\": \"chains\", \"edges\": " << edges.size() / 4 << ", \"crossings\": "
+		<< chained.getSink().count << ", \"chain_events\": " << chained.getEventCount() << ", \"separate_events\": "
+		<< separate.getEventCount() << ", \"chain_ms\": " << chainNs / 1e6 << ", \"separate_ms\": "
+		<< separateNs / 1e6 << "}" << endl;
+
+	const int gridTrials = 1000, gridRings = 4;
+	bool gridClosed[gridRings] = { true, true, true, true };
+	uniform_int_distribution<int> gridPosition(0, 5);
+	uniform_int_distribution<int> gridRingSize(3, 8);
+	int mismatches = 0;
+	for (int t = 0; t < gridTrials; t++)
+	{
+		vertices.clear();
+		starts.clear();
+		for (int r = 0; r < gridRings; r++)
+		{
+			starts.push_back((uint32_t)(vertices.size() / 2));
+			for (int v = gridRingSize(generator); v > 0; v--)
+			{
+				vertices.push_back(gridPosition(generator));
+				vertices.push_back(gridPosition(generator));
+			}
+		}
+		starts.push_back((uint32_t)(vertices.size() / 2));
+		edges = ringEdges(vertices, starts);
+
+		chained.getSink().count = 0;
+		chained.runChains(ChainView<double>(vertices.data(), starts.data(), gridClosed, gridRings));
+		separate.getSink().count = 0;
+		separate.run(SegmentView<double>(edges.data(), edges.size() / 4));
+		mismatches += chained.getSink().count != separate.getSink().count;
+	}
+
+	if (mismatches > 0)
+	{
+		agree = false;
+		cerr << "Chain and separate edge sweeps disagree on " << mismatches << " of " << gridTrials
+			<< " sets of rings on a grid" << endl;
+	}
+
+	cout << "{\"bench\": \"chains\", \"grid_trials\": " << gridTrials << ", \"mismatches\": " << mismatches << "}"
+		<< endl;
+
+	return agree;
+}
+
+/*
+ * PersistentStatus over segmentCount random segments: the sweep that records it, its memory, and stabbing and point
+ * location queries at random x against a scan of all segments for each.
+ */
+inline bool benchmarkPersistentStatus(int segmentCount) {
+	bool agree = true;
+	double maxLength = 4000.0 / sqrt((double)segmentCount);
+	vector<LineSegment*> segments = randomSegments(segmentCount, 1000.0, maxLength, 11);
+	vector<double> coordinates = toCoordinates(segments);
+	for (LineSegment* segment : segments)
+	{
+		delete segment;
+	}
+
+	PersistentStatus status;
+	status.build(SegmentView<double>(coordinates.data(), segmentCount));
+
+	const int queryCount = 10000;
+	mt19937 generator(12);
+	uniform_real_distribution<double> position(0.0, 1000.0);
+	vector<double> queries;
+	for (int i = 0; i < 2 * queryCount; i++)
+	{
+		queries.push_back(position(generator));
+	}
+
+	vector<uint32_t> ids;
+	long long stabbed = 0, located = 0;
+	auto start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < queryCount; i++)
+	{
+		ids.clear();
+		status.stab(queries[2 * i], ids);
+		stabbed += ids.size();
+	}
+	double stabNs = elapsedNs(start);
+
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < queryCount; i++)
+	{
+		located += status.above(queries[2 * i], queries[2 * i + 1]) >= 0;
+	}
+	double aboveNs = elapsedNs(start);
+
+	long long scanned = 0;
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < queryCount; i++)
+	{
+		double x = queries[2 * i];
+		for (int j = 0; j < segmentCount; j++)
+		{
+			const double* c = &coordinates[4 * (size_t)j];
+			scanned += (min(c[0], c[2]) <= x) & (x < max(c[0], c[2]));
+		}
+	}
+	double scanNs = elapsedNs(start);
+
+	if (scanned != stabbed)
+	{
+		agree = false;
+		cerr << "Stabbing queries and scans disagree: " << stabbed << " and " << scanned << endl;
+	}
+
+	cout << "{\"bench\": \"persistent\", \"segments\": " << segmentCount << ", \"versions\": "
+		<< status.getVersionCount() << ", \"nodes\": " << status.getNodeCount() << ", \"memory_mb\": "
+		<< status.getMemoryBytes() / 1e6 << ", \"build_ms\": " << status.getBuildMs() << ", \"mean_stabbed\": "
+		<< (double)stabbed / queryCount << ", \"located\": " << located << ", \"stab_us\": "
+		<< stabNs / queryCount / 1e3 << ", \"above_us\": " << aboveNs / queryCount / 1e3 << ", \"scan_us\": "
+		<< scanNs / queryCount / 1e3 << "}" << endl;
+	return agree;
+}
+
+/*
+ * SweepEngine over segmentCount random segments in random input order, storing them in input order, in sweep order
+ * and along a Hilbert curve. The coordinates are generated directly rather than through LineSegment, so that inputs of
+ * ten million segments fit in memory.
+ */
+inline void benchmarkSegmentOrder(int segmentCount) {
+	mt19937 generator(13);
+	uniform_real_distribution<double> position(0.0, 1000.0);
+	double maxLength = 4000.0 / sqrt((double)segmentCount);
+	uniform_real_distribution<double> offset(-maxLength / 2, maxLength / 2);
+	vector<double> coordinates;
+	coordinates.reserve(4 * (size_t)segmentCount);
+	for (int i = 0; i < segmentCount; i++)
+	{
+		double x = position(generator), y = position(generator);
+		coordinates.insert(coordinates.end(), { x, y, x + offset(generator), y + offset(generator) });
+	}
+	SegmentView<double> view(coordinates.data(), segmentCount);
+
+	const SegmentOrder orders[] = { SegmentOrder::INPUT, SegmentOrder::SWEEP, SegmentOrder::HILBERT };
+	const char* names[] = { "input", "sweep", "hilbert" };
+	for (int i = 0; i < 3; i++)
+	{
+		SweepEngine<double, DefaultTolerance, CountSink> engine;
+		engine.setOrder(orders[i]);
+		auto start = chrono::high_resolution_clock::now();
+		engine.run(view);
+		double ns = elapsedNs(start);
+
+		cout << "{\"bench\": \"order\", \"order\": \"" << names[i] << "\", \"segments\": " << segmentCount
+			<< ", \"crossings\": " << engine.getSink().count << ", \"ms\": " << ns / 1e6 << "}" << endl;
+	}
+}
+
+/*
+ * Runs the benchmark of the given name on size elements, or on its default size if size is 0. Returns 1 for an unknown
+ * name, and also when a benchmark that checks its engines against each other found them disagreeing.
+ */
+inline int runBenchmark(string name, int size) {
+	bool agree = true;
+	if (name == "kernel")
+	{
+		benchmarkIntersectionKernel(size > 0 ? size : 100000);
+	}
+	else if (name == "status")
+	{
+		agree = benchmarkStatusStructures(size > 0 ? size : 100000);
+	}
+	else if (name == "queue")
+	{
+		agree = benchmarkEventQueue(size > 0 ? size : 1000000);
+	}
+	else if (name == "engine")
+	{
+		benchmarkSweepEngine(size > 0 ? size : 100000);
+	}
+	else if (name == "window")
+	{
+		benchmarkWindowQueries(size > 0 ? size : 1000000);
+	}
+	else if (name == "crossover")
+	{
+		agree = benchmarkCrossover(size > 0 ? size : 20000);
+	}
+	else if (name == "range")
+	{
+		benchmarkRangeSweep(size > 0 ? size : 1000000);
+	}
+	else if (name == "memory")
+	{
+		agree = benchmarkSweepMemory(size > 0 ? size : 8000);
+	}
+	else if (name == "dispatch")
+	{
+		agree = benchmarkDispatch(size > 0 ? size : 20000);
+	}
+	else if (name == "orthogonal")
+	{
+		agree = benchmarkOrthogonal(size > 0 ? size : 200000);
+	}
+	else if (name == "kinetic")
+	{
+		agree = benchmarkKineticSweep(size > 0 ? size : 200000);
+	}
+	else if (name == "chains")
+	{
+		agree = benchmarkChains(size > 0 ? size : 200000);
+	}
+	else if (name == "persistent")
+	{
+		agree = benchmarkPersistentStatus(size > 0 ? size : 100000);
+	}
+	else if (name == "order")
+	{
+		benchmarkSegmentOrder(size > 0 ? size : 10000000);
+	}
+	else
+	{
+		cerr << "Unknown benchmark: " << name << endl;
+		return 1;
+	}
+
+	return agree ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <vector>
+#include "Structures.h"
+#include "RadixSort.h"
+
+/*
+ * Pre-pass for --prefilter that drops the line segments whose bounding box overlaps no other bounding box, since those
+ * cannot intersect anything, before they cost two events and a status insertion and removal each. The boxes are swept
+ * along x: a box enters at its left x and leaves at its right x, entering before leaving at the same x so that
+ * touching boxes count as overlapping. The y intervals of the boxes crossing the sweep line are kept in a segment tree
+ * over the boxes in order of their bottom y, each node holding the highest top y below it among all boxes and among
+ * the boxes not yet found to overlap another. An entering box overlaps the boxes with their bottom at most its top
+ * and their top at least its bottom; the first maximum tells whether there is one, and the second leads to each box
+ * found for the first time, which is then taken out of it. Every box is found once, so the pass takes O(n log n).
+ */
+class BoundingBoxFilter {
+private:
+	long long inputCount;
+	long long keptCount;
+	int leafCount;
+	vector<double> anyTop; // highest top y below each node among the boxes crossing the sweep line
+	vector<double> unmatchedTop; // the same among those not yet found to overlap another box
+
+	void setLeaf(int position, double top, double unmatched) {
+		int node = position + leafCount;
+		anyTop[node] = top;
+		unmatchedTop[node] = unmatched;
+
+		for (node /= 2; node > 0; node /= 2)
+		{
+			anyTop[node] = max(anyTop[2 * node], anyTop[2 * node + 1]);
+			unmatchedTop[node] = max(unmatchedTop[2 * node], unmatchedTop[2 * node + 1]);
+		}
+	}
+
+	// Whether any leaf before end has a top y of at least bottom.
+	bool anyReaches(int end, double bottom) {
+		for (int left = leafCount, right = end + leafCount; left < right; left /= 2, right /= 2)
+		{
+			if ((left & 1) && anyTop[left++] >= bottom)
+			{
+				return true;
+			}
+			if ((right & 1) && anyTop[--right] >= bottom)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Appends the positions of the unmatched leaves below a node, before end, with a top y of at least bottom.
+	void collectUnmatched(int node, int nodeBegin, int nodeEnd, int end, double bottom, vector<int>& found) {
+		if (nodeBegin >= end || unmatchedTop[node] < bottom)
+		{
+			return;
+		}
+		else if (node >= leafCount)
+		{
+			found.push_back(node - leafCount);
+			return;
+		}
+
+		int middle = (nodeBegin + nodeEnd) / 2;
+		collectUnmatched(2 * node, nodeBegin, middle, end, bottom, found);
+		collectUnmatched(2 * node + 1, middle, nodeEnd, end, bottom, found);
+	}
+
+public:
+	BoundingBoxFilter() {
+		inputCount = keptCount = 0;
+		leafCount = 0;
+	}
+
+	// Returns the line segments whose bounding box overlaps at least one other, in their original order.
+	vector<LineSegment*> filter(vector<LineSegment*>& segments) {
+		int n = (int)segments.size();
+		vector<double> minX(n), maxX(n), minY(n), maxY(n);
+		vector<RadixRecord> bottoms(n);
+		vector<RadixRecord> sweepEvents(2 * (size_t)n);
+
+		for (int i = 0; i < n; i++)
+		{
+			Point p1 = segments[i]->getP1();
+			Point p2 = segments[i]->getP2();
+			minX[i] = min(p1.getX(), p2.getX());
+			maxX[i] = max(p1.getX(), p2.getX());
+			minY[i] = min(p1.getY(), p2.getY());
+			maxY[i] = max(p1.getY(), p2.getY());
+
+			bottoms[i] = { sortableBits(minY[i]), 0, (uint32_t)i };
+			sweepEvents[2 * i] = { sortableBits(minX[i]), 0, (uint32_t)i };
+			sweepEvents[2 * i + 1] = { sortableBits(maxX[i]), 1, (uint32_t)i };
+		}
+
+		parallelRadixSort(bottoms);
+		parallelRadixSort(sweepEvents);
+
+		vector<int> position(n);
+		vector<double> sortedBottom(n);
+		for (int p = 0; p < n; p++)
+		{
+			position[bottoms[p].index] = p;
+			sortedBottom[p] = minY[bottoms[p].index];
+		}
+
+		leafCount = 1;
+		while (leafCount < n)
+		{
+			leafCount *= 2;
+		}
+		anyTop.assign(2 * (size_t)leafCount, -HUGE_VAL);
+		unmatchedTop.assign(2 * (size_t)leafCount, -HUGE_VAL);
+
+		vector<bool> overlaps(n);
+		vector<int> found;
+		for (RadixRecord& e : sweepEvents)
+		{
+			int i = e.index;
+			if (e.secondary == 1)
+			{
+				setLeaf(position[i], -HUGE_VAL, -HUGE_VAL);
+				continue;
+			}
+
+			// The boxes crossing the sweep line with their bottom at most the top of this one.
+			int end = (int)(upper_bound(sortedBottom.begin(), sortedBottom.end(), maxY[i]) - sortedBottom.begin());
+			overlaps[i] = anyReaches(end, minY[i]);
+
+			found.clear();
+			collectUnmatched(1, 0, leafCount, end, minY[i], found);
+			for (int p : found)
+			{
+				overlaps[bottoms[p].index] = true;
+				setLeaf(p, anyTop[p + leafCount], -HUGE_VAL);
+			}
+
+			setLeaf(position[i], maxY[i], overlaps[i] ? -HUGE_VAL : maxY[i]);
+		}
+
+		vector<LineSegment*> candidates;
+		for (int i = 0; i < n; i++)
+		{
+			if (overlaps[i])
+			{
+				candidates.push_back(segments[i]);
+			}
+		}
+
+		inputCount += n;
+		keptCount += candidates.size();
+		return candidates;
+	}
+
+	// Fraction of all line segments given to filter so far that were dropped.
+	double getPrunedFraction() {
+		return inputCount > 0 ? (double)(inputCount - keptCount) / inputCount : 0.0;
+	}
+};
@@ -0,0 +1,1206 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Structures.h"
+#include "SweepEngine.h"
+#include "SweepStatusTree.h"
+
+/*
+ * Out-of-core sweep for inputs and outputs that do not fit in memory. Endpoints are sorted into runs on disk and
+ * merged back through small buffers, so only the active segments and the pending intersection events stay in memory.
+ * At most MERGE_FAN_IN runs are merged at once: more runs are first merged in passes into fewer, longer ones, so the
+ * number of open files stays bounded however large the input. Pending intersection events spill to disk as well once
+ * they exceed their share of the memory budget, their runs merged into one whenever MERGE_FAN_IN of them are open,
+ * and intersections are streamed to the output file as they are found.
+ *
+ * Should the active segments outgrow their share of the budget, the sweep starts over in horizontal bands, each swept
+ * in one pass over the endpoint runs, keeping the intersections inside it. Only the part of each segment inside the
+ * band is swept, so the status holds the segments crossing the sweep line within the band rather than all reaching
+ * into it: each enters the status where it enters the band, by way of a queue that spills to disk like the events,
+ * and leaves where it leaves the band. A band whose active segments still do not fit is cut in two, at a y taken from
+ * a sample of the segments, and swept again. Points are ordered as in SweepEngine and crossings computed the same way,
+ * so both find the same intersections. A file that cannot be opened, read or written ends the run with an error
+ * rather than a short result.
+ */
+
+// Runs merged at once, well below the number of files a process may have open: 512 streams with the MSVC runtime.
+const int MERGE_FAN_IN = 16;
+
+// An endpoint on disk. Left endpoints carry the other endpoint so that the segment can be rebuilt when it is inserted.
+struct EndpointRecord {
+	double x;
+	double y;
+	double otherX;
+	double otherY;
+	uint32_t id;
+	uint32_t type; // Type::LEFT or Type::RIGHT
+};
+
+// A crossing of two segments found during the sweep, lower being the segment below the other before the crossing.
+struct CrossingRecord {
+	double x;
+	double y;
+	uint32_t lowerId;
+	uint32_t upperId;
+};
+
+// Intersections are written to the output file in this binary format, one record per intersection.
+struct IntersectionRecord {
+	double x;
+	double y;
+	uint32_t firstId;
+	uint32_t secondId;
+};
+
+inline bool recordPrecedes(double ax, double ay, double bx, double by) {
+	if (ax != bx)
+	{
+		return ax < bx;
+	}
+
+	return ay < by;
+}
+
+// At one point, segments ending there come before segments starting there, as in SweepEngine.
+inline bool endpointPrecedes(const EndpointRecord& a, const EndpointRecord& b) {
+	if (a.x != b.x || a.y != b.y)
+	{
+		return recordPrecedes(a.x, a.y, b.x, b.y);
+	}
+	else if (a.type != b.type)
+	{
+		return a.type != (uint32_t)Type::LEFT;
+	}
+
+	return a.id < b.id;
+}
+
+inline bool crossingPrecedes(const CrossingRecord& a, const CrossingRecord& b) {
+	return recordPrecedes(a.x, a.y, b.x, b.y);
+}
+
+/*
+ * Reads a sorted run file through a buffer of a fixed number of records.
+ */
+template <typename T>
+class RunReader {
+private:
+	FILE* file;
+	string path;
+	vector<T> buffer;
+	size_t count;
+	size_t position;
+	bool failed;
+
+	void refill() {
+		count = file != nullptr ? fread(buffer.data(), sizeof(T), buffer.size(), file) : 0;
+		position = 0;
+
+		if (file != nullptr && ferror(file) && !failed)
+		{
+			failed = true;
+			cerr << "Could not read " << path << endl;
+		}
+	}
+
+public:
+	RunReader(string path, size_t bufferRecords) {
+		this->path = path;
+		buffer = vector<T>(bufferRecords > 0 ? bufferRecords : 1);
+		failed = false;
+		if (fopen_s(&file, path.c_str(), "rb") != 0 || file == nullptr)
+		{
+			file = nullptr;
+			failed = true;
+			cerr << "Could not open " << path << endl;
+		}
+		refill();
+	}
+
+	~RunReader() {
+		if (file != nullptr)
+		{
+			fclose(file);
+		}
+	}
+
+	RunReader(const RunReader&) = delete;
+	RunReader& operator=(const RunReader&) = delete;
+
+	bool isEmpty() {
+		return position == count;
+	}
+
+	// Whether the run could not be opened or read, so that the records given out are not all of it.
+	bool hasFailed() {
+		return failed;
+	}
+
+	string getPath() {
+		return path;
+	}
+
+	T& peek() {
+		return buffer[position];
+	}
+
+	T next() {
+		T record = buffer[position++];
+		if (position == count)
+		{
+			refill();
+		}
+		return record;
+	}
+};
+
+/*
+ * Appends records to a file through a buffer of a fixed number of records.
+ */
+template <typename T>
+class RecordWriter {
+private:
+	FILE* file;
+	string path;
+	vector<T> buffer;
+	bool failed;
+
+public:
+	RecordWriter(string path, size_t bufferRecords) {
+		this->path = path;
+		buffer.reserve(bufferRecords > 0 ? bufferRecords : 1);
+		failed = false;
+		if (fopen_s(&file, path.c_str(), "wb") != 0 || file == nullptr)
+		{
+			file = nullptr;
+			failed = true;
+			cerr << "Could not open " << path << " for writing" << endl;
+		}
+	}
+
+	~RecordWriter() {
+		close();
+	}
+
+	RecordWriter(const RecordWriter&) = delete;
+	RecordWriter& operator=(const RecordWriter&) = delete;
+
+	void add(const T& record) {
+		buffer.push_back(record);
+		if (buffer.size() == buffer.capacity())
+		{
+			flush();
+		}
+	}
+
+	void flush() {
+		if (file != nullptr && !buffer.empty()
+			&& fwrite(buffer.data(), sizeof(T), buffer.size(), file) != buffer.size())
+		{
+			fail();
+		}
+		buffer.clear();
+	}
+
+	// Writes out the buffer and closes the file. Returns false if any record could not be written.
+	bool close() {
+		flush();
+		if (file != nullptr)
+		{
+			if (fclose(file) != 0)
+			{
+				fail();
+			}
+			file = nullptr;
+		}
+
+		return !failed;
+	}
+
+	void fail() {
+		if (!failed)
+		{
+			failed = true;
+			cerr << "Could not write " << path << endl;
+		}
+	}
+
+	bool hasFailed() {
+		return failed;
+	}
+};
+
+// Merges what is left of the given runs into one new run. Returns false if a run could not be read or written.
+template <typename T, typename Less>
+bool mergeRuns(vector<RunReader<T>*>& readers, string path, Less less, size_t bufferRecords) {
+	auto runAfter = [&readers, &less](int a, int b) {
+		return less(readers[b]->peek(), readers[a]->peek());
+	};
+	priority_queue<int, vector<int>, decltype(runAfter)> merge(runAfter);
+	for (int i = 0; i < (int)readers.size(); i++)
+	{
+		if (!readers[i]->isEmpty())
+		{
+			merge.push(i);
+		}
+	}
+
+	RecordWriter<T> writer(path, bufferRecords);
+	while (!merge.empty() && !writer.hasFailed())
+	{
+		int i = merge.top();
+		merge.pop();
+		writer.add(readers[i]->next());
+		if (!readers[i]->isEmpty())
+		{
+			merge.push(i);
+		}
+	}
+
+	bool written = writer.close();
+	for (RunReader<T>* reader : readers)
+	{
+		written = written && !reader->hasFailed();
+	}
+	return written;
+}
+
+/*
+ * Priority queue of records, earliest first by Less, holding at most limit of them in memory. Beyond that the later
+ * half is written to a sorted run on disk, and the runs are merged into one whenever MERGE_FAN_IN of them are open.
+ */
+template <typename T, typename Less>
+class SpillQueue {
+private:
+	vector<T> heap;
+	vector<RunReader<T>*> runs;
+	string pathPrefix;
+	int runCount;
+	size_t limit;
+	Less less;
+	long long spilledCount;
+	bool failed;
+
+	// Buffer size of each run, so that the buffers of all runs open at once take as much memory as the heap.
+	size_t bufferRecords() {
+		return max((size_t)1, limit / MERGE_FAN_IN);
+	}
+
+	void spill() {
+		sort(heap.begin(), heap.end(), less);
+		size_t keep = heap.size() / 2;
+
+		string path = pathPrefix + to_string(runCount++) + ".bin";
+		RecordWriter<T> writer(path, bufferRecords());
+		for (size_t i = keep; i < heap.size(); i++)
+		{
+			writer.add(heap[i]);
+		}
+		failed = !writer.close() || failed;
+		spilledCount += heap.size() - keep;
+
+		heap.resize(keep);
+		make_heap(heap.begin(), heap.end(), [this](const T& a, const T& b) { return less(b, a); });
+		runs.push_back(new RunReader<T>(path, bufferRecords()));
+
+		if (runs.size() == (size_t)MERGE_FAN_IN)
+		{
+			string merged = pathPrefix + to_string(runCount++) + ".bin";
+			failed = !mergeRuns(runs, merged, less, bufferRecords()) || failed;
+			closeRuns();
+			runs.push_back(new RunReader<T>(merged, bufferRecords()));
+		}
+	}
+
+	void closeRuns() {
+		for (RunReader<T>* reader : runs)
+		{
+			failed = reader->hasFailed() || failed;
+			remove(reader->getPath().c_str());
+			delete reader;
+		}
+		runs.clear();
+	}
+
+	// Index of the run holding the earliest record, or -1 if all are exhausted.
+	int earliestRun() {
+		int best = -1;
+
+		for (int i = 0; i < (int)runs.size(); i++)
+		{
+			if (!runs[i]->isEmpty() && (best == -1 || less(runs[i]->peek(), runs[best]->peek())))
+			{
+				best = i;
+			}
+		}
+
+		return best;
+	}
+
+	bool runFirst(int run) {
+		return run != -1 && (heap.empty() || less(runs[run]->peek(), heap.front()));
+	}
+
+public:
+	SpillQueue() {
+		runCount = 0;
+		limit = 1;
+		less = Less();
+		spilledCount = 0;
+		failed = false;
+	}
+
+	~SpillQueue() {
+		closeRuns();
+	}
+
+	SpillQueue(const SpillQueue&) = delete;
+	SpillQueue& operator=(const SpillQueue&) = delete;
+
+	// Empties the queue, removing its runs, and names the runs it spills from now on by pathPrefix.
+	void reset(string pathPrefix, size_t limit, Less less) {
+		closeRuns();
+		heap.clear();
+		this->pathPrefix = pathPrefix;
+		this->limit = max((size_t)2, limit);
+		this->less = less;
+		runCount = 0;
+		spilledCount = 0;
+		failed = false;
+	}
+
+	void push(const T& record) {
+		heap.push_back(record);
+		push_heap(heap.begin(), heap.end(), [this](const T& a, const T& b) { return less(b, a); });
+
+		if (heap.size() > limit)
+		{
+			spill();
+		}
+	}
+
+	bool isEmpty() {
+		return heap.empty() && earliestRun() == -1;
+	}
+
+	T peek() {
+		int run = earliestRun();
+		return runFirst(run) ? runs[run]->peek() : heap.front();
+	}
+
+	T pop() {
+		int run = earliestRun();
+		if (runFirst(run))
+		{
+			return runs[run]->next();
+		}
+
+		T record = heap.front();
+		pop_heap(heap.begin(), heap.end(), [this](const T& a, const T& b) { return less(b, a); });
+		heap.pop_back();
+		return record;
+	}
+
+	// Whether a run could not be written or read back, so that records may have been lost.
+	bool hasFailed() {
+		for (RunReader<T>* reader : runs)
+		{
+			if (reader->hasFailed())
+			{
+				return true;
+			}
+		}
+		return failed;
+	}
+
+	long long getSpilledCount() {
+		return spilledCount;
+	}
+};
+
+/*
+ * The part of each segment lying in a band of y, widened by a margin on either side so that a crossing computed just
+ * inside the band, or on its edge, lies inside the parts of both segments.
+ */
+struct BandClip {
+	double bottom;
+	double top;
+	double margin;
+
+	// Whether the segment of a left endpoint record reaches into the band.
+	bool reaches(const EndpointRecord& e) const {
+		return max(e.y, e.otherY) >= bottom && min(e.y, e.otherY) <= top;
+	}
+
+	// The x range of the part in the band of the segment of a left endpoint record.
+	void span(const EndpointRecord& e, double& enterX, double& exitX) const {
+		enterX = e.x;
+		exitX = e.otherX;
+
+		// Vertical segments are active at a single x whatever their length, and horizontal ones reach in or not.
+		if (e.x != e.otherX && e.y != e.otherY)
+		{
+			double tBottom = (bottom - e.y) / (e.otherY - e.y);
+			double tTop = (top - e.y) / (e.otherY - e.y);
+			double tEnter = min(tBottom, tTop);
+			double tExit = max(tBottom, tTop);
+			if (tEnter > 0)
+			{
+				enterX = min(e.otherX, max(e.x, e.x + tEnter * (e.otherX - e.x) - margin));
+			}
+			if (tExit < 1)
+			{
+				exitX = max(enterX, min(e.otherX, e.x + tExit * (e.otherX - e.x) + margin));
+			}
+		}
+	}
+
+	// The point at which the segment of a left endpoint record enters the band.
+	void enter(const EndpointRecord& e, double& x, double& y) const {
+		double exitX;
+		span(e, x, exitX);
+		y = x == e.x ? e.y : SweepGeometry<double, DefaultTolerance>::yOn(e.x, e.y, e.otherX, e.otherY, x);
+	}
+
+	// The point at which the segment of a left endpoint record leaves the band.
+	void leave(const EndpointRecord& e, double& x, double& y) const {
+		double enterX;
+		span(e, enterX, x);
+		y = x == e.otherX ? e.otherY : SweepGeometry<double, DefaultTolerance>::yOn(e.x, e.y, e.otherX, e.otherY, x);
+	}
+};
+
+// Orders left endpoint records by the point at which their segments enter a band.
+struct EntryPrecedes {
+	BandClip clip;
+
+	bool operator()(const EndpointRecord& a, const EndpointRecord& b) const {
+		double ax, ay, bx, by;
+		clip.enter(a, ax, ay);
+		clip.enter(b, bx, by);
+		if (ax != bx || ay != by)
+		{
+			return recordPrecedes(ax, ay, bx, by);
+		}
+
+		return a.id < b.id;
+	}
+};
+
+// The point at which an active segment leaves the band being swept.
+struct ExitRecord {
+	double x;
+	double y;
+	uint32_t id;
+};
+
+inline bool exitAfter(const ExitRecord& a, const ExitRecord& b) {
+	return recordPrecedes(b.x, b.y, a.x, a.y);
+}
+
+class ExternalSweep {
+private:
+	size_t memoryBudget; // bytes
+	string tempDirectory;
+	int runCount;
+	vector<string> temporaryFiles;
+	bool failed;
+	long long intersectionCount;
+	double margin; // by which bands are widened, well above the rounding error of the largest coordinate
+
+	// Active segments live in slots, which are reused once a segment ends, so the status only ever holds slot numbers
+	// up to the largest number of segments active at once. Each slot keeps the left endpoint record of its segment.
+	SweepStatusTree status;
+	unordered_map<uint32_t, int> slotOfId;
+	vector<EndpointRecord> slotSegment;
+	vector<uint32_t> slotId;
+	vector<int> freeSlots;
+	vector<ExitRecord> exits; // heap of the points where the active segments leave the band, earliest first
+	size_t peakActive;
+	size_t statusLimit; // active segments that fit in the share of the memory budget left to the status
+
+	// Lowest and highest y of a uniform sample of the segments, where bands are cut.
+	vector<double> sampleY;
+	long long sampledCount;
+	mt19937_64 sampler;
+	int bandCount;
+
+	// Pending intersection events, and segments yet to enter the band being swept, both spilling to disk.
+	SpillQueue<CrossingRecord, bool (*)(const CrossingRecord&, const CrossingRecord&)> crossings;
+	SpillQueue<EndpointRecord, EntryPrecedes> entries;
+	size_t crossingLimit;
+	size_t entryLimit;
+	long long spilledCount;
+
+	static const size_t SAMPLE_SEGMENTS = 1 << 13;
+
+	string nextRunPath() {
+		string path = tempDirectory + "/bentley_ottmann_run_" + to_string(runCount++) + ".bin";
+		temporaryFiles.push_back(path);
+		return path;
+	}
+
+	template <typename T>
+	void writeRun(vector<T>& records, string path) {
+		FILE* file;
+		if (fopen_s(&file, path.c_str(), "wb") != 0 || file == nullptr)
+		{
+			cerr << "Could not open " << path << " for writing" << endl;
+			failed = true;
+			return;
+		}
+
+		bool written = fwrite(records.data(), sizeof(T), records.size(), file) == records.size();
+		written = fclose(file) == 0 && written;
+		if (!written)
+		{
+			cerr << "Could not write " << path << endl;
+			failed = true;
+		}
+	}
+
+	// Buffer size of each run merged at once, which share half of the memory budget.
+	template <typename T>
+	size_t mergeBufferRecords() {
+		return max((size_t)1, memoryBudget / 2 / (MERGE_FAN_IN + 1) / sizeof(T));
+	}
+
+	void sampleSegment(double y1, double y2) {
+		size_t slot = sampledCount < (long long)SAMPLE_SEGMENTS ? (size_t)sampledCount
+			: (size_t)(sampler() % (uint64_t)(sampledCount + 1));
+		sampledCount++;
+
+		if (slot >= SAMPLE_SEGMENTS)
+		{
+			return;
+		}
+		else if (2 * slot == sampleY.size())
+		{
+			sampleY.push_back(min(y1, y2));
+			sampleY.push_back(max(y1, y2));
+		}
+		else
+		{
+			sampleY[2 * slot] = min(y1, y2);
+			sampleY[2 * slot + 1] = max(y1, y2);
+		}
+	}
+
+	/*
+	 * Reads the segments and writes their endpoints to disk in sorted runs, each as large as the memory budget allows,
+	 * keeping a sample of the segments for cutting bands.
+	 */
+	vector<string> formEndpointRuns(string inputPath, long long& segmentCount) {
+		vector<string> runs;
+		FILE* input;
+		segmentCount = 0;
+
+		if (fopen_s(&input, inputPath.c_str(), "r") != 0 || input == nullptr)
+		{
+			cerr << "Could not open " << inputPath << endl;
+			failed = true;
+			return runs;
+		}
+
+		long long n;
+		if (fscanf_s(input, "%lld", &n) != 1)
+		{
+			cerr << "Could not read the segment count of " << inputPath << endl;
+			failed = true;
+			fclose(input);
+			return runs;
+		}
+
+		size_t runRecords = max((size_t)2, memoryBudget / sizeof(EndpointRecord));
+		vector<EndpointRecord> run;
+		run.reserve(runRecords);
+		double largest = 1.0;
+
+		for (long long i = 0; i < n && !failed; i++)
+		{
+			double x1, y1, x2, y2;
+			if (fscanf_s(input, "%lf%lf%lf%lf", &x1, &y1, &x2, &y2) != 4)
+			{
+				cerr << inputPath << " ends after " << i << " of " << n << " segments" << endl;
+				failed = true;
+				break;
+			}
+
+			// Endpoints in sweep order, as SweepEngine takes them.
+			if (x2 < x1 || (x2 == x1 && y2 < y1))
+			{
+				swap(x1, x2);
+				swap(y1, y2);
+			}
+
+			run.push_back({ x1, y1, x2, y2, (uint32_t)i, (uint32_t)Type::LEFT });
+			run.push_back({ x2, y2, x1, y1, (uint32_t)i, (uint32_t)Type::RIGHT });
+			sampleSegment(y1, y2);
+			largest = max(largest, max(max(fabs(x1), fabs(y1)), max(fabs(x2), fabs(y2))));
+			segmentCount++;
+
+			if (run.size() + 2 > runRecords)
+			{
+				sort(run.begin(), run.end(), endpointPrecedes);
+				runs.push_back(nextRunPath());
+				writeRun(run, runs.back());
+				run.clear();
+			}
+		}
+
+		if (!run.empty() && !failed)
+		{
+			sort(run.begin(), run.end(), endpointPrecedes);
+			runs.push_back(nextRunPath());
+			writeRun(run, runs.back());
+		}
+
+		margin = POINT_EPSILON * largest;
+		fclose(input);
+		return runs;
+	}
+
+	// Merges the endpoint runs MERGE_FAN_IN at a time, in as many passes as it takes to leave at most that many.
+	vector<string> mergeEndpointRuns(vector<string> runs) {
+		while (runs.size() > (size_t)MERGE_FAN_IN && !failed)
+		{
+			vector<string> merged;
+			for (size_t first = 0; first < runs.size() && !failed; first += MERGE_FAN_IN)
+			{
+				size_t end = min(runs.size(), first + MERGE_FAN_IN);
+				if (end - first == 1)
+				{
+					merged.push_back(runs[first]);
+					continue;
+				}
+
+				vector<RunReader<EndpointRecord>*> readers;
+				for (size_t i = first; i < end; i++)
+				{
+					readers.push_back(new RunReader<EndpointRecord>(runs[i], mergeBufferRecords<EndpointRecord>()));
+				}
+
+				merged.push_back(nextRunPath());
+				failed = !mergeRuns(readers, merged.back(), endpointPrecedes, mergeBufferRecords<EndpointRecord>())
+					|| failed;
+				for (size_t i = first; i < end; i++)
+				{
+					delete readers[i - first];
+					remove(runs[i].c_str());
+				}
+			}
+			runs.swap(merged);
+		}
+
+		return runs;
+	}
+
+	// Whether a segment directly below another rises more steeply, as it must to cross it ahead of the sweep point.
+	static bool converging(const EndpointRecord& lower, const EndpointRecord& upper) {
+		return (lower.otherX - lower.x) * (upper.otherY - upper.y)
+			< (lower.otherY - lower.y) * (upper.otherX - upper.x);
+	}
+
+	/*
+	 * Schedules the crossing of two adjacent segments if they converge, as SweepEngine does: a crossing computed
+	 * behind the sweep point is one through it put there by rounding, and is scheduled at the sweep point.
+	 */
+	void checkCrossing(int lowerSlot, int upperSlot, double sweepX, double sweepY) {
+		if (lowerSlot == -1 || upperSlot == -1)
+		{
+			return;
+		}
+
+		EndpointRecord& a = slotSegment[lowerSlot];
+		EndpointRecord& b = slotSegment[upperSlot];
+		double x, y;
+		if (!SweepGeometry<double, DefaultTolerance>::crossing(a.x, a.y, a.otherX, a.otherY, b.x, b.y, b.otherX,
+			b.otherY, x, y) || !converging(a, b))
+		{
+			return;
+		}
+
+		if (recordPrecedes(x, y, sweepX, sweepY))
+		{
+			x = sweepX;
+			y = sweepY;
+		}
+		crossings.push({ x, y, slotId[lowerSlot], slotId[upperSlot] });
+	}
+
+	int allocateSlot(const EndpointRecord& left) {
+		int slot;
+
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			slotSegment[slot] = left;
+			slotId[slot] = left.id;
+		}
+		else
+		{
+			slot = (int)slotSegment.size();
+			slotSegment.push_back(left);
+			slotId.push_back(left.id);
+		}
+
+		slotOfId[left.id] = slot;
+		peakActive = max(peakActive, slotOfId.size());
+		return slot;
+	}
+
+	// Opens the endpoint runs and a heap holding the index of each that still has records, earliest first.
+	class EndpointMerge {
+	public:
+		vector<RunReader<EndpointRecord>*> readers;
+		vector<int> heap;
+
+		static bool runAfter(vector<RunReader<EndpointRecord>*>& readers, int a, int b) {
+			return endpointPrecedes(readers[b]->peek(), readers[a]->peek());
+		}
+
+		EndpointMerge(const vector<string>& runs, size_t bufferRecords) {
+			for (const string& path : runs)
+			{
+				readers.push_back(new RunReader<EndpointRecord>(path, bufferRecords));
+				if (!readers.back()->isEmpty())
+				{
+					heap.push_back((int)readers.size() - 1);
+				}
+			}
+			make_heap(heap.begin(), heap.end(), [this](int a, int b) { return runAfter(readers, a, b); });
+		}
+
+		~EndpointMerge() {
+			for (RunReader<EndpointRecord>* reader : readers)
+			{
+				delete reader;
+			}
+		}
+
+		bool isEmpty() {
+			return heap.empty();
+		}
+
+		EndpointRecord& peek() {
+			return readers[heap.front()]->peek();
+		}
+
+		EndpointRecord next() {
+			auto after = [this](int a, int b) { return runAfter(readers, a, b); };
+			pop_heap(heap.begin(), heap.end(), after);
+			EndpointRecord record = readers[heap.back()]->next();
+			if (readers[heap.back()]->isEmpty())
+			{
+				heap.pop_back();
+			}
+			else
+			{
+				push_heap(heap.begin(), heap.end(), after);
+			}
+			return record;
+		}
+
+		bool hasFailed() {
+			for (RunReader<EndpointRecord>* reader : readers)
+			{
+				if (reader->hasFailed())
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	// Whether two segments lie within POINT_EPSILON of each other at x, and still cross ahead of the point (x, y).
+	bool crossesAhead(int lowerSlot, int upperSlot, double x, double y) {
+		EndpointRecord& a = slotSegment[lowerSlot];
+		EndpointRecord& b = slotSegment[upperSlot];
+		double crossingX, crossingY;
+		if (a.x == a.otherX || b.x == b.otherX || fabs(SweepGeometry<double, DefaultTolerance>::yOn(a.x, a.y,
+			a.otherX, a.otherY, x) - SweepGeometry<double, DefaultTolerance>::yOn(b.x, b.y, b.otherX, b.otherY, x))
+			>= POINT_EPSILON)
+		{
+			return false;
+		}
+
+		return SweepGeometry<double, DefaultTolerance>::crossing(a.x, a.y, a.otherX, a.otherY, b.x, b.y, b.otherX,
+			b.otherY, crossingX, crossingY) && recordPrecedes(x, y, crossingX, crossingY);
+	}
+
+	/*
+	 * Inserts a segment at the point (x, y) where it enters the band, and schedules its leaving. Within POINT_EPSILON
+	 * of a neighbour there, a segment is put in their order right of the sweep line, as segments starting at one
+	 * point are. One entering the band part way along may yet have to cross that neighbour, so it is moved back past
+	 * each such neighbour, into the order the two have before their crossing.
+	 */
+	void insertSegment(const EndpointRecord& left, const BandClip& clip, double x, double y) {
+		int slot = allocateSlot(left);
+		status.insert(makeStatusEntry(slot, Point(left.x, left.y), Point(left.otherX, left.otherY)), x, y);
+		if (x != left.x)
+		{
+			for (int above = status.above(slot); above != -1 && crossesAhead(slot, above, x, y);
+				above = status.above(slot))
+			{
+				status.swap(slot, above);
+			}
+			for (int below = status.below(slot); below != -1 && crossesAhead(below, slot, x, y);
+				below = status.below(slot))
+			{
+				status.swap(below, slot);
+			}
+		}
+		checkCrossing(slot, status.above(slot), x, y);
+		checkCrossing(status.below(slot), slot, x, y);
+
+		ExitRecord exit;
+		exit.id = left.id;
+		clip.leave(left, exit.x, exit.y);
+		exits.push_back(exit);
+		push_heap(exits.begin(), exits.end(), exitAfter);
+	}
+
+	void removeSegment() {
+		ExitRecord exit = exits.front();
+		pop_heap(exits.begin(), exits.end(), exitAfter);
+		exits.pop_back();
+
+		auto found = slotOfId.find(exit.id);
+		int slot = found->second;
+		int above = status.above(slot);
+		int below = status.below(slot);
+		status.remove(slot);
+		slotOfId.erase(found);
+		freeSlots.push_back(slot);
+		checkCrossing(below, above, exit.x, exit.y);
+	}
+
+	/*
+	 * Whether the crossing of two segments lies in the band of bottom <= y < top. A crossing through a point where
+	 * others cross is scheduled at whichever sweep point it was found from, which differs between bands, so the band is
+	 * told by the crossing computed from the pair alone, lower id first.
+	 */
+	bool insideBand(int firstSlot, int secondSlot, double bottom, double top) {
+		if (bottom == -HUGE_VAL && top == HUGE_VAL)
+		{
+			return true;
+		}
+
+		if (slotId[secondSlot] < slotId[firstSlot])
+		{
+			swap(firstSlot, secondSlot);
+		}
+		EndpointRecord& a = slotSegment[firstSlot];
+		EndpointRecord& b = slotSegment[secondSlot];
+		double x, y;
+		SweepGeometry<double, DefaultTolerance>::crossing(a.x, a.y, a.otherX, a.otherY, b.x, b.y, b.otherX, b.otherY,
+			x, y);
+		return y >= bottom && y < top;
+	}
+
+	void processCrossing(RecordWriter<IntersectionRecord>& output, double bottom, double top) {
+		CrossingRecord crossing = crossings.pop();
+		auto lower = slotOfId.find(crossing.lowerId);
+		auto upper = slotOfId.find(crossing.upperId);
+
+		// Events are not removed when their segments stop being adjacent, so check that the pair is still adjacent
+		// and in its order before the crossing. This also discards duplicates of an event.
+		if (lower == slotOfId.end() || upper == slotOfId.end() || status.below(upper->second) != lower->second)
+		{
+			return;
+		}
+
+		int lowerSlot = lower->second;
+		int upperSlot = upper->second;
+		if (insideBand(lowerSlot, upperSlot, bottom, top))
+		{
+			output.add({ crossing.x, crossing.y, crossing.lowerId, crossing.upperId });
+			intersectionCount++;
+		}
+
+		status.swap(lowerSlot, upperSlot);
+		checkCrossing(status.below(upperSlot), upperSlot, crossing.x, crossing.y);
+		checkCrossing(lowerSlot, status.above(lowerSlot), crossing.x, crossing.y);
+	}
+
+	/*
+	 * Sweeps the band of bottom <= y < top in one pass over the endpoint runs, writing the intersections inside it to
+	 * output. Only the part of each segment in the band, widened by the margin, is swept: the segment is inserted
+	 * where it enters the band, through a queue of entries that spills to disk, and removed where it leaves. Gives up
+	 * and returns false as soon as more segments are active than fit in the status share of the memory budget.
+	 */
+	bool sweepBand(const vector<string>& runs, double bottom, double top, RecordWriter<IntersectionRecord>& output) {
+		BandClip clip = { bottom - margin, top + margin, margin };
+		status.clear();
+		slotOfId.clear();
+		slotSegment.clear();
+		slotId.clear();
+		freeSlots.clear();
+		exits.clear();
+		crossings.reset(tempDirectory + "/bentley_ottmann_crossings_", crossingLimit, crossingPrecedes);
+		entries.reset(tempDirectory + "/bentley_ottmann_entries_", entryLimit, EntryPrecedes{ clip });
+
+		EndpointMerge merge(runs, mergeBufferRecords<EndpointRecord>());
+		bool fits = true;
+		while (fits && !failed && !output.hasFailed())
+		{
+			// Right endpoints are stood for by the exits. Segments of length 0 cross nothing.
+			while (!merge.isEmpty() && (merge.peek().type != (uint32_t)Type::LEFT || !clip.reaches(merge.peek())
+				|| (merge.peek().x == merge.peek().otherX && merge.peek().y == merge.peek().otherY)))
+			{
+				merge.next();
+			}
+
+			// At one point, segments leave first, then cross, then start or enter, as in SweepEngine.
+			enum { NONE, EXIT, CROSSING, START, ENTRY } source = NONE;
+			double x = 0.0, y = 0.0;
+			if (!exits.empty())
+			{
+				source = EXIT;
+				x = exits.front().x;
+				y = exits.front().y;
+			}
+			if (!crossings.isEmpty())
+			{
+				CrossingRecord crossing = crossings.peek();
+				if (source == NONE || recordPrecedes(crossing.x, crossing.y, x, y))
+				{
+					source = CROSSING;
+					x = crossing.x;
+					y = crossing.y;
+				}
+			}
+			if (!merge.isEmpty() && (source == NONE || recordPrecedes(merge.peek().x, merge.peek().y, x, y)))
+			{
+				source = START;
+				x = merge.peek().x;
+				y = merge.peek().y;
+			}
+			if (!entries.isEmpty())
+			{
+				double entryX, entryY;
+				clip.enter(entries.peek(), entryX, entryY);
+				if (source == NONE || recordPrecedes(entryX, entryY, x, y))
+				{
+					source = ENTRY;
+				}
+			}
+
+			if (source == NONE)
+			{
+				break;
+			}
+			else if (source == EXIT)
+			{
+				removeSegment();
+			}
+			else if (source == CROSSING)
+			{
+				processCrossing(output, bottom, top);
+			}
+			else
+			{
+				// A segment starting below or above the band waits in the entries until it reaches the band.
+				EndpointRecord left = source == START ? merge.next() : entries.pop();
+				double enterX, enterY;
+				clip.enter(left, enterX, enterY);
+				if (source == START && enterX != left.x)
+				{
+					entries.push(left);
+					continue;
+				}
+
+				insertSegment(left, clip, enterX, enterY);
+				fits = slotOfId.size() <= statusLimit;
+			}
+		}
+
+		failed = merge.hasFailed() || crossings.hasFailed() || entries.hasFailed() || failed;
+		spilledCount += crossings.getSpilledCount();
+		crossings.reset(tempDirectory + "/bentley_ottmann_crossings_", crossingLimit, crossingPrecedes);
+		entries.reset(tempDirectory + "/bentley_ottmann_entries_", entryLimit, EntryPrecedes{ clip });
+		return fits;
+	}
+
+	/*
+	 * Cuts a band whose active segments did not fit in two, at the median of the sampled y inside it, or halfway when
+	 * there is none. Pushes the upper half and then the lower one, or returns false if the band cannot be cut.
+	 */
+	bool cutBand(double bottom, double top, const vector<double>& sample, vector<pair<double, double>>& bands) {
+		auto inside = upper_bound(sample.begin(), sample.end(), bottom);
+		size_t count = lower_bound(inside, sample.end(), top) - inside;
+		double cut;
+
+		if (count > 0)
+		{
+			cut = *(inside + count / 2);
+		}
+		else if (isfinite(bottom) && isfinite(top))
+		{
+			cut = bottom + (top - bottom) / 2;
+		}
+		else if (isfinite(bottom) || isfinite(top))
+		{
+			cut = isfinite(bottom) ? bottom + max(1.0, fabs(bottom)) : top - max(1.0, fabs(top));
+		}
+		else
+		{
+			return false;
+		}
+
+		if (!(cut > bottom && cut < top))
+		{
+			return false;
+		}
+		bands.push_back(make_pair(cut, top));
+		bands.push_back(make_pair(bottom, cut));
+		return true;
+	}
+
+	/*
+	 * Sweeps the input in bands from the bottom up, each into a run of its own that is appended to the output once the
+	 * band is done. A band whose active segments do not fit is cut in two and both halves are swept instead.
+	 */
+	void sweepInBands(const vector<string>& runs, RecordWriter<IntersectionRecord>& output) {
+		vector<double> sample = sampleY;
+		sort(sample.begin(), sample.end());
+		sample.erase(unique(sample.begin(), sample.end()), sample.end());
+
+		vector<pair<double, double>> bands;
+		if (!cutBand(-HUGE_VAL, HUGE_VAL, sample, bands))
+		{
+			failed = true;
+		}
+
+		while (!bands.empty() && !failed)
+		{
+			double bottom = bands.back().first;
+			double top = bands.back().second;
+			bands.pop_back();
+
+			long long found = intersectionCount;
+			string path = nextRunPath();
+			RecordWriter<IntersectionRecord>* bandOutput =
+				new RecordWriter<IntersectionRecord>(path, mergeBufferRecords<IntersectionRecord>());
+			bool fits = sweepBand(runs, bottom, top, *bandOutput);
+			failed = !bandOutput->close() || failed;
+			delete bandOutput;
+
+			if (fits && !failed)
+			{
+				RunReader<IntersectionRecord> band(path, mergeBufferRecords<IntersectionRecord>());
+				while (!band.isEmpty() && !output.hasFailed())
+				{
+					output.add(band.next());
+				}
+				failed = band.hasFailed() || failed;
+				bandCount++;
+			}
+			else if (!failed)
+			{
+				intersectionCount = found;
+				if (!cutBand(bottom, top, sample, bands))
+				{
+					cerr << "More segments around y = " << bottom << " are active at once than the " << statusLimit
+						<< " that fit in the memory budget" << endl;
+					failed = true;
+				}
+			}
+			remove(path.c_str());
+		}
+	}
+
+	void cleanUp() {
+		crossings.reset(tempDirectory + "/bentley_ottmann_crossings_", crossingLimit, crossingPrecedes);
+		entries.reset(tempDirectory + "/bentley_ottmann_entries_", entryLimit, EntryPrecedes());
+
+		for (string& path : temporaryFiles)
+		{
+			remove(path.c_str());
+		}
+		temporaryFiles.clear();
+	}
+
+public:
+	ExternalSweep(size_t memoryBudget, string tempDirectory) {
+		this->memoryBudget = max((size_t)(1 << 16), memoryBudget);
+		this->tempDirectory = tempDirectory;
+		runCount = 0;
+		failed = false;
+		intersectionCount = 0;
+		margin = 0.0;
+		peakActive = 0;
+		spilledCount = 0;
+		sampledCount = 0;
+		bandCount = 0;
+		crossingLimit = max((size_t)1024, this->memoryBudget / 8 / sizeof(CrossingRecord));
+		entryLimit = max((size_t)1024, this->memoryBudget / 8 / sizeof(EndpointRecord));
+		statusLimit = max((size_t)64, this->memoryBudget / 4
+			/ (sizeof(StatusEntry) + sizeof(EndpointRecord) + sizeof(ExitRecord) + 32));
+	}
+
+	~ExternalSweep() {
+		cleanUp();
+	}
+
+	/*
+	 * Finds all intersections of the segments in the input file, in the same text format as in.txt, and writes them
+	 * to the output file as IntersectionRecords. Returns the number of intersections, or -1 if the input could not be
+	 * read in full, a temporary or the output file could not be read or written, or the status did not fit.
+	 */
+	long long run(string inputPath, string outputPath) {
+		failed = false;
+		intersectionCount = 0;
+		peakActive = 0;
+		spilledCount = 0;
+		sampleY.clear();
+		sampledCount = 0;
+		sampler.seed(1);
+		bandCount = 1;
+
+		long long segmentCount;
+		vector<string> runs = mergeEndpointRuns(formEndpointRuns(inputPath, segmentCount));
+
+		unique_ptr<RecordWriter<IntersectionRecord>> output(
+			new RecordWriter<IntersectionRecord>(outputPath, mergeBufferRecords<IntersectionRecord>()));
+		if (!failed && !sweepBand(runs, -HUGE_VAL, HUGE_VAL, *output) && !failed)
+		{
+			// The active segments outgrew their share of the budget: start over in bands, from an empty output.
+			output->close();
+			output.reset(new RecordWriter<IntersectionRecord>(outputPath, mergeBufferRecords<IntersectionRecord>()));
+			intersectionCount = 0;
+			bandCount = 0;
+			sweepInBands(runs, *output);
+		}
+
+		failed = !output->close() || failed;
+		cleanUp();
+		return failed ? -1 : intersectionCount;
+	}
+
+	size_t getPeakActiveSegments() {
+		return peakActive;
+	}
+
+	long long getSpilledEventCount() {
+		return spilledCount;
+	}
+
+	int getRunCount() {
+		return runCount;
+	}
+
+	// Bands of y swept by the last run, 1 unless its active segments outgrew their share of the memory budget.
+	int getBandCount() {
+		return bandCount;
+	}
+};
@@ -0,0 +1,442 @@
+#pragma once
+#include <vector>
+#include "Structures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 code for functions explicitly marked for it, MSVC emits it anywhere.
+#if defined(KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define KERNEL_TARGET_AVX2
+#endif
+
+enum class KernelLevel { SCALAR, SSE2, AVX2 };
+
+/*
+ * The rules a pair is tested with:
+ *  - LINE_SEGMENT, those of LineSegment::getIntersectionPointWith, with the bounding boxes compared first,
+ *  - SWEEP, those of SweepGeometry::crossing on doubles with the default tolerance: only the straddle tests, whose
+ *    orientations are computed exactly as there, so a pair is a hit if and only if SweepEngine takes it as crossing.
+ *    The bounding boxes are not compared, as rounding could then reject a pair the engine accepts.
+ */
+enum class KernelRules { LINE_SEGMENT, SWEEP };
+
+/*
+ * Structure of arrays holding the endpoints and bounding boxes of a set of line segments, so that the batched
+ * intersection kernel can load the coordinates of several segments at once. Segments are referred to by their index
+ * in the batch.
+ */
+class SegmentBatch {
+public:
+	vector<double> x1, y1, x2, y2;
+	vector<double> minX, maxX, minY, maxY;
+
+	SegmentBatch() {}
+
+	SegmentBatch(vector<LineSegment*>& segments) {
+		for (LineSegment* s : segments)
+		{
+			add(s);
+		}
+	}
+
+	void add(LineSegment* s) {
+		add(s->getP1().getX(), s->getP1().getY(), s->getP2().getX(), s->getP2().getY());
+	}
+
+	void add(double ax, double ay, double bx, double by) {
+		x1.push_back(ax);
+		y1.push_back(ay);
+		x2.push_back(bx);
+		y2.push_back(by);
+		minX.push_back(ax < bx ? ax : bx);
+		maxX.push_back(ax < bx ? bx : ax);
+		minY.push_back(ay < by ? ay : by);
+		maxY.push_back(ay < by ? by : ay);
+	}
+
+	void clear() {
+		for (vector<double>* v : { &x1, &y1, &x2, &y2, &minX, &maxX, &minY, &maxY })
+		{
+			v->clear();
+		}
+	}
+
+	int size() {
+		return (int)x1.size();
+	}
+};
+
+class IntersectionKernel {
+private:
+	/*
+	 * Tests a single pair with exactly the rules of LineSegment::getIntersectionPointWith: the pair crosses if the
+	 * bounding boxes overlap, no endpoints are shared, the segments are not collinear and each segment straddles the
+	 * other. With the sweep rules only the straddle tests are made.
+	 */
+	template <bool sweepRules>
+	static bool testPairScalar(SegmentBatch& b, int i, int j) {
+		if (!sweepRules
+			&& (b.maxX[i] < b.minX[j] || b.maxX[j] < b.minX[i] || b.maxY[i] < b.minY[j] || b.maxY[j] < b.minY[i]))
+		{
+			return false;
+		}
+
+		double ax1 = b.x1[i], ay1 = b.y1[i], ax2 = b.x2[i], ay2 = b.y2[i];
+		double bx1 = b.x1[j], by1 = b.y1[j], bx2 = b.x2[j], by2 = b.y2[j];
+
+		if (!sweepRules && ((fabs(ax1 - bx1) < POINT_EPSILON && fabs(ay1 - by1) < POINT_EPSILON)
+			|| (fabs(ax1 - bx2) < POINT_EPSILON && fabs(ay1 - by2) < POINT_EPSILON)
+			|| (fabs(ax2 - bx1) < POINT_EPSILON && fabs(ay2 - by1) < POINT_EPSILON)
+			|| (fabs(ax2 - bx2) < POINT_EPSILON && fabs(ay2 - by2) < POINT_EPSILON)))
+		{
+			return false;
+		}
+
+		double adx = ax2 - ax1, ady = ay2 - ay1;
+		double bdx = bx2 - bx1, bdy = by2 - by1;
+
+		// Orientations of the endpoints of each segment relative to the other, as in LineSegment::straddles.
+		double o1 = (bx1 - ax1) * ady - (by1 - ay1) * adx;
+		double o2 = (bx2 - ax1) * ady - (by2 - ay1) * adx;
+		double o3 = (ax1 - bx1) * bdy - (ay1 - by1) * bdx;
+		double o4 = (ax2 - bx1) * bdy - (ay2 - by1) * bdx;
+
+		// Collinearity is tested on the triangle areas, which are half the orientations.
+		if (!sweepRules && fabs(0.5 * o1) < POINT_EPSILON && fabs(0.5 * o2) < POINT_EPSILON)
+		{
+			return false;
+		}
+
+		return fabs(o1) >= POINT_EPSILON && fabs(o2) >= POINT_EPSILON && (o1 < 0.0) != (o2 < 0.0)
+			&& fabs(o3) >= POINT_EPSILON && fabs(o4) >= POINT_EPSILON && (o3 < 0.0) != (o4 < 0.0);
+	}
+
+	template <bool sweepRules>
+	static void testPairsScalar(SegmentBatch& b, const int* first, const int* second, int count,
+		unsigned char* hits) {
+		for (int p = 0; p < count; p++)
+		{
+			hits[p] = testPairScalar<sweepRules>(b, first[p], second[p]) ? 1 : 0;
+		}
+	}
+
+#ifdef KERNEL_X86
+	static __m128d absSse2(__m128d v) {
+		return _mm_andnot_pd(_mm_set1_pd(-0.0), v);
+	}
+
+	static __m128d sharesPointSse2(__m128d ax, __m128d ay, __m128d bx, __m128d by, __m128d eps) {
+		return _mm_and_pd(_mm_cmplt_pd(absSse2(_mm_sub_pd(ax, bx)), eps),
+			_mm_cmplt_pd(absSse2(_mm_sub_pd(ay, by)), eps));
+	}
+
+	// Mask of the lanes where o1 and o2 are both at least epsilon away from zero and have opposite signs.
+	static __m128d straddlesSse2(__m128d o1, __m128d o2, __m128d eps) {
+		__m128d zero = _mm_setzero_pd();
+		__m128d opposite = _mm_xor_pd(_mm_cmplt_pd(o1, zero), _mm_cmplt_pd(o2, zero));
+		return _mm_and_pd(opposite,
+			_mm_and_pd(_mm_cmpge_pd(absSse2(o1), eps), _mm_cmpge_pd(absSse2(o2), eps)));
+	}
+
+	template <bool sweepRules>
+	static void testPairsSse2(SegmentBatch& b, const int* first, const int* second, int count,
+		unsigned char* hits) {
+		const __m128d eps = _mm_set1_pd(POINT_EPSILON);
+		const __m128d half = _mm_set1_pd(0.5);
+		int p = 0;
+
+		for (; p + 2 <= count; p += 2)
+		{
+			int i0 = first[p], i1 = first[p + 1];
+			int j0 = second[p], j1 = second[p + 1];
+
+			// Bounding box rejection first, so that most non-crossing pairs never load their endpoints.
+			__m128d overlap = _mm_castsi128_pd(_mm_set1_epi32(-1));
+			if (!sweepRules)
+			{
+				overlap = _mm_and_pd(
+					_mm_and_pd(_mm_cmpge_pd(_mm_set_pd(b.maxX[i1], b.maxX[i0]), _mm_set_pd(b.minX[j1], b.minX[j0])),
+						_mm_cmpge_pd(_mm_set_pd(b.maxX[j1], b.maxX[j0]), _mm_set_pd(b.minX[i1], b.minX[i0]))),
+					_mm_and_pd(_mm_cmpge_pd(_mm_set_pd(b.maxY[i1], b.maxY[i0]), _mm_set_pd(b.minY[j1], b.minY[j0])),
+						_mm_cmpge_pd(_mm_set_pd(b.maxY[j1], b.maxY[j0]), _mm_set_pd(b.minY[i1], b.minY[i0]))));
+
+				if (_mm_movemask_pd(overlap) == 0)
+				{
+					hits[p] = hits[p + 1] = 0;
+					continue;
+				}
+			}
+
+			__m128d ax1 = _mm_set_pd(b.x1[i1], b.x1[i0]), ay1 = _mm_set_pd(b.y1[i1], b.y1[i0]);
+			__m128d ax2 = _mm_set_pd(b.x2[i1], b.x2[i0]), ay2 = _mm_set_pd(b.y2[i1], b.y2[i0]);
+			__m128d bx1 = _mm_set_pd(b.x1[j1], b.x1[j0]), by1 = _mm_set_pd(b.y1[j1], b.y1[j0]);
+			__m128d bx2 = _mm_set_pd(b.x2[j1], b.x2[j0]), by2 = _mm_set_pd(b.y2[j1], b.y2[j0]);
+
+			__m128d shared = _mm_or_pd(
+				_mm_or_pd(sharesPointSse2(ax1, ay1, bx1, by1, eps), sharesPointSse2(ax1, ay1, bx2, by2, eps)),
+				_mm_or_pd(sharesPointSse2(ax2, ay2, bx1, by1, eps), sharesPointSse2(ax2, ay2, bx2, by2, eps)));
+
+			__m128d adx = _mm_sub_pd(ax2, ax1), ady = _mm_sub_pd(ay2, ay1);
+			__m128d bdx = _mm_sub_pd(bx2, bx1), bdy = _mm_sub_pd(by2, by1);
+
+			__m128d o1 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(bx1, ax1), ady), _mm_mul_pd(_mm_sub_pd(by1, ay1), adx));
+			__m128d o2 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(bx2, ax1), ady), _mm_mul_pd(_mm_sub_pd(by2, ay1), adx));
+			__m128d o3 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(ax1, bx1), bdy), _mm_mul_pd(_mm_sub_pd(ay1, by1), bdx));
+			__m128d o4 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(ax2, bx1), bdy), _mm_mul_pd(_mm_sub_pd(ay2, by1), bdx));
+
+			__m128d collinear = _mm_and_pd(_mm_cmplt_pd(absSse2(_mm_mul_pd(half, o1)), eps),
+				_mm_cmplt_pd(absSse2(_mm_mul_pd(half, o2)), eps));
+
+			__m128d crossing = _mm_and_pd(overlap,
+				_mm_and_pd(straddlesSse2(o1, o2, eps), straddlesSse2(o3, o4, eps)));
+			if (!sweepRules)
+			{
+				crossing = _mm_andnot_pd(_mm_or_pd(shared, collinear), crossing);
+			}
+
+			int mask = _mm_movemask_pd(crossing);
+			hits[p] = mask & 1;
+			hits[p + 1] = (mask >> 1) & 1;
+		}
+
+		testPairsScalar<sweepRules>(b, first + p, second + p, count - p, hits + p);
+	}
+
+	KERNEL_TARGET_AVX2 static __m256d absAvx2(__m256d v) {
+		return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v);
+	}
+
+	KERNEL_TARGET_AVX2 static __m256d sharesPointAvx2(__m256d ax, __m256d ay, __m256d bx, __m256d by,
+		__m256d eps) {
+		return _mm256_and_pd(_mm256_cmp_pd(absAvx2(_mm256_sub_pd(ax, bx)), eps, _CMP_LT_OQ),
+			_mm256_cmp_pd(absAvx2(_mm256_sub_pd(ay, by)), eps, _CMP_LT_OQ));
+	}
+
+	KERNEL_TARGET_AVX2 static __m256d straddlesAvx2(__m256d o1, __m256d o2, __m256d eps) {
+		__m256d zero = _mm256_setzero_pd();
+		__m256d opposite = _mm256_xor_pd(_mm256_cmp_pd(o1, zero, _CMP_LT_OQ), _mm256_cmp_pd(o2, zero, _CMP_LT_OQ));
+		return _mm256_and_pd(opposite, _mm256_and_pd(_mm256_cmp_pd(absAvx2(o1), eps, _CMP_GE_OQ),
+			_mm256_cmp_pd(absAvx2(o2), eps, _CMP_GE_OQ)));
+	}
+
+	template <bool sweepRules>
+	KERNEL_TARGET_AVX2 static void testPairsAvx2(SegmentBatch& b, const int* first, const int* second, int count,
+		unsigned char* hits) {
+		const __m256d eps = _mm256_set1_pd(POINT_EPSILON);
+		const __m256d half = _mm256_set1_pd(0.5);
+		int p = 0;
+
+		for (; p + 4 <= count; p += 4)
+		{
+			__m128i i = _mm_loadu_si128((const __m128i*)(first + p));
+			__m128i j = _mm_loadu_si128((const __m128i*)(second + p));
+
+			// Bounding box rejection first, so that most non-crossing pairs never gather their endpoints.
+			__m256d overlap = _mm256_castsi256_pd(_mm256_set1_epi32(-1));
+			if (!sweepRules)
+			{
+				overlap = _mm256_and_pd(
+					_mm256_and_pd(
+						_mm256_cmp_pd(_mm256_i32gather_pd(b.maxX.data(), i, 8),
+							_mm256_i32gather_pd(b.minX.data(), j, 8), _CMP_GE_OQ),
+						_mm256_cmp_pd(_mm256_i32gather_pd(b.maxX.data(), j, 8),
+							_mm256_i32gather_pd(b.minX.data(), i, 8), _CMP_GE_OQ)),
+					_mm256_and_pd(
+						_mm256_cmp_pd(_mm256_i32gather_pd(b.maxY.data(), i, 8),
+							_mm256_i32gather_pd(b.minY.data(), j, 8), _CMP_GE_OQ),
+						_mm256_cmp_pd(_mm256_i32gather_pd(b.maxY.data(), j, 8),
+							_mm256_i32gather_pd(b.minY.data(), i, 8), _CMP_GE_OQ)));
+
+				if (_mm256_movemask_pd(overlap) == 0)
+				{
+					hits[p] = hits[p + 1] = hits[p + 2] = hits[p + 3] = 0;
+					continue;
+				}
+			}
+
+			__m256d ax1 = _mm256_i32gather_pd(b.x1.data(), i, 8), ay1 = _mm256_i32gather_pd(b.y1.data(), i, 8);
+			__m256d ax2 = _mm256_i32gather_pd(b.x2.data(), i, 8), ay2 = _mm256_i32gather_pd(b.y2.data(), i, 8);
+			__m256d bx1 = _mm256_i32gather_pd(b.x1.data(), j, 8), by1 = _mm256_i32gather_pd(b.y1.data(), j, 8);
+			__m256d bx2 = _mm256_i32gather_pd(b.x2.data(), j, 8), by2 = _mm256_i32gather_pd(b.y2.data(), j, 8);
+
+			__m256d shared = _mm256_or_pd(
+				_mm256_or_pd(sharesPointAvx2(ax1, ay1, bx1, by1, eps), sharesPointAvx2(ax1, ay1, bx2, by2, eps)),
+				_mm256_or_pd(sharesPointAvx2(ax2, ay2, bx1, by1, eps), sharesPointAvx2(ax2, ay2, bx2, by2, eps)));
+
+			__m256d adx = _mm256_sub_pd(ax2, ax1), ady = _mm256_sub_pd(ay2, ay1);
+			__m256d bdx = _mm256_sub_pd(bx2, bx1), bdy = _mm256_sub_pd(by2, by1);
+
+			__m256d o1 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(bx1, ax1), ady),
+				_mm256_mul_pd(_mm256_sub_pd(by1, ay1), adx));
+			__m256d o2 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(bx2, ax1), ady),
+				_mm256_mul_pd(_mm256_sub_pd(by2, ay1), adx));
+			__m256d o3 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(ax1, bx1), bdy),
+				_mm256_mul_pd(_mm256_sub_pd(ay1, by1), bdx));
+			__m256d o4 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(ax2, bx1), bdy),
+				_mm256_mul_pd(_mm256_sub_pd(ay2, by1), bdx));
+
+			__m256d collinear = _mm256_and_pd(
+				_mm256_cmp_pd(absAvx2(_mm256_mul_pd(half, o1)), eps, _CMP_LT_OQ),
+				_mm256_cmp_pd(absAvx2(_mm256_mul_pd(half, o2)), eps, _CMP_LT_OQ));
+
+			__m256d crossing = _mm256_and_pd(overlap,
+				_mm256_and_pd(straddlesAvx2(o1, o2, eps), straddlesAvx2(o3, o4, eps)));
+			if (!sweepRules)
+			{
+				crossing = _mm256_andnot_pd(_mm256_or_pd(shared, collinear), crossing);
+			}
+
+			int mask = _mm256_movemask_pd(crossing);
+			hits[p] = mask & 1;
+			hits[p + 1] = (mask >> 1) & 1;
+			hits[p + 2] = (mask >> 2) & 1;
+			hits[p + 3] = (mask >> 3) & 1;
+		}
+
+		testPairsScalar<sweepRules>(b, first + p, second + p, count - p, hits + p);
+	}
+#endif
+
+	static KernelLevel detectLevel() {
+#ifdef KERNEL_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool avx2 = false;
+
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2)
+		{
+			return KernelLevel::AVX2;
+		}
+#else
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return KernelLevel::AVX2;
+		}
+#endif
+		// SSE2 is part of every x64 processor.
+		return KernelLevel::SSE2;
+#else
+		return KernelLevel::SCALAR;
+#endif
+	}
+
+public:
+	// The widest instruction set supported by the running processor, detected once.
+	static KernelLevel bestLevel() {
+		static KernelLevel level = detectLevel();
+		return level;
+	}
+
+	static const char* levelName(KernelLevel level) {
+		switch (level)
+		{
+		case KernelLevel::AVX2:
+			return "avx2";
+		case KernelLevel::SSE2:
+			return "sse2";
+		default:
+			return "scalar";
+		}
+	}
+
+	/*
+	 * Tests count candidate pairs (first[p], second[p]) of segments in the batch at once, setting hits[p] to 1 where
+	 * the pair crosses and to 0 otherwise. With the LINE_SEGMENT rules the result for every pair is the same as
+	 * checking getIntersectionPointWith for nullptr, but the bounding boxes are compared first and several pairs are
+	 * tested per instruction.
+	 */
+	static void testPairs(SegmentBatch& batch, const int* first, const int* second, int count, unsigned char* hits,
+		KernelLevel level = bestLevel(), KernelRules rules = KernelRules::LINE_SEGMENT) {
+		bool sweepRules = rules == KernelRules::SWEEP;
+#ifdef KERNEL_X86
+		if (level == KernelLevel::AVX2)
+		{
+			sweepRules ? testPairsAvx2<true>(batch, first, second, count, hits)
+				: testPairsAvx2<false>(batch, first, second, count, hits);
+			return;
+		}
+		else if (level == KernelLevel::SSE2)
+		{
+			sweepRules ? testPairsSse2<true>(batch, first, second, count, hits)
+				: testPairsSse2<false>(batch, first, second, count, hits);
+			return;
+		}
+#endif
+		sweepRules ? testPairsScalar<true>(batch, first, second, count, hits)
+			: testPairsScalar<false>(batch, first, second, count, hits);
+	}
+
+	/*
+	 * Calculates the point where two segments of the batch cross, from the parametric form of the first segment. Only
+	 * meaningful for pairs reported as crossing by testPairs.
+	 */
+	static Point crossingPoint(SegmentBatch& b, int i, int j) {
+		double adx = b.x2[i] - b.x1[i], ady = b.y2[i] - b.y1[i];
+		double bdx = b.x2[j] - b.x1[j], bdy = b.y2[j] - b.y1[j];
+		double t = ((b.x1[j] - b.x1[i]) * bdy - (b.y1[j] - b.y1[i]) * bdx) / (adx * bdy - ady * bdx);
+
+		return Point(b.x1[i] + t * adx, b.y1[i] + t * ady);
+	}
+};
+
+/*
+ * Counts every crossing pair of a set of segments by testing all n(n-1)/2 pairs with the batched kernel. Used to
+ * validate the sweep, and as the fastest option for very small inputs.
+ */
+inline long long bruteForceIntersectionCount(vector<LineSegment*>& segments) {
+	SegmentBatch batch(segments);
+	int n = batch.size();
+	const int chunk = 4096;
+	vector<int> first(chunk), second(chunk);
+	vector<unsigned char> hits(chunk);
+	long long total = 0;
+	int count = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = i + 1; j < n; j++)
+		{
+			first[count] = i;
+			second[count] = j;
+
+			if (++count == chunk)
+			{
+				IntersectionKernel::testPairs(batch, first.data(), second.data(), count, hits.data());
+				for (int p = 0; p < count; p++)
+				{
+					total += hits[p];
+				}
+				count = 0;
+			}
+		}
+	}
+
+	IntersectionKernel::testPairs(batch, first.data(), second.data(), count, hits.data());
+	for (int p = 0; p < count; p++)
+	{
+		total += hits[p];
+	}
+
+	return total;
+}
@@ -0,0 +1,366 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Structures.h"
+#include "SweepEngine.h"
+
+/*
+ * Intersection engine for inputs with a very large number of crossings, after Balaban's TreeSearch. The plane is cut
+ * into vertical strips at the distinct x of all endpoints, so no segment starts or ends inside a strip, and the strips
+ * are the leaves of a balanced tree, each node covering the strips between two endpoint x. Two segments spanning a
+ * strip cross inside it exactly when their order along its left edge and along its right edge differ.
+ *
+ * Each node takes the segments crossing its left edge, bottom to top, and picks from those spanning its whole strip a
+ * staircase: greedily, each segment that does not cross the one picked before it. The staircase segments cross none
+ * of each other inside the strip, so each other segment in the strip is located among them by its position at either
+ * end of its part in the strip, and crosses exactly the staircase segments between the two. Staircase segments are
+ * left out of the node's subtree, while every other segment was either left out of an earlier staircase for crossing
+ * it or has an endpoint inside the strip, so the segments handed down the tree add up to O(n log n + k). A leaf sorts
+ * the segments crossing its strip along its right edge by insertion, one adjacent swap per crossing. Positions at the
+ * right edge of a node come from merging its staircase into the order its subtree returns, and the others from binary
+ * searches, one per endpoint and level.
+ *
+ * It takes O(n log^2 n + k) time: the binary searches are the one logarithmic factor above Balaban's optimal
+ * algorithm, which passes the staircases down the tree so as to locate the endpoints in constant time. No event queue
+ * is kept and no logarithmic factor is paid per intersection, so on inputs with k close to n^2 this beats
+ * Bentley-Ottmann, while on sparse inputs the larger constant per endpoint loses; Benchmark.h reports the crossover.
+ *
+ * Along a vertical line segments are ordered by y, then by their order just left of it, so that a crossing on a strip
+ * edge counts toward the strip to its right. Each pair found is confirmed with the same crossing test as SweepEngine,
+ * so segments touching or overlapping within the tolerance are reordered without being reported.
+ */
+template <typename Sink = CountSink, typename Tolerance = DefaultTolerance>
+class InversionSweep {
+private:
+	struct Segment {
+		double x1, y1, x2, y2;
+		double slope;
+
+		double yAt(double x) const {
+			return x == x2 ? y2 : y1 + slope * (x - x1);
+		}
+	};
+
+	Sink sink;
+	vector<Segment> segments;
+	vector<double> edges; // distinct endpoint x, the strip edges
+	vector<uint32_t> byStart; // segments in order of their left x
+	vector<uint32_t> startPosition; // of each segment in the staircase of the node being merged
+	vector<double> keys;
+	long long swaps;
+
+	void load(const SegmentView<double>& input) {
+		size_t n = input.size();
+		segments.resize(n);
+		edges.clear();
+		byStart.clear();
+		startPosition.assign(n, 0);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const double* c = input[i];
+			bool inOrder = c[0] < c[2] || (c[0] == c[2] && c[1] <= c[3]);
+			Segment& s = segments[i];
+			s = inOrder ? Segment{ c[0], c[1], c[2], c[3], 0.0 } : Segment{ c[2], c[3], c[0], c[1], 0.0 };
+			s.slope = s.x2 != s.x1 ? (s.y2 - s.y1) / (s.x2 - s.x1) : 0.0;
+
+			// Segments of length 0 cross nothing.
+			if (s.x1 != s.x2 || s.y1 != s.y2)
+			{
+				edges.push_back(s.x1);
+				edges.push_back(s.x2);
+				byStart.push_back((uint32_t)i);
+			}
+		}
+
+		sort(edges.begin(), edges.end());
+		edges.erase(unique(edges.begin(), edges.end()), edges.end());
+		sort(byStart.begin(), byStart.end(), [this](uint32_t a, uint32_t b) {
+			return segments[a].x1 != segments[b].x1 ? segments[a].x1 < segments[b].x1 : a < b;
+		});
+	}
+
+	bool isVertical(uint32_t id) const {
+		return segments[id].x1 == segments[id].x2;
+	}
+
+	// Whether a lies below b along the vertical line at x, ties taking their order just left of the line.
+	bool below(uint32_t a, uint32_t b, double x) const {
+		double ya = segments[a].yAt(x), yb = segments[b].yAt(x);
+		if (ya != yb)
+		{
+			return ya < yb;
+		}
+		else if (segments[a].slope != segments[b].slope)
+		{
+			return segments[a].slope > segments[b].slope;
+		}
+
+		return a < b;
+	}
+
+	void reportIfCrossing(uint32_t lowerId, uint32_t upperId) {
+		Segment& a = segments[lowerId];
+		Segment& b = segments[upperId];
+		double x, y;
+
+		swaps++;
+		if (SweepGeometry<double, Tolerance>::crossing(a.x1, a.y1, a.x2, a.y2, b.x1, b.y1, b.x2, b.y2, x, y))
+		{
+			sink.report(x, y, lowerId, upperId);
+		}
+	}
+
+	// Number of the segments in order, bottom to top along x, lying below a segment there.
+	size_t countBelow(const vector<uint32_t>& order, uint32_t id, double x) const {
+		return lower_bound(order.begin(), order.end(), id, [this, x](uint32_t a, uint32_t b) {
+			return below(a, b, x);
+		}) - order.begin();
+	}
+
+	// Reports the segments in order, bottom to top along the x of a vertical segment, that it crosses.
+	void crossVertical(const vector<uint32_t>& order, uint32_t id) {
+		Segment& v = segments[id];
+		size_t first = lower_bound(order.begin(), order.end(), v.y1, [this, &v](uint32_t a, double y) {
+			return segments[a].yAt(v.x1) < y;
+		}) - order.begin();
+
+		for (size_t i = first; i < order.size() && segments[order[i]].yAt(v.x1) <= v.y2; i++)
+		{
+			reportIfCrossing(order[i], id);
+		}
+	}
+
+	// Reports the crossings of a segment with the staircase segments between its positions at either end.
+	void crossStaircase(const vector<uint32_t>& staircase, uint32_t id, size_t start, size_t end) {
+		for (size_t k = start; k < end; k++)
+		{
+			reportIfCrossing(id, staircase[k]);
+		}
+		for (size_t k = end; k < start; k++)
+		{
+			reportIfCrossing(staircase[k], id);
+		}
+	}
+
+	// Sorts the segments crossing a strip with no endpoint inside along its right edge, reporting each pair swapped.
+	void searchInStrip(vector<uint32_t>& order, double right) {
+		keys.resize(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			keys[i] = segments[order[i]].yAt(right);
+		}
+
+		for (size_t i = 1; i < order.size(); i++)
+		{
+			uint32_t id = order[i];
+			double key = keys[i];
+			size_t j = i;
+
+			while (j > 0 && (keys[j - 1] > key || (keys[j - 1] == key && below(id, order[j - 1], right))))
+			{
+				reportIfCrossing(order[j - 1], id);
+				order[j] = order[j - 1];
+				keys[j] = keys[j - 1];
+				j--;
+			}
+
+			order[j] = id;
+			keys[j] = key;
+		}
+	}
+
+	/*
+	 * Finds the crossings inside the strip between edges[lo] and edges[hi] of the segments crossing its left edge,
+	 * given bottom to top along it in order, and of the segments byStart[first, last) starting inside it. Leaves in
+	 * order the segments reaching its right edge, bottom to top along it.
+	 */
+	void treeSearch(size_t lo, size_t hi, vector<uint32_t>& order, size_t first, size_t last) {
+		double left = edges[lo], right = edges[hi];
+		if (hi == lo + 1)
+		{
+			searchInStrip(order, right);
+			return;
+		}
+
+		// The staircase, and the others with their position in it along the left edge.
+		vector<uint32_t> staircase, rest;
+		vector<uint32_t> restStart;
+		for (uint32_t id : order)
+		{
+			if (segments[id].x2 >= right && (staircase.empty() || !below(id, staircase.back(), right)))
+			{
+				staircase.push_back(id);
+			}
+			else
+			{
+				rest.push_back(id);
+				restStart.push_back((uint32_t)staircase.size());
+			}
+		}
+
+		// Segments ending inside the strip are located at their right endpoint now, those reaching the right edge once
+		// the subtree has put them in order along it.
+		vector<pair<uint32_t, uint32_t>> reaching;
+		for (size_t i = 0; i < rest.size(); i++)
+		{
+			uint32_t id = rest[i];
+			if (segments[id].x2 < right)
+			{
+				crossStaircase(staircase, id, restStart[i], countBelow(staircase, id, segments[id].x2));
+			}
+			else
+			{
+				reaching.push_back(make_pair(id, restStart[i]));
+			}
+		}
+		for (size_t i = first; i < last; i++)
+		{
+			uint32_t id = byStart[i];
+			if (isVertical(id))
+			{
+				crossVertical(staircase, id);
+				continue;
+			}
+
+			size_t start = countBelow(staircase, id, segments[id].x1);
+			if (segments[id].x2 < right)
+			{
+				crossStaircase(staircase, id, start, countBelow(staircase, id, segments[id].x2));
+			}
+			else
+			{
+				reaching.push_back(make_pair(id, (uint32_t)start));
+			}
+		}
+		order.swap(rest);
+
+		// The children, split at the middle edge, where the segments ending there leave and those starting there
+		// enter, after the vertical segments there cross the segments passing through.
+		size_t middle = (lo + hi) / 2;
+		double x = edges[middle];
+		auto startsBefore = [this](uint32_t id, double x) { return segments[id].x1 < x; };
+		auto startsAfter = [this](double x, uint32_t id) { return x < segments[id].x1; };
+		size_t atMiddle = lower_bound(byStart.begin() + first, byStart.begin() + last, x, startsBefore)
+			- byStart.begin();
+		size_t pastMiddle = upper_bound(byStart.begin() + atMiddle, byStart.begin() + last, x, startsAfter)
+			- byStart.begin();
+
+		treeSearch(lo, middle, order, first, atMiddle);
+
+		vector<uint32_t> entering;
+		for (size_t i = atMiddle; i < pastMiddle; i++)
+		{
+			if (isVertical(byStart[i]))
+			{
+				crossVertical(order, byStart[i]);
+			}
+			else
+			{
+				entering.push_back(byStart[i]);
+			}
+		}
+		sort(entering.begin(), entering.end(), [this, x](uint32_t a, uint32_t b) { return below(a, b, x); });
+
+		vector<uint32_t> merged;
+		merged.reserve(order.size() + entering.size());
+		size_t j = 0;
+		for (uint32_t id : order)
+		{
+			if (segments[id].x2 == x)
+			{
+				continue;
+			}
+			for (; j < entering.size() && below(entering[j], id, x); j++)
+			{
+				merged.push_back(entering[j]);
+			}
+			merged.push_back(id);
+		}
+		merged.insert(merged.end(), entering.begin() + j, entering.end());
+		order.swap(merged);
+
+		treeSearch(middle, hi, order, pastMiddle, last);
+
+		// The subtree has used startPosition for its own staircases, so it is filled in only now.
+		for (pair<uint32_t, uint32_t>& r : reaching)
+		{
+			startPosition[r.first] = r.second;
+		}
+
+		merged.clear();
+		merged.reserve(order.size() + staircase.size());
+		size_t k = 0;
+		for (uint32_t id : order)
+		{
+			for (; k < staircase.size() && below(staircase[k], id, right); k++)
+			{
+				merged.push_back(staircase[k]);
+			}
+			crossStaircase(staircase, id, startPosition[id], k);
+			merged.push_back(id);
+		}
+		merged.insert(merged.end(), staircase.begin() + k, staircase.end());
+		order.swap(merged);
+	}
+
+public:
+	InversionSweep(Sink sink = Sink()) : sink(sink) {
+		swaps = 0;
+	}
+
+	// Reports every intersection of the segments to the sink, with segments identified by their index in the view.
+	void run(const SegmentView<double>& input) {
+		load(input);
+		swaps = 0;
+		if (edges.size() < 2)
+		{
+			return;
+		}
+
+		// Segments starting on the first edge cross its left edge, the others start inside the root strip. Vertical
+		// segments on the first or last edge meet the others only at their endpoints.
+		double first = edges.front(), last = edges.back();
+		vector<uint32_t> order;
+		size_t inside = 0;
+		for (; inside < byStart.size() && segments[byStart[inside]].x1 == first; inside++)
+		{
+			if (!isVertical(byStart[inside]))
+			{
+				order.push_back(byStart[inside]);
+			}
+		}
+		sort(order.begin(), order.end(), [this, first](uint32_t a, uint32_t b) { return below(a, b, first); });
+
+		size_t end = lower_bound(byStart.begin() + inside, byStart.end(), last, [this](uint32_t id, double x) {
+			return segments[id].x1 < x;
+		}) - byStart.begin();
+		treeSearch(0, edges.size() - 1, order, inside, end);
+	}
+
+	Sink& getSink() {
+		return sink;
+	}
+
+	// Pairs of the last run found out of order, the crossings of non-vertical segments included, before the test.
+	long long getSwapCount() {
+		return swaps;
+	}
+};
+
+// Runs InversionSweep over the segments, with the input and output of findIntersections.
+inline vector<Point> findIntersectionsByInversions(vector<LineSegment*>& segments) {
+	vector<double> coordinates = toCoordinates(segments);
+
+	InversionSweep<CollectSink<double>> sweep;
+	sweep.run(SegmentView<double>(coordinates.data(), segments.size()));
+
+	vector<Point> intersections;
+	for (SweepPoint<double>& p : sweep.getSink().points)
+	{
+		intersections.push_back(Point(p.x, p.y));
+	}
+	return intersections;
+}
@@ -0,0 +1,346 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include "SweepEngine.h"
+
+/*
+ * Intersections of segments that move from frame to frame, kept up to date at a cost that follows what moved rather
+ * than the size of the input. The first frame is swept by SweepEngine; after that, the crossings of the segments that
+ * moved are dropped and found again, while the crossings between segments that stayed put are kept as they are.
+ *
+ * Between frames the segments are kept sorted by their left x, each moved segment being walked to its new place by
+ * insertion, so a small move costs a few swaps. Their x and y extents are stored in that order in flat arrays, along
+ * with the largest right x of each block of 64 positions. The segments overlapping a moved one in x all start between
+ * its left x less the longest x extent and its right x, a range found by binary search and scanned block by block,
+ * skipping the blocks that end before the moved segment starts. Pairs whose bounding boxes meet are confirmed by the
+ * crossing test of SweepEngine.
+ *
+ * The status orderings at every x are not kept, as their total size grows with the sum of the status sizes over all
+ * events; the order by left x takes O(n) and serves every query a moved segment needs.
+ */
+class KineticSweep {
+private:
+	struct Segment {
+		double x1, y1, x2, y2;
+	};
+
+	static const size_t BLOCK = 64;
+
+	vector<Segment> segments; // by id, endpoints in sweep order
+	vector<uint32_t> order; // ids by left x
+	vector<uint32_t> position; // in order, by id
+	vector<double> lefts; // extents of order[i], as of when it was last put in place
+	vector<double> rights;
+	vector<double> bottoms;
+	vector<double> tops;
+	vector<double> blockReach; // largest right x of each block of positions
+	uint32_t hitBuffer[BLOCK];
+	double longest; // largest x extent of a segment, never lowered between resets
+	unordered_map<uint64_t, SweepPoint<double>> crossings; // by pair, lower id first
+	vector<vector<uint32_t>> partners; // segments crossing each segment
+	vector<bool> moved;
+	vector<uint32_t> movedIds;
+	vector<pair<uint32_t, uint32_t>> added;
+	vector<pair<uint32_t, uint32_t>> removed;
+	long long swaps;
+	long long candidates;
+	double updateMs;
+
+	static uint64_t pairKey(uint32_t a, uint32_t b) {
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	static Segment inSweepOrder(const double* c) {
+		bool inOrder = c[0] < c[2] || (c[0] == c[2] && c[1] <= c[3]);
+		return inOrder ? Segment{ c[0], c[1], c[2], c[3] } : Segment{ c[2], c[3], c[0], c[1] };
+	}
+
+	static void addCrossing(double x, double y, uint32_t lowerId, uint32_t upperId, void* context) {
+		KineticSweep* sweep = (KineticSweep*)context;
+		sweep->crossings[pairKey(lowerId, upperId)] = { x, y };
+		sweep->partners[lowerId].push_back(upperId);
+		sweep->partners[upperId].push_back(lowerId);
+	}
+
+	void store(size_t i) {
+		Segment& s = segments[order[i]];
+		lefts[i] = s.x1;
+		rights[i] = s.x2;
+		bottoms[i] = min(s.y1, s.y2);
+		tops[i] = max(s.y1, s.y2);
+	}
+
+	void updateBlock(size_t block) {
+		size_t end = min(order.size(), (block + 1) * BLOCK);
+		double reach = -HUGE_VAL;
+		for (size_t i = block * BLOCK; i < end; i++)
+		{
+			reach = max(reach, rights[i]);
+		}
+		blockReach[block] = reach;
+	}
+
+	void swapPositions(size_t i, size_t j) {
+		swap(order[i], order[j]);
+		swap(lefts[i], lefts[j]);
+		swap(rights[i], rights[j]);
+		swap(bottoms[i], bottoms[j]);
+		swap(tops[i], tops[j]);
+		position[order[i]] = (uint32_t)i;
+		position[order[j]] = (uint32_t)j;
+		if (i / BLOCK != j / BLOCK)
+		{
+			updateBlock(i / BLOCK);
+			updateBlock(j / BLOCK);
+		}
+		swaps++;
+	}
+
+	// Walks a moved segment to its place in order, the others still sorted by their extents of the last frame.
+	void reposition(uint32_t id) {
+		size_t i = position[id];
+		store(i);
+		updateBlock(i / BLOCK);
+		longest = max(longest, segments[id].x2 - segments[id].x1);
+
+		while (i > 0 && lefts[i - 1] > lefts[i])
+		{
+			swapPositions(i - 1, i);
+			i--;
+		}
+		while (i + 1 < order.size() && lefts[i + 1] < lefts[i])
+		{
+			swapPositions(i, i + 1);
+			i++;
+		}
+	}
+
+	void dropCrossings(uint32_t id) {
+		for (uint32_t other : partners[id])
+		{
+			crossings.erase(pairKey(id, other));
+			removed.push_back(make_pair(min(id, other), max(id, other)));
+
+			vector<uint32_t>& list = partners[other];
+			auto found = find(list.begin(), list.end(), id);
+			*found = list.back();
+			list.pop_back();
+		}
+		partners[id].clear();
+	}
+
+	void testPair(uint32_t id, uint32_t other) {
+		Segment& a = segments[id];
+		Segment& b = segments[other];
+		double x, y;
+		candidates++;
+
+		if (SweepGeometry<double, DefaultTolerance>::crossing(a.x1, a.y1, a.x2, a.y2, b.x1, b.y1, b.x2, b.y2, x, y))
+		{
+			addCrossing(x, y, id, other, this);
+			added.push_back(make_pair(min(id, other), max(id, other)));
+		}
+	}
+
+	// Tests a moved segment against every segment whose bounding box meets its own.
+	void findCrossings(uint32_t id) {
+		Segment& s = segments[id];
+		double bottom = min(s.y1, s.y2), top = max(s.y1, s.y2);
+		size_t first = lower_bound(lefts.begin(), lefts.end(), s.x1 - longest) - lefts.begin();
+		size_t end = upper_bound(lefts.begin(), lefts.end(), s.x2) - lefts.begin();
+
+		for (size_t block = first / BLOCK; block * BLOCK < end; block++)
+		{
+			if (blockReach[block] < s.x1)
+			{
+				continue;
+			}
+
+			// Few positions pass the box test, so they are gathered without branching and tested afterwards.
+			size_t blockEnd = min(end, (block + 1) * BLOCK);
+			size_t hits = 0;
+			for (size_t i = max(first, block * BLOCK); i < blockEnd; i++)
+			{
+				hitBuffer[hits] = (uint32_t)i;
+				hits += (rights[i] >= s.x1) & (tops[i] >= bottom) & (bottoms[i] <= top);
+			}
+
+			for (size_t h = 0; h < hits; h++)
+			{
+				// A pair of moved segments is tested once, from the lower id.
+				uint32_t other = order[hitBuffer[h]];
+				if (other != id && (!moved[other] || other < id))
+				{
+					testPair(id, other);
+				}
+			}
+		}
+	}
+
+	void finishUpdate() {
+		for (uint32_t id : movedIds)
+		{
+			dropCrossings(id);
+			reposition(id);
+		}
+
+		for (uint32_t id : movedIds)
+		{
+			findCrossings(id);
+		}
+
+		for (uint32_t id : movedIds)
+		{
+			moved[id] = false;
+		}
+	}
+
+public:
+	KineticSweep() {
+		longest = 0.0;
+		swaps = 0;
+		candidates = 0;
+		updateMs = 0.0;
+	}
+
+	// Starts over from the segments of a first frame, finding all their crossings with SweepEngine.
+	void reset(const SegmentView<double>& input) {
+		auto start = chrono::high_resolution_clock::now();
+		size_t n = input.size();
+		segments.resize(n);
+		order.resize(n);
+		position.resize(n);
+		lefts.resize(n);
+		rights.resize(n);
+		bottoms.resize(n);
+		tops.resize(n);
+		blockReach.resize((n + BLOCK - 1) / BLOCK);
+		longest = 0.0;
+		moved.assign(n, false);
+		partners.assign(n, vector<uint32_t>());
+		crossings.clear();
+		added.clear();
+		removed.clear();
+		swaps = 0;
+		candidates = 0;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			segments[i] = inSweepOrder(input[i]);
+			order[i] = (uint32_t)i;
+		}
+		sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return segments[a].x1 < segments[b].x1; });
+
+		for (size_t i = 0; i < n; i++)
+		{
+			position[order[i]] = (uint32_t)i;
+			store(i);
+			longest = max(longest, rights[i] - lefts[i]);
+		}
+		for (size_t block = 0; block < blockReach.size(); block++)
+		{
+			updateBlock(block);
+		}
+
+		SweepEngine<double, DefaultTolerance, CallbackSink> engine;
+		engine.getSink().callback = addCrossing;
+		engine.getSink().context = this;
+		engine.run(input);
+
+		updateMs = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count()
+			/ 1e3;
+	}
+
+	/*
+	 * Moves to the next frame, given in full with the same segments in the same order as the first. Segments whose
+	 * coordinates changed are found by comparing them with the last frame.
+	 */
+	void update(const SegmentView<double>& input) {
+		auto start = chrono::high_resolution_clock::now();
+		movedIds.clear();
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			Segment s = inSweepOrder(input[i]);
+			Segment& old = segments[i];
+			if (s.x1 != old.x1 || s.y1 != old.y1 || s.x2 != old.x2 || s.y2 != old.y2)
+			{
+				old = s;
+				moved[i] = true;
+				movedIds.push_back((uint32_t)i);
+			}
+		}
+
+		added.clear();
+		removed.clear();
+		swaps = 0;
+		candidates = 0;
+		finishUpdate();
+		updateMs = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count()
+			/ 1e3;
+	}
+
+	// Moves to the next frame given only the segments that moved, as ids and their new x1, y1, x2, y2.
+	void update(const vector<uint32_t>& ids, const SegmentView<double>& moves) {
+		auto start = chrono::high_resolution_clock::now();
+		movedIds.clear();
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			segments[ids[i]] = inSweepOrder(moves[i]);
+			if (!moved[ids[i]])
+			{
+				moved[ids[i]] = true;
+				movedIds.push_back(ids[i]);
+			}
+		}
+
+		added.clear();
+		removed.clear();
+		swaps = 0;
+		candidates = 0;
+		finishUpdate();
+		updateMs = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count()
+			/ 1e3;
+	}
+
+	// The crossing point of every crossing pair, keyed by the pair with the lower id in the high 32 bits.
+	unordered_map<uint64_t, SweepPoint<double>>& getCrossings() {
+		return crossings;
+	}
+
+	size_t getCount() {
+		return crossings.size();
+	}
+
+	/*
+	 * Pairs that stopped and started crossing in the last update, lower id first. A pair still crossing after one of
+	 * its segments moved appears in both, as its crossing point may have moved.
+	 */
+	vector<pair<uint32_t, uint32_t>>& getAdded() {
+		return added;
+	}
+
+	vector<pair<uint32_t, uint32_t>>& getRemoved() {
+		return removed;
+	}
+
+	size_t getMovedCount() {
+		return movedIds.size();
+	}
+
+	// Swaps made to restore the order by left x in the last update.
+	long long getSwapCount() {
+		return swaps;
+	}
+
+	// Pairs given to the crossing test in the last update.
+	long long getCandidateCount() {
+		return candidates;
+	}
+
+	double getUpdateMs() {
+		return updateMs;
+	}
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <stddef.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+using namespace std;
+
+enum class MemoryCategory { SEGMENTS, EVENTS, QUEUE, STATUS, CACHE, CROSSING_POINTS, OUTPUT };
+
+const int MEMORY_CATEGORY_COUNT = 7;
+
+inline const char* memoryCategoryName(MemoryCategory category) {
+	static const char* names[MEMORY_CATEGORY_COUNT] = {
+		"segments", "events", "queue", "status", "cache", "crossing_points", "output"
+	};
+	return names[(int)category];
+}
+
+struct MemoryUsage {
+	long long bytes = 0; // held now
+	long long objects = 0; // held now
+	long long peakBytes = 0;
+	long long allocations = 0; // since the start of the sweep
+};
+
+/*
+ * Bytes and objects held by a sweep in each category, with their peaks and the number of allocations made. Objects
+ * allocated one at a time are counted by allocate and release as they come and go; containers are reported by track
+ * with their current size, each growth counting as one allocation. The sweep also records the largest number of
+ * intersection events pending in its queue at once.
+ *
+ * The figures are those of the structures themselves, without the overhead of the allocator.
+ */
+struct SweepMemory {
+	MemoryUsage categories[MEMORY_CATEGORY_COUNT];
+	long long bytes = 0;
+	long long peakBytes = 0;
+	long long allocations = 0;
+	long long peakPendingIntersections = 0;
+
+	void reset() {
+		*this = SweepMemory();
+	}
+
+	MemoryUsage& operator[](MemoryCategory category) {
+		return categories[(int)category];
+	}
+
+	void allocate(MemoryCategory category, size_t size, long long objects = 1) {
+		MemoryUsage& usage = (*this)[category];
+		usage.objects += objects;
+		usage.allocations++;
+		allocations++;
+		change(usage, (long long)size);
+	}
+
+	void release(MemoryCategory category, size_t size, long long objects = 1) {
+		MemoryUsage& usage = (*this)[category];
+		usage.objects -= objects;
+		change(usage, -(long long)size);
+	}
+
+	// Reports the current size of a container, counting an allocation whenever it grows.
+	void track(MemoryCategory category, size_t size, long long objects) {
+		MemoryUsage& usage = (*this)[category];
+		if ((long long)size > usage.bytes)
+		{
+			usage.allocations++;
+			allocations++;
+		}
+
+		usage.objects = objects;
+		change(usage, (long long)size - usage.bytes);
+	}
+
+	void pending(long long intersections) {
+		peakPendingIntersections = max(peakPendingIntersections, intersections);
+	}
+
+	// The figures as a JSON object, for benchmark output and job sizing scripts.
+	string toJson() {
+		ostringstream json;
+		json << "{\"bytes\": " << bytes << ", \"peak_bytes\": " << peakBytes << ", \"allocations\": " << allocations
+			<< ", \"peak_pending_intersections\": " << peakPendingIntersections;
+
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+		{
+			MemoryUsage& usage = categories[i];
+			json << ", \"" << memoryCategoryName((MemoryCategory)i) << "\": {\"bytes\": " << usage.bytes
+				<< ", \"objects\": " << usage.objects << ", \"peak_bytes\": " << usage.peakBytes
+				<< ", \"allocations\": " << usage.allocations << "}";
+		}
+
+		json << "}";
+		return json.str();
+	}
+
+private:
+	void change(MemoryUsage& usage, long long delta) {
+		usage.bytes += delta;
+		usage.peakBytes = max(usage.peakBytes, usage.bytes);
+		bytes += delta;
+		peakBytes = max(peakBytes, bytes);
+	}
+};
+
+// Accounting of the sweep in progress, reset by init.
+inline SweepMemory sweepMemory;
@@ -0,0 +1,228 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "SweepEngine.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+inline int lowestSetBit(uint64_t word) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (int)index;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+/*
+ * Set of integers below a fixed size, stored as a tree of 64 bit words: a bit of level 0 per integer, and a bit of each
+ * higher level per word of the level below, set when that word is not empty. Insertion, removal and finding the next
+ * member from a position all take one word per level, four levels covering 16M integers.
+ */
+class RankSet {
+private:
+	vector<vector<uint64_t>> levels;
+
+public:
+	static const size_t NONE = (size_t)-1;
+
+	void reset(size_t size) {
+		levels.clear();
+		do
+		{
+			size = (size + 63) / 64;
+			levels.push_back(vector<uint64_t>(size, 0));
+		} while (size > 1);
+	}
+
+	void insert(size_t i) {
+		for (size_t level = 0; level < levels.size(); level++, i /= 64)
+		{
+			uint64_t& word = levels[level][i / 64];
+			bool wasEmpty = word == 0;
+			word |= 1ULL << (i % 64);
+			if (!wasEmpty)
+			{
+				break;
+			}
+		}
+	}
+
+	void erase(size_t i) {
+		for (size_t level = 0; level < levels.size(); level++, i /= 64)
+		{
+			uint64_t& word = levels[level][i / 64];
+			word &= ~(1ULL << (i % 64));
+			if (word != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	// The smallest member at least i, or NONE.
+	size_t next(size_t i) {
+		size_t level = 0;
+		for (; level < levels.size(); level++, i = i / 64 + 1)
+		{
+			if (i / 64 >= levels[level].size())
+			{
+				return NONE;
+			}
+
+			uint64_t bits = levels[level][i / 64] & (~0ULL << (i % 64));
+			if (bits != 0)
+			{
+				i = i / 64 * 64 + lowestSetBit(bits);
+				break;
+			}
+		}
+
+		if (level == levels.size())
+		{
+			return NONE;
+		}
+
+		while (level > 0)
+		{
+			level--;
+			i = i * 64 + lowestSetBit(levels[level][i]);
+		}
+		return i;
+	}
+};
+
+/*
+ * Intersection engine for inputs made only of horizontal and vertical segments, such as VLSI layouts and floor plans,
+ * in O(n log n + k) time. Two horizontal or two vertical segments never cross properly, so every intersection is a
+ * vertical crossing a horizontal, and no intersection event is ever scheduled: the sweep goes over the x of the
+ * endpoints, keeping the horizontals spanning the sweep line, and reports for each vertical the ones strictly inside
+ * its y extent.
+ *
+ * The horizontals are ranked by y once, so the status is a RankSet over their ranks rather than a tree of keys, and a
+ * vertical's y extent becomes a range of ranks found by binary search. Segments are crossed only at interior points of
+ * both, as everywhere else in this program: at one x, horizontals ending there leave before the verticals are answered
+ * and those starting there enter after. Segments that are neither horizontal nor vertical are ignored.
+ *
+ * Each intersection is reported with the horizontal segment first. Intersections come in order of x, and at one x
+ * vertical by vertical, each from bottom to top.
+ */
+template <typename Sink = CountSink>
+class OrthogonalSweep {
+private:
+	// At one x, END events come first and START events last.
+	enum EventType : uint32_t { END, VERTICAL, START };
+
+	struct Event {
+		double x;
+		uint32_t id;
+		uint32_t type;
+	};
+
+	struct Horizontal {
+		double y;
+		uint32_t id;
+	};
+
+	Sink sink;
+	vector<Event> events;
+	vector<Horizontal> horizontals; // by y
+	vector<uint32_t> rankOf; // of each horizontal segment, by id
+	vector<double> verticalY1; // lower end of each vertical segment, by id
+	vector<double> verticalY2;
+	RankSet active;
+
+	static bool eventPrecedes(const Event& a, const Event& b) {
+		if (a.x != b.x)
+		{
+			return a.x < b.x;
+		}
+		else if (a.type != b.type)
+		{
+			return a.type < b.type;
+		}
+
+		return a.id < b.id;
+	}
+
+	void load(const SegmentView<double>& input) {
+		size_t n = input.size();
+		events.clear();
+		horizontals.clear();
+		rankOf.assign(n, 0);
+		verticalY1.assign(n, 0.0);
+		verticalY2.assign(n, 0.0);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const double* c = input[i];
+			if (c[1] == c[3] && c[0] != c[2])
+			{
+				horizontals.push_back({ c[1], (uint32_t)i });
+				events.push_back({ min(c[0], c[2]), (uint32_t)i, START });
+				events.push_back({ max(c[0], c[2]), (uint32_t)i, END });
+			}
+			else if (c[0] == c[2] && c[1] != c[3])
+			{
+				verticalY1[i] = min(c[1], c[3]);
+				verticalY2[i] = max(c[1], c[3]);
+				events.push_back({ c[0], (uint32_t)i, VERTICAL });
+			}
+		}
+
+		sort(events.begin(), events.end(), eventPrecedes);
+		sort(horizontals.begin(), horizontals.end(), [](const Horizontal& a, const Horizontal& b) {
+			return a.y != b.y ? a.y < b.y : a.id < b.id;
+		});
+		for (size_t rank = 0; rank < horizontals.size(); rank++)
+		{
+			rankOf[horizontals[rank].id] = (uint32_t)rank;
+		}
+		active.reset(horizontals.size());
+	}
+
+	void crossVertical(const Event& e) {
+		auto below = [](const Horizontal& h, double y) { return h.y < y; };
+		auto above = [](double y, const Horizontal& h) { return y < h.y; };
+		size_t first = upper_bound(horizontals.begin(), horizontals.end(), verticalY1[e.id], above)
+			- horizontals.begin();
+		size_t end = lower_bound(horizontals.begin(), horizontals.end(), verticalY2[e.id], below) - horizontals.begin();
+
+		for (size_t rank = active.next(first); rank != RankSet::NONE && rank < end; rank = active.next(rank + 1))
+		{
+			sink.report(e.x, horizontals[rank].y, horizontals[rank].id, e.id);
+		}
+	}
+
+public:
+	OrthogonalSweep(Sink sink = Sink()) : sink(sink) {
+	}
+
+	// Reports every intersection of the segments to the sink, with segments identified by their index in the view.
+	void run(const SegmentView<double>& input) {
+		load(input);
+
+		for (const Event& e : events)
+		{
+			if (e.type == START)
+			{
+				active.insert(rankOf[e.id]);
+			}
+			else if (e.type == END)
+			{
+				active.erase(rankOf[e.id]);
+			}
+			else
+			{
+				crossVertical(e);
+			}
+		}
+	}
+
+	Sink& getSink() {
+		return sink;
+	}
+};
@@ -0,0 +1,588 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "SweepEngine.h"
+#include "SweepStatusTree.h"
+
+/*
+ * The sweep status of a static set of segments at every x, recorded by a single sweep so that vertical stabbing and
+ * point location queries are answered at any x without sweeping again: the segments crossing the line x = c in order
+ * of y, and the segment directly above or below a point.
+ *
+ * The status is kept as a red-black tree ordered by position along the sweep line, made persistent by the node-copying
+ * method of Driscoll, Sarnak, Sleator and Tarjan. Only the children and the segment of a node are persistent; colours
+ * and parent links are used by the updates alone and kept for the current status only. Each node has MOD_SLOTS extra
+ * fields recording changes with the version they were made in; a change to a full node makes a copy of it holding the
+ * latest values, and the parent is changed to point to the copy in turn. A version is kept for each distinct x of the
+ * events, the one holding the segments with x1 <= c < x2 for any c from that x up to the next, and changes made within
+ * one version overwrite each other in place.
+ *
+ * An insertion or removal makes at most three rotations and a crossing changes the segments of two nodes, so each
+ * event changes O(1) fields, and as every node has one parent the copies add O(1) amortized nodes per change: memory
+ * is O(n + k) for n segments and k crossings, at 40 bytes a node. getMemoryBytes gives the figure for an input.
+ * Queries only read nodes, so any number of threads may query at once, in O(log n) plus the size of the answer.
+ *
+ * Finding the node of a segment to remove, or of the two segments of a crossing, by their geometry is ambiguous where
+ * segments meet, so each segment keeps the node holding it while the sweep runs. The crossings are found by
+ * SweepEngine beforehand and replayed in its order.
+ */
+class PersistentStatus {
+private:
+	static const uint32_t NIL = 0; // node 0 of the tree and of the current status, standing for no node
+	static const int MOD_SLOTS = 2;
+
+	enum Field : uint32_t { LEFT_CHILD, RIGHT_CHILD, SEGMENT };
+
+	// Change of a field of a node made in version stamp, or an unused slot if stamp is 0.
+	struct Modification {
+		uint32_t stamp;
+		uint32_t field;
+		uint32_t value;
+	};
+
+	// Node of the persistent tree, with its fields as of the version it was made in and the changes since.
+	struct Node {
+		uint32_t fields[3];
+		uint32_t stamp;
+		Modification changes[MOD_SLOTS];
+	};
+
+	// Node of the current status, one per segment, standing for the latest copy of its node in the persistent tree.
+	struct CurrentNode {
+		uint32_t left;
+		uint32_t right;
+		uint32_t parent;
+		uint32_t id;
+		uint32_t node; // latest copy in nodes
+		bool red;
+	};
+
+	struct Event {
+		double x;
+		double y;
+		uint32_t id;
+		uint32_t type;
+	};
+
+	struct Crossing {
+		double x;
+		double y;
+		uint32_t lowerId;
+		uint32_t upperId;
+	};
+
+	vector<StatusEntry> entries; // by id
+	vector<Node> nodes;
+	vector<double> versionX; // x from which each kept version holds
+	vector<uint32_t> versionRoot;
+	uint32_t stamp; // version being built, kept versions being numbered from 1
+
+	vector<CurrentNode> current; // node id + 1 holds segment id at first, then ids move between nodes on swaps
+	vector<uint32_t> nodeOf; // current node of each segment
+	uint32_t currentRoot;
+	double buildMs;
+
+	static bool eventPrecedes(const Event& a, const Event& b) {
+		if (a.x != b.x)
+		{
+			return a.x < b.x;
+		}
+		else if (a.y != b.y)
+		{
+			return a.y < b.y;
+		}
+		else if (a.type != b.type)
+		{
+			return a.type != (uint32_t)Type::LEFT;
+		}
+
+		return a.id < b.id;
+	}
+
+	static bool crossingFirst(const Crossing& c, const Event& e) {
+		return c.x != e.x ? c.x < e.x : c.y < e.y || (c.y == e.y && e.type == (uint32_t)Type::LEFT);
+	}
+
+	static void addCrossing(double x, double y, uint32_t lowerId, uint32_t upperId, void* context) {
+		((vector<Crossing>*)context)->push_back({ x, y, lowerId, upperId });
+	}
+
+	// Persistent tree
+
+	// Value of a field of a node in the given version.
+	uint32_t fieldAt(uint32_t node, uint32_t field, uint32_t version) const {
+		const Node& n = nodes[node];
+		uint32_t value = n.fields[field];
+		for (int i = 0; i < MOD_SLOTS && n.changes[i].stamp != 0 && n.changes[i].stamp <= version; i++)
+		{
+			if (n.changes[i].field == field)
+			{
+				value = n.changes[i].value;
+			}
+		}
+		return value;
+	}
+
+	/*
+	 * Sets a persistent field of the node of current node c. A node made in this version, or a field already changed
+	 * in it, is changed in place, and otherwise the change takes a free slot. A full node is copied with its latest
+	 * values, and the parent of c, if c is attached to one, is set to the copy.
+	 */
+	void record(uint32_t c, uint32_t field, uint32_t value) {
+		uint32_t node = current[c].node;
+		if (nodes[node].stamp == stamp)
+		{
+			nodes[node].fields[field] = value;
+			return;
+		}
+
+		int slot = 0;
+		for (; slot < MOD_SLOTS && nodes[node].changes[slot].stamp != 0; slot++)
+		{
+			if (nodes[node].changes[slot].stamp == stamp && nodes[node].changes[slot].field == field)
+			{
+				nodes[node].changes[slot].value = value;
+				return;
+			}
+		}
+
+		if (slot < MOD_SLOTS)
+		{
+			nodes[node].changes[slot] = { stamp, field, value };
+			return;
+		}
+
+		Node copy = { { fieldAt(node, LEFT_CHILD, stamp), fieldAt(node, RIGHT_CHILD, stamp),
+			fieldAt(node, SEGMENT, stamp) }, stamp, {} };
+		copy.fields[field] = value;
+		nodes.push_back(copy);
+		current[c].node = (uint32_t)nodes.size() - 1;
+
+		uint32_t parent = current[c].parent;
+		if (parent != NIL && (current[parent].left == c || current[parent].right == c))
+		{
+			record(parent, current[parent].left == c ? LEFT_CHILD : RIGHT_CHILD, current[c].node);
+		}
+	}
+
+	// Current status
+
+	void setLeft(uint32_t c, uint32_t child) {
+		current[c].left = child;
+		if (child != NIL)
+		{
+			current[child].parent = c;
+		}
+		record(c, LEFT_CHILD, current[child].node);
+	}
+
+	void setRight(uint32_t c, uint32_t child) {
+		current[c].right = child;
+		if (child != NIL)
+		{
+			current[child].parent = c;
+		}
+		record(c, RIGHT_CHILD, current[child].node);
+	}
+
+	// Puts the subtree of v in the place of that of u. The parent of NIL is set as well, for fixRemoval to climb from.
+	void transplant(uint32_t u, uint32_t v) {
+		uint32_t parent = current[u].parent;
+		if (parent == NIL)
+		{
+			currentRoot = v;
+		}
+		else if (current[parent].left == u)
+		{
+			setLeft(parent, v);
+		}
+		else
+		{
+			setRight(parent, v);
+		}
+		current[v].parent = parent;
+	}
+
+	void rotateLeft(uint32_t c) {
+		uint32_t up = current[c].right;
+		setRight(c, current[up].left);
+		transplant(c, up);
+		setLeft(up, c);
+	}
+
+	void rotateRight(uint32_t c) {
+		uint32_t up = current[c].left;
+		setLeft(c, current[up].right);
+		transplant(c, up);
+		setRight(up, c);
+	}
+
+	uint32_t successorOf(uint32_t c) const {
+		if (current[c].right != NIL)
+		{
+			c = current[c].right;
+			while (current[c].left != NIL)
+			{
+				c = current[c].left;
+			}
+			return c;
+		}
+
+		uint32_t parent = current[c].parent;
+		while (parent != NIL && current[parent].right == c)
+		{
+			c = parent;
+			parent = current[c].parent;
+		}
+		return parent;
+	}
+
+	void fixInsertion(uint32_t c) {
+		while (current[current[c].parent].red)
+		{
+			uint32_t parent = current[c].parent;
+			uint32_t grandparent = current[parent].parent;
+			bool leftSide = current[grandparent].left == parent;
+			uint32_t uncle = leftSide ? current[grandparent].right : current[grandparent].left;
+			if (current[uncle].red)
+			{
+				current[parent].red = current[uncle].red = false;
+				current[grandparent].red = true;
+				c = grandparent;
+				continue;
+			}
+
+			if (c == (leftSide ? current[parent].right : current[parent].left))
+			{
+				c = parent;
+				leftSide ? rotateLeft(c) : rotateRight(c);
+				parent = current[c].parent;
+			}
+
+			current[parent].red = false;
+			current[grandparent].red = true;
+			leftSide ? rotateRight(grandparent) : rotateLeft(grandparent);
+		}
+		current[currentRoot].red = false;
+	}
+
+	void fixRemoval(uint32_t c) {
+		while (c != currentRoot && !current[c].red)
+		{
+			uint32_t parent = current[c].parent;
+			bool leftSide = current[parent].left == c;
+			uint32_t sibling = leftSide ? current[parent].right : current[parent].left;
+			if (current[sibling].red)
+			{
+				current[sibling].red = false;
+				current[parent].red = true;
+				leftSide ? rotateLeft(parent) : rotateRight(parent);
+				sibling = leftSide ? current[parent].right : current[parent].left;
+			}
+
+			uint32_t nearChild = leftSide ? current[sibling].left : current[sibling].right;
+			uint32_t farChild = leftSide ? current[sibling].right : current[sibling].left;
+			if (!current[nearChild].red && !current[farChild].red)
+			{
+				current[sibling].red = true;
+				c = parent;
+				continue;
+			}
+
+			if (!current[farChild].red)
+			{
+				current[nearChild].red = false;
+				current[sibling].red = true;
+				leftSide ? rotateRight(sibling) : rotateLeft(sibling);
+				sibling = leftSide ? current[parent].right : current[parent].left;
+				farChild = leftSide ? current[sibling].right : current[sibling].left;
+			}
+
+			current[sibling].red = current[parent].red;
+			current[parent].red = false;
+			current[farChild].red = false;
+			leftSide ? rotateLeft(parent) : rotateRight(parent);
+			c = currentRoot;
+		}
+		current[c].red = false;
+	}
+
+	// Sweep events
+
+	// Inserts a segment at the sweep point (x, y), before any segment it does not follow as in SweepStatusTree.
+	void insert(uint32_t id, double x, double y) {
+		uint32_t parent = NIL;
+		bool follows = false;
+		for (uint32_t c = currentRoot; c != NIL; c = follows ? current[c].right : current[c].left)
+		{
+			parent = c;
+			follows = entries[id].compareAt(entries[current[c].id], x, y) > 0;
+		}
+
+		uint32_t c = nodeOf[id];
+		nodes.push_back({ { NIL, NIL, id }, stamp, {} });
+		current[c] = { NIL, NIL, parent, id, (uint32_t)nodes.size() - 1, true };
+		if (parent == NIL)
+		{
+			currentRoot = c;
+		}
+		else if (follows)
+		{
+			setRight(parent, c);
+		}
+		else
+		{
+			setLeft(parent, c);
+		}
+		fixInsertion(c);
+	}
+
+	void remove(uint32_t id) {
+		uint32_t c = nodeOf[id];
+		uint32_t moved = c; // the node leaving its place, c itself or its successor
+		bool movedRed = current[c].red;
+		uint32_t filler; // the node taking the place of moved
+		if (current[c].left == NIL)
+		{
+			filler = current[c].right;
+			transplant(c, filler);
+		}
+		else if (current[c].right == NIL)
+		{
+			filler = current[c].left;
+			transplant(c, filler);
+		}
+		else
+		{
+			moved = successorOf(c);
+			movedRed = current[moved].red;
+			filler = current[moved].right;
+			if (current[moved].parent == c)
+			{
+				current[filler].parent = moved;
+			}
+			else
+			{
+				transplant(moved, filler);
+				setRight(moved, current[c].right);
+			}
+			transplant(c, moved);
+			setLeft(moved, current[c].left);
+			current[moved].red = current[c].red;
+		}
+
+		if (!movedRed)
+		{
+			fixRemoval(filler);
+		}
+		current[NIL].parent = NIL;
+	}
+
+	void swapAdjacent(const Crossing& c) {
+		uint32_t lower = nodeOf[c.lowerId];
+		uint32_t upper = nodeOf[c.upperId];
+		if (successorOf(lower) != upper)
+		{
+			return;
+		}
+
+		current[lower].id = c.upperId;
+		current[upper].id = c.lowerId;
+		record(lower, SEGMENT, c.upperId);
+		record(upper, SEGMENT, c.lowerId);
+		swap(nodeOf[c.lowerId], nodeOf[c.upperId]);
+	}
+
+	void keepVersion(double x) {
+		versionX.push_back(x);
+		versionRoot.push_back(current[currentRoot].node);
+		stamp++;
+	}
+
+	// Root of the version holding at x, setting version to its number.
+	uint32_t versionAt(double x, uint32_t& version) const {
+		size_t i = upper_bound(versionX.begin(), versionX.end(), x) - versionX.begin();
+		version = (uint32_t)i;
+		return i == 0 ? NIL : versionRoot[i - 1];
+	}
+
+	void collect(uint32_t node, uint32_t version, double x, double y0, double y1, vector<uint32_t>& ids) const {
+		while (node != NIL)
+		{
+			uint32_t id = fieldAt(node, SEGMENT, version);
+			double y = entries[id].yAt(x);
+			if (y < y0)
+			{
+				node = fieldAt(node, RIGHT_CHILD, version);
+			}
+			else if (y > y1)
+			{
+				node = fieldAt(node, LEFT_CHILD, version);
+			}
+			else
+			{
+				collect(fieldAt(node, LEFT_CHILD, version), version, x, y0, y1, ids);
+				ids.push_back(id);
+				node = fieldAt(node, RIGHT_CHILD, version);
+			}
+		}
+	}
+
+public:
+	PersistentStatus() {
+		stamp = 0;
+		currentRoot = NIL;
+		buildMs = 0.0;
+	}
+
+	// Sweeps the segments once, keeping the status at every x.
+	void build(const SegmentView<double>& input) {
+		auto start = chrono::high_resolution_clock::now();
+		size_t n = input.size();
+		vector<Crossing> crossings;
+		SweepEngine<double, DefaultTolerance, CallbackSink> engine;
+		engine.getSink().callback = addCrossing;
+		engine.getSink().context = &crossings;
+		engine.run(input);
+
+		vector<Event> events;
+		events.reserve(2 * n);
+		entries.resize(n);
+		current.assign(n + 1, { NIL, NIL, NIL, 0, NIL, false });
+		nodeOf.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			const double* c = input[i];
+			bool inOrder = c[0] < c[2] || (c[0] == c[2] && c[1] <= c[3]);
+			Point left = inOrder ? Point(c[0], c[1]) : Point(c[2], c[3]);
+			Point right = inOrder ? Point(c[2], c[3]) : Point(c[0], c[1]);
+			entries[i] = makeStatusEntry((int)i, left, right);
+			// A segment of length 0 crosses no line x = c with x1 <= c < x2, and its end would precede its start.
+			if (left.getX() != right.getX() || left.getY() != right.getY())
+			{
+				events.push_back({ left.getX(), left.getY(), (uint32_t)i, (uint32_t)Type::LEFT });
+				events.push_back({ right.getX(), right.getY(), (uint32_t)i, (uint32_t)Type::RIGHT });
+			}
+			nodeOf[i] = (uint32_t)i + 1;
+		}
+		sort(events.begin(), events.end(), eventPrecedes);
+
+		nodes.assign(1, { { NIL, NIL, 0 }, 0, {} });
+		versionX.clear();
+		versionRoot.clear();
+		stamp = 1;
+		currentRoot = NIL;
+
+		// The crossings are replayed between the endpoints as SweepEngine processed them: at one point, after the
+		// segments ending there and before those starting there.
+		size_t next = 0, crossing = 0;
+		while (next < events.size() || crossing < crossings.size())
+		{
+			double x;
+			if (crossing < crossings.size()
+				&& (next == events.size() || crossingFirst(crossings[crossing], events[next])))
+			{
+				x = crossings[crossing].x;
+				swapAdjacent(crossings[crossing++]);
+			}
+			else
+			{
+				Event& e = events[next++];
+				x = e.x;
+				if (e.type == (uint32_t)Type::LEFT)
+				{
+					insert(e.id, e.x, e.y);
+				}
+				else
+				{
+					remove(e.id);
+				}
+			}
+
+			bool lastAtX = (next == events.size() || events[next].x != x)
+				&& (crossing == crossings.size() || crossings[crossing].x != x);
+			if (lastAtX)
+			{
+				keepVersion(x);
+			}
+		}
+
+		current.clear();
+		current.shrink_to_fit();
+		nodeOf.clear();
+		nodeOf.shrink_to_fit();
+		buildMs = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count()
+			/ 1e3;
+	}
+
+	// Ids of the segments with x1 <= x < x2, in order of y along the line, vertical segments excepted.
+	void stab(double x, vector<uint32_t>& ids) const {
+		stab(x, -HUGE_VAL, HUGE_VAL, ids);
+	}
+
+	// Ids of the segments crossing the line x between y0 and y1, in order of y.
+	void stab(double x, double y0, double y1, vector<uint32_t>& ids) const {
+		uint32_t version;
+		uint32_t node = versionAt(x, version);
+		collect(node, version, x, y0, y1, ids);
+	}
+
+	// Id of the segment crossing the vertical line through a point closest above it, or -1 if there is none.
+	int above(double x, double y) const {
+		int found = -1;
+		uint32_t version;
+		for (uint32_t node = versionAt(x, version); node != NIL;)
+		{
+			uint32_t id = fieldAt(node, SEGMENT, version);
+			if (entries[id].yAt(x) > y)
+			{
+				found = (int)id;
+				node = fieldAt(node, LEFT_CHILD, version);
+			}
+			else
+			{
+				node = fieldAt(node, RIGHT_CHILD, version);
+			}
+		}
+		return found;
+	}
+
+	// Id of the segment crossing the vertical line through a point closest below it, or -1 if there is none.
+	int below(double x, double y) const {
+		int found = -1;
+		uint32_t version;
+		for (uint32_t node = versionAt(x, version); node != NIL;)
+		{
+			uint32_t id = fieldAt(node, SEGMENT, version);
+			if (entries[id].yAt(x) < y)
+			{
+				found = (int)id;
+				node = fieldAt(node, RIGHT_CHILD, version);
+			}
+			else
+			{
+				node = fieldAt(node, LEFT_CHILD, version);
+			}
+		}
+		return found;
+	}
+
+	size_t getVersionCount() const {
+		return versionX.size();
+	}
+
+	size_t getNodeCount() const {
+		return nodes.size();
+	}
+
+	size_t getMemoryBytes() const {
+		return nodes.capacity() * sizeof(Node) + entries.capacity() * sizeof(StatusEntry)
+			+ versionX.capacity() * sizeof(double) + versionRoot.capacity() * sizeof(uint32_t);
+	}
+
+	double getBuildMs() const {
+		return buildMs;
+	}
+};
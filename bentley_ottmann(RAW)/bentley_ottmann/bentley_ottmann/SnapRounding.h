@@ -0,0 +1,285 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Structures.h"
+
+// A piece of the snap rounded output, between the centres of two pixels given by their column and row.
+struct GridSegment {
+	int64_t x1;
+	int64_t y1;
+	int64_t x2;
+	int64_t y2;
+
+	bool operator<(const GridSegment& o) const {
+		if (x1 != o.x1)
+		{
+			return x1 < o.x1;
+		}
+		else if (y1 != o.y1)
+		{
+			return y1 < o.y1;
+		}
+		else if (x2 != o.x2)
+		{
+			return x2 < o.x2;
+		}
+
+		return y2 < o.y2;
+	}
+
+	bool operator==(const GridSegment& o) const {
+		return x1 == o.x1 && y1 == o.y1 && x2 == o.x2 && y2 == o.y2;
+	}
+};
+
+/*
+ * Snap rounding of the segments of a sweep to a grid of square pixels, pixel (i, j) being the square of side
+ * pixelSize centred on (i * pixelSize, j * pixelSize). A pixel is hot when it contains an endpoint or an intersection;
+ * endpoints are known up front and intersections are added by the sweep as it reports them. Once the sweep is done,
+ * every segment is rerouted through the centres of the hot pixels it passes through, in order along the segment, and
+ * the pieces are merged into a single set of grid segments.
+ *
+ * Rounding the intersections alone moves segments past one another and creates crossings that were not there. Snap
+ * rounding bends a segment at every hot pixel it meets instead, so the output only meets at pixel centres and keeps
+ * the order of the input along every segment (Hobby; Guibas and Marimont). The hot pixels are bucketed in a grid of
+ * buckets holding about one of them each, and each segment only tests the pixels of the buckets along it, so the cost
+ * after the sweep follows n plus the number of hot pixels near the segments rather than their number times n.
+ *
+ * Pixels are closed squares here, so a segment passing exactly through the corner of a hot pixel is bent through it.
+ */
+class SnapRounding {
+private:
+	struct Pixel {
+		int64_t x;
+		int64_t y;
+
+		bool operator<(const Pixel& o) const {
+			return x != o.x ? x < o.x : y < o.y;
+		}
+
+		bool operator==(const Pixel& o) const {
+			return x == o.x && y == o.y;
+		}
+	};
+
+	double pixelSize;
+	vector<LineSegment*> segments;
+	vector<Pixel> hotPixels; // with duplicates until finish
+	vector<GridSegment> output;
+
+	int64_t minColumn, minRow; // pixel at the bottom left corner of the bucket grid
+	int64_t cellPixels; // side of a bucket in pixels
+	int columns, rows;
+	vector<uint32_t> cellStart; // hot pixels of bucket c are cellItems[cellStart[c]] to cellItems[cellStart[c + 1] - 1]
+	vector<uint32_t> cellItems;
+
+	Pixel pixelOf(Point p) {
+		return { (int64_t)floor(p.getX() / pixelSize + 0.5), (int64_t)floor(p.getY() / pixelSize + 0.5) };
+	}
+
+	int columnOf(double x) {
+		return (int)max(0.0, min(columns - 1.0, floor((x - minColumn + 0.5) / cellPixels)));
+	}
+
+	int rowOf(double y) {
+		return (int)max(0.0, min(rows - 1.0, floor((y - minRow + 0.5) / cellPixels)));
+	}
+
+	size_t bucketOf(Pixel p) {
+		return (size_t)rowOf((double)p.y) * columns + columnOf((double)p.x);
+	}
+
+	void buildBuckets() {
+		int64_t maxColumn = minColumn = hotPixels[0].x;
+		int64_t maxRow = minRow = hotPixels[0].y;
+		for (Pixel& p : hotPixels)
+		{
+			minColumn = min(minColumn, p.x);
+			maxColumn = max(maxColumn, p.x);
+			minRow = min(minRow, p.y);
+			maxRow = max(maxRow, p.y);
+		}
+
+		// Buckets are sized so that each holds about one hot pixel on average.
+		double width = (double)(maxColumn - minColumn + 1), height = (double)(maxRow - minRow + 1);
+		cellPixels = max((int64_t)1, (int64_t)ceil(sqrt(width * height / hotPixels.size())));
+		columns = (int)min((double)(1 << 15), ceil(width / cellPixels));
+		rows = (int)min((double)(1 << 15), ceil(height / cellPixels));
+		cellPixels = max(cellPixels, (int64_t)max(ceil(width / columns), ceil(height / rows)));
+
+		cellStart.assign((size_t)columns * rows + 1, 0);
+		for (Pixel& p : hotPixels)
+		{
+			cellStart[bucketOf(p) + 1]++;
+		}
+		for (size_t c = 1; c < cellStart.size(); c++)
+		{
+			cellStart[c] += cellStart[c - 1];
+		}
+
+		cellItems.resize(hotPixels.size());
+		vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+		for (uint32_t i = 0; i < hotPixels.size(); i++)
+		{
+			cellItems[next[bucketOf(hotPixels[i])]++] = i;
+		}
+	}
+
+	/*
+	 * Tests whether the segment from (x1, y1) to (x2, y2), in pixel units, meets the closed square of a pixel: their
+	 * bounding boxes overlap and the corners of the square are not all strictly on one side of the segment.
+	 */
+	static bool meets(double x1, double y1, double x2, double y2, Pixel p) {
+		double left = p.x - 0.5, right = p.x + 0.5, bottom = p.y - 0.5, top = p.y + 0.5;
+		if (max(x1, x2) < left || min(x1, x2) > right || max(y1, y2) < bottom || min(y1, y2) > top)
+		{
+			return false;
+		}
+
+		double dx = x2 - x1, dy = y2 - y1;
+		int positive = 0, negative = 0;
+		for (double cx : { left, right })
+		{
+			for (double cy : { bottom, top })
+			{
+				double side = dx * (cy - y1) - dy * (cx - x1);
+				positive += side > 0.0;
+				negative += side < 0.0;
+			}
+		}
+
+		return positive < 4 && negative < 4;
+	}
+
+	// Appends the pieces of a segment, bent through the centres of the hot pixels it meets.
+	void route(LineSegment* s, vector<pair<double, uint32_t>>& met) {
+		Point left = s->getLeftEndpoint(), right = s->getRightEndpoint();
+		double x1 = left.getX() / pixelSize, y1 = left.getY() / pixelSize;
+		double x2 = right.getX() / pixelSize, y2 = right.getY() / pixelSize;
+		double dx = x2 - x1, dy = y2 - y1;
+		met.clear();
+
+		if (dx == 0.0 && dy == 0.0)
+		{
+			return;
+		}
+
+		// Walk the bucket columns the segment spans, and in each the rows its y covers over the pixels of that column.
+		// Bounds are widened by half a pixel, as closed pixels on either side of a boundary both meet a point on it.
+		int firstColumn = columnOf(x1 - 0.5), lastColumn = columnOf(x2 + 0.5);
+		for (int c = firstColumn; c <= lastColumn; c++)
+		{
+			double from = max(x1, minColumn + (double)c * cellPixels - 0.5);
+			double to = min(x2, minColumn + (double)(c + 1) * cellPixels - 0.5);
+			double yFrom = dx == 0.0 ? y1 : y1 + dy * (from - x1) / dx;
+			double yTo = dx == 0.0 ? y2 : y1 + dy * (to - x1) / dx;
+
+			int firstRow = rowOf(min(yFrom, yTo) - 0.5), lastRow = rowOf(max(yFrom, yTo) + 0.5);
+			for (int r = firstRow; r <= lastRow; r++)
+			{
+				size_t cell = (size_t)r * columns + c;
+				for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+				{
+					Pixel& p = hotPixels[cellItems[i]];
+					if (meets(x1, y1, x2, y2, p))
+					{
+						met.push_back(make_pair((p.x - x1) * dx + (p.y - y1) * dy, cellItems[i]));
+					}
+				}
+			}
+		}
+
+		sort(met.begin(), met.end());
+		for (size_t i = 1; i < met.size(); i++)
+		{
+			Pixel& a = hotPixels[met[i - 1].second];
+			Pixel& b = hotPixels[met[i].second];
+			if (b < a)
+			{
+				output.push_back({ b.x, b.y, a.x, a.y });
+			}
+			else if (a < b)
+			{
+				output.push_back({ a.x, a.y, b.x, b.y });
+			}
+		}
+	}
+
+public:
+	SnapRounding(double pixelSize) {
+		this->pixelSize = pixelSize;
+	}
+
+	// Takes the segments to round, all of them including those the sweep leaves out, and makes their endpoints hot.
+	void start(vector<LineSegment*>& segments) {
+		this->segments = segments;
+		hotPixels.clear();
+		output.clear();
+
+		for (LineSegment* s : segments)
+		{
+			hotPixels.push_back(pixelOf(s->getP1()));
+			hotPixels.push_back(pixelOf(s->getP2()));
+		}
+	}
+
+	// At an INTERSECTION event: makes the pixel of the crossing hot.
+	void addCrossing(Point p) {
+		hotPixels.push_back(pixelOf(p));
+	}
+
+	// Once the sweep is done, reroutes every segment through its hot pixels. Returns the grid segments, each once.
+	vector<GridSegment>& finish() {
+		sort(hotPixels.begin(), hotPixels.end());
+		hotPixels.erase(unique(hotPixels.begin(), hotPixels.end()), hotPixels.end());
+		if (hotPixels.empty())
+		{
+			return output;
+		}
+
+		buildBuckets();
+
+		vector<pair<double, uint32_t>> met;
+		for (LineSegment* s : segments)
+		{
+			route(s, met);
+		}
+
+		sort(output.begin(), output.end());
+		output.erase(unique(output.begin(), output.end()), output.end());
+		return output;
+	}
+
+	// Writes the grid segments in the format of in.txt, with pixel centres in input coordinates.
+	bool write(string path) {
+		FILE* file;
+		if (fopen_s(&file, path.c_str(), "w") != 0 || file == nullptr)
+		{
+			cerr << "Could not open " << path << endl;
+			return false;
+		}
+
+		fprintf(file, "%d\n", (int)output.size());
+		for (GridSegment& g : output)
+		{
+			fprintf(file, "%.17g %.17g %.17g %.17g\n", g.x1 * pixelSize, g.y1 * pixelSize, g.x2 * pixelSize,
+				g.y2 * pixelSize);
+		}
+
+		fclose(file);
+		return true;
+	}
+
+	size_t getHotPixelCount() {
+		return hotPixels.size();
+	}
+
+	double getPixelSize() {
+		return pixelSize;
+	}
+};
@@ -0,0 +1,293 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Structures.h"
+#include "SweepEngine.h"
+#include "IntersectionKernel.h"
+
+// An intersection found by a window query, with the ids of the two segments in the indexed segment store.
+struct WindowIntersection {
+	double x;
+	double y;
+	uint32_t firstId;
+	uint32_t secondId;
+};
+
+/*
+ * Bucketed grid over a static set of segments for repeated window queries. Every segment is listed in the cells its
+ * bounding box covers. A query gathers the segments listed in the cells the window covers, clips them to the window
+ * and sweeps only those, so its cost follows the number of segments near the window rather than the size of the
+ * whole set. A query gathering only a few segments tests all their pairs with the batched IntersectionKernel instead,
+ * which costs less than sorting their endpoints for a sweep.
+ *
+ * The grid is built once; queries reuse the buffers of the index and of its sweep engine, so an index answers one
+ * query at a time.
+ */
+class SpatialIndex {
+private:
+	static const size_t PAIR_TEST_CANDIDATES = 64; // most segments gathered for which all pairs are tested
+
+	vector<LineSegment*> segments;
+	double minX, minY;
+	double cellSize;
+	int columns, rows;
+	vector<uint32_t> cellStart; // segments of cell c are cellItems[cellStart[c]] to cellItems[cellStart[c + 1] - 1]
+	vector<uint32_t> cellItems;
+
+	vector<uint32_t> seenAt; // query number at which each segment was last gathered
+	uint32_t queryNumber;
+	vector<uint32_t> candidates;
+	vector<double> clipped; // clipped candidates as x1, y1, x2, y2
+	SweepEngine<double, DefaultTolerance, CallbackSink> engine;
+	SegmentBatch batch; // clipped candidates for the pair tests
+	vector<int> pairFirst, pairSecond;
+	vector<unsigned char> pairHits;
+
+	struct Query {
+		SpatialIndex* index;
+		double minX, minY, maxX, maxY;
+		vector<WindowIntersection>* out;
+	};
+
+	int columnOf(double x) {
+		return max(0, min(columns - 1, (int)floor((x - minX) / cellSize)));
+	}
+
+	int rowOf(double y) {
+		return max(0, min(rows - 1, (int)floor((y - minY) / cellSize)));
+	}
+
+	template <typename Visit>
+	void forCells(double x1, double y1, double x2, double y2, Visit visit) {
+		int c1 = columnOf(x1), c2 = columnOf(x2);
+		int r1 = rowOf(y1), r2 = rowOf(y2);
+
+		for (int r = r1; r <= r2; r++)
+		{
+			for (int c = c1; c <= c2; c++)
+			{
+				visit(r * columns + c);
+			}
+		}
+	}
+
+	/*
+	 * Clips the segment from (x1, y1) to (x2, y2) to a rectangle with the Liang-Barsky algorithm. Returns false if no
+	 * part of the segment lies inside.
+	 */
+	static bool clip(double& x1, double& y1, double& x2, double& y2, double left, double bottom, double right,
+		double top) {
+		double dx = x2 - x1, dy = y2 - y1;
+		double p[4] = { -dx, dx, -dy, dy };
+		double q[4] = { x1 - left, right - x1, y1 - bottom, top - y1 };
+		double t0 = 0.0, t1 = 1.0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			if (p[i] == 0.0)
+			{
+				if (q[i] < 0.0)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				double t = q[i] / p[i];
+				if (p[i] < 0.0)
+				{
+					t0 = max(t0, t);
+				}
+				else
+				{
+					t1 = min(t1, t);
+				}
+			}
+		}
+
+		if (t0 > t1)
+		{
+			return false;
+		}
+
+		double startX = x1 + t0 * dx, startY = y1 + t0 * dy;
+		x2 = x1 + t1 * dx;
+		y2 = y1 + t1 * dy;
+		x1 = startX;
+		y1 = startY;
+		return true;
+	}
+
+	static void report(double x, double y, uint32_t lowerId, uint32_t upperId, void* context) {
+		Query* query = (Query*)context;
+
+		if (x >= query->minX && x <= query->maxX && y >= query->minY && y <= query->maxY)
+		{
+			SpatialIndex* index = query->index;
+			query->out->push_back({ x, y, index->candidates[lowerId], index->candidates[upperId] });
+		}
+	}
+
+	// Tests every pair of the clipped candidates, reporting the crossings in the order of a sweep.
+	void testAllPairs(Query& query) {
+		batch.clear();
+		pairFirst.clear();
+		pairSecond.clear();
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			batch.add(clipped[4 * i], clipped[4 * i + 1], clipped[4 * i + 2], clipped[4 * i + 3]);
+			for (size_t j = 0; j < i; j++)
+			{
+				pairFirst.push_back((int)j);
+				pairSecond.push_back((int)i);
+			}
+		}
+
+		pairHits.resize(pairFirst.size());
+		IntersectionKernel::testPairs(batch, pairFirst.data(), pairSecond.data(), (int)pairFirst.size(),
+			pairHits.data());
+
+		for (size_t p = 0; p < pairHits.size(); p++)
+		{
+			if (pairHits[p])
+			{
+				Point crossing = IntersectionKernel::crossingPoint(batch, pairFirst[p], pairSecond[p]);
+				report(crossing.getX(), crossing.getY(), pairFirst[p], pairSecond[p], &query);
+			}
+		}
+
+		sort(query.out->begin(), query.out->end(), [](const WindowIntersection& a, const WindowIntersection& b) {
+			return a.x != b.x ? a.x < b.x : a.y < b.y;
+		});
+	}
+
+public:
+	// Builds the grid with cells sized so that each holds about segmentsPerCell segments on average.
+	SpatialIndex(vector<LineSegment*>& segments, double segmentsPerCell = 4.0) {
+		this->segments = segments;
+		double maxX, maxY;
+		minX = minY = HUGE_VAL;
+		maxX = maxY = -HUGE_VAL;
+
+		for (LineSegment* s : segments)
+		{
+			minX = min(minX, min(s->getP1().getX(), s->getP2().getX()));
+			maxX = max(maxX, max(s->getP1().getX(), s->getP2().getX()));
+			minY = min(minY, min(s->getP1().getY(), s->getP2().getY()));
+			maxY = max(maxY, max(s->getP1().getY(), s->getP2().getY()));
+		}
+
+		if (segments.empty())
+		{
+			minX = minY = maxX = maxY = 0.0;
+		}
+
+		double width = max(maxX - minX, POINT_EPSILON);
+		double height = max(maxY - minY, POINT_EPSILON);
+		double cellCount = max(1.0, segments.size() / segmentsPerCell);
+		cellSize = sqrt(width * height / cellCount);
+		columns = max(1, min(1 << 15, (int)ceil(width / cellSize)));
+		rows = max(1, min(1 << 15, (int)ceil(height / cellSize)));
+		cellSize = max(width / columns, height / rows);
+
+		// Count the segments of each cell, then fill the cells in a single array.
+		cellStart.assign((size_t)columns * rows + 1, 0);
+		for (LineSegment* s : segments)
+		{
+			forCells(min(s->getP1().getX(), s->getP2().getX()), min(s->getP1().getY(), s->getP2().getY()),
+				max(s->getP1().getX(), s->getP2().getX()), max(s->getP1().getY(), s->getP2().getY()),
+				[this](int cell) { cellStart[cell + 1]++; });
+		}
+		for (size_t c = 1; c < cellStart.size(); c++)
+		{
+			cellStart[c] += cellStart[c - 1];
+		}
+
+		cellItems.resize(cellStart.back());
+		vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+		for (uint32_t id = 0; id < segments.size(); id++)
+		{
+			LineSegment* s = segments[id];
+			forCells(min(s->getP1().getX(), s->getP2().getX()), min(s->getP1().getY(), s->getP2().getY()),
+				max(s->getP1().getX(), s->getP2().getX()), max(s->getP1().getY(), s->getP2().getY()),
+				[this, &next, id](int cell) { cellItems[next[cell]++] = id; });
+		}
+
+		seenAt.assign(segments.size(), 0);
+		queryNumber = 0;
+	}
+
+	/*
+	 * Finds the intersections lying inside the window, edges included. Segments are clipped to the window grown by a
+	 * small margin, so that crossings on the edges of the window are not lost to the clipped endpoints.
+	 */
+	vector<WindowIntersection> query(double left, double bottom, double right, double top) {
+		vector<WindowIntersection> found;
+		if (left > right || bottom > top)
+		{
+			return found;
+		}
+
+		if (++queryNumber == 0)
+		{
+			fill(seenAt.begin(), seenAt.end(), 0);
+			queryNumber = 1;
+		}
+
+		double margin = POINT_EPSILON * (1.0 + max(right - left, top - bottom));
+		candidates.clear();
+		clipped.clear();
+
+		forCells(left - margin, bottom - margin, right + margin, top + margin, [&](int cell) {
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+			{
+				uint32_t id = cellItems[i];
+				if (seenAt[id] == queryNumber)
+				{
+					continue;
+				}
+				seenAt[id] = queryNumber;
+
+				Point p1 = segments[id]->getP1();
+				Point p2 = segments[id]->getP2();
+				double x1 = p1.getX(), y1 = p1.getY(), x2 = p2.getX(), y2 = p2.getY();
+
+				if (clip(x1, y1, x2, y2, left - margin, bottom - margin, right + margin, top + margin))
+				{
+					candidates.push_back(id);
+					clipped.push_back(x1);
+					clipped.push_back(y1);
+					clipped.push_back(x2);
+					clipped.push_back(y2);
+				}
+			}
+		});
+
+		Query context = { this, left, bottom, right, top, &found };
+		if (candidates.size() <= PAIR_TEST_CANDIDATES)
+		{
+			testAllPairs(context);
+			return found;
+		}
+
+		engine.getSink().callback = report;
+		engine.getSink().context = &context;
+		engine.run(SegmentView<double>(clipped.data(), candidates.size()));
+		return found;
+	}
+
+	// Segments gathered by the last query.
+	size_t getLastCandidateCount() {
+		return candidates.size();
+	}
+
+	int getColumns() {
+		return columns;
+	}
+
+	int getRows() {
+		return rows;
+	}
+};
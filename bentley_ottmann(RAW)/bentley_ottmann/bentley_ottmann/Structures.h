@@ -3,12 +3,15 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include "RadixSort.h"
+#include "MemoryAccounting.h"
 using namespace std;
 
-double GENERAL_EPSILON = 0.000000001;
-double POINT_EPSILON = 0.000000001;
+inline double GENERAL_EPSILON = 0.000000001;
+inline double POINT_EPSILON = 0.000000001;
 
-enum class Type { LEFT, RIGHT, INTERSECTION };
+// VERTEX is a vertex of a chain, where one edge ends and the next begins; it is used by SweepEngine::runChains only.
+enum class Type { LEFT, RIGHT, INTERSECTION, VERTEX };
 
 
 class Point {
@@ -56,10 +59,17 @@ public:
 	}
 };
 
+class LineSegment;
+
+// Crossing point of two line segments, looked up in intersectionCache while a sweep has one. Defined after
+// IntersectionCache.
+inline bool findCrossing(LineSegment* a, LineSegment* b, Point& crossing);
+
 class LineSegment {
 private:
 	Point p1;
 	Point p2;
+	int id; // Index of this line segment in segmentStore.
 
 	// Finds the area of the triangle formed by three points using the shoelace formula.
 	double area(Point a, Point b, Point c) {
@@ -218,8 +228,18 @@ public:
 	LineSegment(Point begin, Point end){
 		this->p1 = begin;
 		this->p2 = end;
+		this->id = -1;
+	}
+	LineSegment() {
+		id = -1;
+	}
+	int getId() {
+		return id;
+	}
+
+	void setId(int id) {
+		this->id = id;
 	}
-	LineSegment() {}
 	bool isHorizontal(){
 		return fabs(p1.getY() - p2.getY()) < POINT_EPSILON ? true : false;
 	}
@@ -361,6 +381,7 @@ public:
 			}
 
 			Point* result = new Point(x, y);
+			sweepMemory.allocate(MemoryCategory::CROSSING_POINTS, sizeof(Point));
 			return result;
 		}
 	}
@@ -428,11 +449,11 @@ public:
 			{
 				if (fabs(eventPoint.getY() - y) < POINT_EPSILON)
 				{
-					Point* crossingPoint = this->getIntersectionPointWith(other);
+					Point crossingPoint;
 
-					if (crossingPoint != nullptr  && crossingPoint->equals(eventPoint))
+					if (findCrossing(this, other, crossingPoint) && crossingPoint.equals(eventPoint))
 					{
-						double orientation = crossProductK(*crossingPoint, thisRight, *crossingPoint, otherRight);
+						double orientation = crossProductK(crossingPoint, thisRight, crossingPoint, otherRight);
 
 						if (orientation <= 0.0)
 						{
@@ -496,72 +517,308 @@ public:
 	}
 };
 
+// Frees a point returned by LineSegment::getIntersectionPointWith.
+inline void deleteCrossingPoint(Point* crossingPoint) {
+	sweepMemory.release(MemoryCategory::CROSSING_POINTS, sizeof(Point));
+	delete crossingPoint;
+}
+
+// All line segments of the current sweep, indexed by id, so that events can refer to segments by a 32 bit id.
+inline vector<LineSegment*> segmentStore;
+
+// Registers the line segments of a sweep in segmentStore, giving each one its index as id.
+inline void storeSegments(vector<LineSegment*>& segments) {
+	segmentStore = segments;
+
+	for (int i = 0; i < (int)segments.size(); i++)
+	{
+		segments[i]->setId(i);
+	}
+}
+
+/*
+ * Remembers the crossing point, or the absence of one, of every pair of line segments tested during a sweep, since
+ * the same neighbours are tested on insertion, on removal, after every swap and again by compareTo on ties. It is an
+ * open addressing table with linear probing keyed by the unordered pair of segment ids. Once a segment has been
+ * removed from the sweep line it is retired: entries with a retired segment are never read again and their slots are
+ * reused by later insertions, or dropped when the table is rebuilt.
+ */
+class IntersectionCache {
+private:
+	static const uint64_t EMPTY_KEY = ~0ULL;
+
+	struct Entry {
+		uint64_t key;
+		double x;
+		double y;
+		bool crosses;
+	};
+
+	vector<Entry> table;
+	vector<bool> retired;
+	size_t used; // Slots holding an entry, including entries of retired segments.
+	long long lookups;
+	long long hits;
+
+	static uint64_t keyOf(uint32_t a, uint32_t b) {
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	bool isStale(uint64_t key) {
+		return retired[(size_t)(key >> 32)] || retired[(size_t)(key & 0xFFFFFFFF)];
+	}
+
+	size_t slotOf(uint64_t key) {
+		return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 20) & (table.size() - 1);
+	}
+
+	// Rehashes the live entries into a table at most a quarter full, dropping those of retired segments.
+	void rebuild() {
+		vector<Entry> live;
+		for (Entry& entry : table)
+		{
+			if (entry.key != EMPTY_KEY && !isStale(entry.key))
+			{
+				live.push_back(entry);
+			}
+		}
+
+		size_t capacity = table.size();
+		while (live.size() * 4 > capacity)
+		{
+			capacity *= 2;
+		}
+
+		table.assign(capacity, Entry{ EMPTY_KEY, 0.0, 0.0, false });
+		for (Entry& entry : live)
+		{
+			size_t slot = slotOf(entry.key);
+			while (table[slot].key != EMPTY_KEY)
+			{
+				slot = (slot + 1) & (table.size() - 1);
+			}
+			table[slot] = entry;
+		}
+		used = live.size();
+		trackMemory();
+	}
+
+	void trackMemory() {
+		sweepMemory.track(MemoryCategory::CACHE, table.capacity() * sizeof(Entry) + retired.size() / 8, (long long)used);
+	}
+
+public:
+	IntersectionCache(int segmentCount) {
+		table.assign(1024, Entry{ EMPTY_KEY, 0.0, 0.0, false });
+		retired.assign(segmentCount, false);
+		used = 0;
+		lookups = hits = 0;
+		trackMemory();
+	}
+
+	~IntersectionCache() {
+		sweepMemory.track(MemoryCategory::CACHE, 0, 0);
+	}
+
+	// Whether the pair can be cached: both segments belong to this sweep and are still on the sweep line.
+	bool accepts(LineSegment* a, LineSegment* b) {
+		return a->getId() >= 0 && a->getId() < (int)retired.size() && !retired[a->getId()]
+			&& b->getId() >= 0 && b->getId() < (int)retired.size() && !retired[b->getId()];
+	}
+
+	/*
+	 * Finds the crossing point of a and b as getIntersectionPointWith would, computing it only on the first lookup of
+	 * the pair. The computation is always made from the segment with the lower id, so that every lookup of a pair sees
+	 * the same point.
+	 */
+	bool find(LineSegment* a, LineSegment* b, Point& crossing) {
+		uint64_t key = keyOf((uint32_t)a->getId(), (uint32_t)b->getId());
+		size_t slot = slotOf(key);
+		size_t reusable = table.size();
+		lookups++;
+
+		while (table[slot].key != EMPTY_KEY)
+		{
+			if (table[slot].key == key)
+			{
+				hits++;
+				crossing = Point(table[slot].x, table[slot].y);
+				return table[slot].crosses;
+			}
+			else if (reusable == table.size() && isStale(table[slot].key))
+			{
+				reusable = slot;
+			}
+			slot = (slot + 1) & (table.size() - 1);
+		}
+
+		LineSegment* first = a->getId() < b->getId() ? a : b;
+		LineSegment* second = first == a ? b : a;
+		Point* crossingPoint = first->getIntersectionPointWith(second);
+		Entry entry = { key, 0.0, 0.0, crossingPoint != nullptr };
+		if (crossingPoint != nullptr)
+		{
+			entry.x = crossingPoint->getX();
+			entry.y = crossingPoint->getY();
+			crossing = *crossingPoint;
+			deleteCrossingPoint(crossingPoint);
+		}
+
+		if (reusable != table.size())
+		{
+			table[reusable] = entry;
+		}
+		else
+		{
+			table[slot] = entry;
+			used++;
+
+			if (used * 2 > table.size())
+			{
+				rebuild();
+			}
+		}
+
+		return entry.crosses;
+	}
+
+	// Called once a segment has left the sweep line, after which none of its pairs are looked up again.
+	void retire(LineSegment* segment) {
+		if (segment->getId() >= 0 && segment->getId() < (int)retired.size())
+		{
+			retired[segment->getId()] = true;
+		}
+	}
+
+	long long getLookups() {
+		return lookups;
+	}
+
+	long long getHits() {
+		return hits;
+	}
+
+	double getHitRate() {
+		return lookups > 0 ? (double)hits / lookups : 0.0;
+	}
+};
+
+// Cache of the sweep in progress, or nullptr when crossings are computed on every test.
+inline IntersectionCache* intersectionCache = nullptr;
+
+inline bool findCrossing(LineSegment* a, LineSegment* b, Point& crossing) {
+	if (intersectionCache != nullptr && intersectionCache->accepts(a, b))
+	{
+		return intersectionCache->find(a, b, crossing);
+	}
+
+	Point* crossingPoint = a->getIntersectionPointWith(b);
+	if (crossingPoint == nullptr)
+	{
+		return false;
+	}
+
+	crossing = *crossingPoint;
+	deleteCrossingPoint(crossingPoint);
+	return true;
+}
+
+/*
+ * An event is stored by value in 24 bytes: the event point, the id of its segment, and the id of the segment it
+ * intersects with the event type packed in the top two bits. Segments are looked up in segmentStore.
+ */
 class Event {
 
 private:
-	Point eventPoint;
-	LineSegment* segment;
-	LineSegment* intersectionSegment;
-	Type eventType;
+	static const uint32_t ID_MASK = 0x3FFFFFFF;
+	static const uint32_t NO_SEGMENT = ID_MASK;
+	static const int TYPE_SHIFT = 30;
+
+	double x;
+	double y;
+	uint32_t segmentId;
+	uint32_t intersectionIdAndType;
 
 public:
-	Event(){}
+	// Segment ids below the mask are stored, the mask itself marking an event without a second segment.
+	static const int MAX_SEGMENTS = (int)ID_MASK;
+
+private:
+	static uint32_t idOf(LineSegment* segment) {
+		return segment != nullptr ? (uint32_t)segment->getId() : NO_SEGMENT;
+	}
+
+	static LineSegment* segmentOf(uint32_t id) {
+		return id != NO_SEGMENT ? segmentStore[id] : nullptr;
+	}
+
+public:
+	Event() {
+		x = y = 0;
+		segmentId = NO_SEGMENT;
+		intersectionIdAndType = NO_SEGMENT;
+	}
 
 	Event(Point eventPoint, LineSegment* segment, LineSegment* intersectionSegment, Type eventType) {
-		this->eventPoint = eventPoint;
-		this->segment = segment;
-		this->intersectionSegment = intersectionSegment;
-		this->eventType = eventType;
+		this->x = eventPoint.getX();
+		this->y = eventPoint.getY();
+		this->segmentId = idOf(segment);
+		this->intersectionIdAndType = idOf(intersectionSegment) | ((uint32_t)eventType << TYPE_SHIFT);
 	}
 
 	Event(Point eventPoint, LineSegment* segment, Type eventType) {
-		this->eventPoint = eventPoint;
-		this->segment = segment;
-		this->eventType = eventType;
-
-		this->intersectionSegment = nullptr;
+		this->x = eventPoint.getX();
+		this->y = eventPoint.getY();
+		this->segmentId = idOf(segment);
+		this->intersectionIdAndType = NO_SEGMENT | ((uint32_t)eventType << TYPE_SHIFT);
 	}
 
 	Point getEventPoint() {
-		return eventPoint;
+		return Point(x, y);
+	}
+
+	double getX() {
+		return x;
+	}
+
+	double getY() {
+		return y;
 	}
 
 	Type getEventType() {
-		return eventType;
+		return (Type)(intersectionIdAndType >> TYPE_SHIFT);
 	}
 
 	LineSegment* getIntersectionSegment() {
-		return intersectionSegment;
+		return segmentOf(intersectionIdAndType & ID_MASK);
 	}
 
 	LineSegment* getSegment() {
-		return segment;
+		return segmentOf(segmentId);
 	}
 
 	void setEventPoint(Point eventPoint) {
-		this->eventPoint = eventPoint;
+		this->x = eventPoint.getX();
+		this->y = eventPoint.getY();
 	}
 
 	void setEventType(Type eventType) {
-		this->eventType = eventType;
+		this->intersectionIdAndType = (intersectionIdAndType & ID_MASK) | ((uint32_t)eventType << TYPE_SHIFT);
 	}
 
 	void setIntersectionSegment(LineSegment* intersectionSegment)
 	{
-		this->intersectionSegment = intersectionSegment;
+		this->intersectionIdAndType = idOf(intersectionSegment) | (intersectionIdAndType & ~ID_MASK);
 	}
 
 	void setSegment(LineSegment* segment)
 	{
-		this->segment = segment;
+		this->segmentId = idOf(segment);
 	}
-
-	//string toString() {
-	//	
-	//	return x;
-	//}
 };
 
+static_assert(sizeof(Event) == 24, "Event records are expected to be 24 bytes");
+
 class Node
 {
 private:
@@ -641,6 +898,22 @@ class BinarySearchTree
 {
 private:
 	Node* root; // Root of the bst, implemented as a dummy node.
+	static Node* newNode() {
+		sweepMemory.allocate(MemoryCategory::STATUS, sizeof(Node));
+		return new Node();
+	}
+	static void deleteNode(Node* p) {
+		sweepMemory.release(MemoryCategory::STATUS, sizeof(Node));
+		delete p;
+	}
+	void destroy(Node* p) {
+		if (p != nullptr)
+		{
+			destroy(p->getLeftChild());
+			destroy(p->getRightChild());
+			deleteNode(p);
+		}
+	}
 	Node* findInorderPredecessorOf(Node* p) {
 		if (p->getLeftChild() != nullptr)
 		{
@@ -699,6 +972,32 @@ private:
 
 		return current;
 	}
+	// Takes a node with at most one child out of the tree, its child taking its place.
+	void unlinkNode(Node* p)
+	{
+		Node* child = p->getLeftChild() != nullptr ? p->getLeftChild() : p->getRightChild();
+		Node* parent = p->getParent();
+
+		if (child != nullptr)
+		{
+			child->setParent(parent);
+		}
+
+		if (parent == nullptr)
+		{
+			root->setLeftChild(child);
+		}
+		else if (parent->getLeftChild() == p)
+		{
+			parent->setLeftChild(child);
+		}
+		else
+		{
+			parent->setRightChild(child);
+		}
+
+		deleteNode(p);
+	}
 	Node* findMinNodeFrom(Node* p){
 		Node* current = p;
 
@@ -794,7 +1093,7 @@ private:
 		{
 			if (p->getLeftChild() == nullptr)
 			{
-				Node* newChild = new Node();
+				Node* newChild = newNode();
 				newChild->setNode(s, p, nullptr, nullptr, nullptr, nullptr);
 				p->setLeftChild(newChild);
 				newChild->setPredecessor(findInorderPredecessorOf(newChild));
@@ -822,7 +1121,7 @@ private:
 		{
 			if (p->getRightChild() == nullptr)
 			{
-				Node* newChild = new Node();
+				Node* newChild = newNode();
 				newChild->setNode(s, p, nullptr, nullptr, nullptr, nullptr);
 				p->setRightChild(newChild);
 				newChild->setPredecessor(findInorderPredecessorOf(newChild));
@@ -874,18 +1173,12 @@ private:
 		else
 		{ // If matching LineSegment is found.
 
-			// Node with no child.
-			if (p->getLeftChild() == nullptr && p->getRightChild() == nullptr)
-			{
-				return nullptr;
-			}
-			else if (p->getLeftChild() == nullptr) // Node with only a right child.
-			{
-				return p->getRightChild();
-			}
-			else if (p->getRightChild() == nullptr) // Node with only a left child.
+			// Node with at most one child, which takes its place.
+			if (p->getLeftChild() == nullptr || p->getRightChild() == nullptr)
 			{
-				return p->getLeftChild();
+				Node* child = p->getLeftChild() != nullptr ? p->getLeftChild() : p->getRightChild();
+				deleteNode(p);
+				return child;
 			}
 			else // If node has both children, copy inorder successor contents to it, and remove successor.
 			{
@@ -939,16 +1232,23 @@ private:
 	}
 public:
 	BinarySearchTree(){
-		root = new Node(); // Dummy node as the root
+		root = newNode(); // Dummy node as the root
 		root->setLeftChild(nullptr);
 		root->setRightChild(nullptr);
 		root->setSegment(nullptr);
 	}
 
+	~BinarySearchTree() {
+		destroy(root);
+	}
+
+	BinarySearchTree(const BinarySearchTree&) = delete;
+	BinarySearchTree& operator=(const BinarySearchTree&) = delete;
+
 	Node* add(LineSegment* s, Point eventPoint){
 		if (root->getLeftChild() == nullptr)
 		{
-			Node* first = new Node();
+			Node* first = newNode();
 			(*first).setNode(s, nullptr, nullptr, nullptr, nullptr, nullptr);
 			root->setLeftChild(first);
 
@@ -967,6 +1267,57 @@ public:
 		return findNode(s, eventPoint, root->getLeftChild());
 	}
 
+	/*
+	 * Finds the node holding segment s, or nullptr if s is not in the tree. Where several segments pass through the
+	 * event point the comparisons tie or disagree with the order the swaps left behind, and the descent can miss the
+	 * node; it then stops at the last node on its path and the neighbours are walked outward in sweep order from
+	 * there. Segments meeting at a point are adjacent in the status, so the walk only covers those that meet s.
+	 */
+	Node* locateNode(LineSegment* s, Point eventPoint)
+	{
+		Node* p = root->getLeftChild();
+		Node* last = nullptr;
+
+		while (p != nullptr)
+		{
+			if (p->getSegment() == s)
+			{
+				return p;
+			}
+
+			last = p;
+			p = s->compareTo(p->getSegment(), eventPoint) == -1 ? p->getLeftChild() : p->getRightChild();
+		}
+
+		Node* down = last;
+		Node* up = last != nullptr ? last->getSuccessor() : nullptr;
+
+		while (down != nullptr || up != nullptr)
+		{
+			if (down != nullptr)
+			{
+				if (down->getSegment() == s)
+				{
+					return down;
+				}
+
+				down = down->getPredecessor();
+			}
+
+			if (up != nullptr)
+			{
+				if (up->getSegment() == s)
+				{
+					return up;
+				}
+
+				up = up->getSuccessor();
+			}
+		}
+
+		return nullptr;
+	}
+
 	int getCount(){
 		return getCount(root->getLeftChild());
 	}
@@ -1024,6 +1375,42 @@ public:
 			}
 		}
 	}
+	/*
+	 * Removes a node found by locateNode. Unlike remove, it does not search for the segment again, so it cannot miss
+	 * it at a point where the comparisons tie. A node with two children takes the segment of its successor in sweep
+	 * order, and the successor's node is the one unlinked.
+	 */
+	void removeNode(Node* p)
+	{
+		if (p->getLeftChild() != nullptr && p->getRightChild() != nullptr)
+		{
+			Node* successor = p->getSuccessor();
+
+			p->setSegment(successor->getSegment());
+			p->setSuccessor(successor->getSuccessor());
+
+			if (p->getSuccessor() != nullptr)
+			{
+				p->getSuccessor()->setPredecessor(p);
+			}
+
+			unlinkNode(successor);
+		}
+		else
+		{
+			if (p->getPredecessor() != nullptr)
+			{
+				p->getPredecessor()->setSuccessor(p->getSuccessor());
+			}
+
+			if (p->getSuccessor() != nullptr)
+			{
+				p->getSuccessor()->setPredecessor(p->getPredecessor());
+			}
+
+			unlinkNode(p);
+		}
+	}
 	void swapNodeInfo(Node* p, Node* q)
 	{
 		LineSegment* temp = p->getSegment();
@@ -1036,6 +1423,16 @@ public:
 	}
 };
 
+// Checks if event point a comes before event point b in sweep order: left to right, then bottom to top.
+inline bool precedes(Point a, Point b) {
+	if (fabs(a.getX() - b.getX()) < POINT_EPSILON)
+	{
+		return a.getY() < b.getY();
+	}
+
+	return a.getX() < b.getX();
+}
+
 class EventQueue{
 	/**
 	 * Heapifies a subtree rooted with node index i, producing a min heap through Floyd's method which utilizes the
@@ -1048,23 +1445,23 @@ class EventQueue{
 	 * @param i      The root index of the subtree.
 	 */
 private:
-	static void heapify(vector<Event*>& events, int size, int i){
+	static void heapify(vector<Event>& events, int size, int i){
 		// By minimum we refer to the event points that have a smaller x, and thus should be higher on the binary heap.
 		int minimum = i; // Initialize minimum as root of subtree.
 		int left = 2 * i; // left child = 2*i
 		int right = 2 * i + 1; // right child = 2*i + 1
 
-		double minX = events[minimum]->getEventPoint().getX();
+		double minX = events[minimum].getEventPoint().getX();
 
 		if (left <= size)
 		{
-			double leftX = events[left]->getEventPoint().getX();
+			double leftX = events[left].getEventPoint().getX();
 
 			// If the two event points have the same x, then the minimum will be the point with the minimum y.
 			if (fabs(leftX - minX) < POINT_EPSILON)
 			{
-				double minY = events[minimum]->getEventPoint().getY();
-				double leftY = events[left]->getEventPoint().getY();
+				double minY = events[minimum].getEventPoint().getY();
+				double leftY = events[left].getEventPoint().getY();
 
 				if (leftY < minY)
 				{
@@ -1081,13 +1478,13 @@ private:
 
 		if (right <= size)
 		{
-			double rightX = events[right]->getEventPoint().getX();
+			double rightX = events[right].getEventPoint().getX();
 
 			// If the two event points have the same x, then the minimum will be the point with the minimum y.
 			if (fabs(rightX - minX) < POINT_EPSILON)
 			{
-				double minY = events[minimum]->getEventPoint().getY();
-				double rightY = events[right]->getEventPoint().getY();
+				double minY = events[minimum].getEventPoint().getY();
+				double rightY = events[right].getEventPoint().getY();
 
 				if (rightY < minY)
 				{
@@ -1120,24 +1517,27 @@ private:
 	 * @param x      the index of the first element to be swapped.
 	 * @param y      the index of the second element to be swapped.
 	 */
-	static void swap(vector<Event*>& events, int x, int y)
+	static void swap(vector<Event>& events, int x, int y)
 	{
-		Event* swap = events[x];
+		Event swap = events[x];
 		events[x] = events[y];
 		events[y] = swap;
 	}
 
-	vector<Event*> events;
+	vector<Event> events;
 
 	int arraySize; // size of the array
 	int length; // current number of elements in the array
+	int peakLength; // largest number of elements the array has held at once
 
 public:
-	EventQueue(vector<Event*> events){
+	EventQueue(vector<Event>& events){
 		length = events.size();
 		arraySize = length + 1;
+		peakLength = length;
 
-		this->events = vector<Event*>(arraySize);
+		this->events = vector<Event>(arraySize);
+		sweepMemory.allocate(MemoryCategory::QUEUE, (size_t)arraySize * sizeof(Event), length);
 		for (int i = 1; i < arraySize; i++)
 			this->events[i] = events[i - 1];
 
@@ -1152,26 +1552,47 @@ public:
 
 	EventQueue(int arraySize){
 		length = 0;
+		peakLength = 0;
 		this->arraySize = arraySize;
 
-		events = vector<Event*>(this->arraySize, new Event());
+		events = vector<Event>(this->arraySize);
+		sweepMemory.allocate(MemoryCategory::QUEUE, (size_t)arraySize * sizeof(Event), 0);
+	}
+
+	~EventQueue() {
+		sweepMemory.release(MemoryCategory::QUEUE, (size_t)arraySize * sizeof(Event), 0);
 	}
 
-	void add(Event* e){
+	EventQueue(const EventQueue&) = delete;
+	EventQueue& operator=(const EventQueue&) = delete;
+
+	void add(Event e){
+		if (length + 1 >= arraySize)
+		{
+			sweepMemory.release(MemoryCategory::QUEUE, (size_t)arraySize * sizeof(Event), 0);
+			arraySize = 2 * arraySize + 2;
+			events.resize(arraySize);
+			sweepMemory.allocate(MemoryCategory::QUEUE, (size_t)arraySize * sizeof(Event), 0);
+		}
+
 		int loc = ++length;
+		if (length > peakLength)
+		{
+			peakLength = length;
+		}
 
 		events[0] = e;
-		double eventX = e->getEventPoint().getX();
-		while (eventX < events[loc / 2]->getEventPoint().getX())
+		double eventX = e.getEventPoint().getX();
+		while (eventX < events[loc / 2].getEventPoint().getX())
 		{
 			events[loc] = events[loc / 2];
 			loc /= 2;
 		}
 
 		// If the two event points have the same x, then bubble up the point with the minimum y.
-		double eventY = e->getEventPoint().getY();
-		while (fabs(eventX - events[loc / 2]->getEventPoint().getX()) < POINT_EPSILON
-			&& eventY < events[loc / 2]->getEventPoint().getY())
+		double eventY = e.getEventPoint().getY();
+		while (fabs(eventX - events[loc / 2].getEventPoint().getX()) < POINT_EPSILON
+			&& eventY < events[loc / 2].getEventPoint().getY())
 		{
 			events[loc] = events[loc / 2];
 			loc /= 2;
@@ -1181,19 +1602,14 @@ public:
 	}
 
 	void deleteEventPoint(Point eventPoint){
-		events[0] = nullptr;
 		for (int i = 1; i <= length; i++)
 		{
-			if (events[i]->getEventPoint().equals(eventPoint))
+			if (events[i].getEventPoint().equals(eventPoint))
 			{
 				for (int j = i; j <= length - 1; j++)
 				{
 					events[j] = events[j + 1];
 				}
-				for (int j = length; j < arraySize; j++)
-				{
-					events[j] = nullptr;
-				}
 
 				length--;
 
@@ -1213,14 +1629,14 @@ public:
 		return (length == 0) ? true : false;
 	}
 
-	Event* min(){
+	Event& min(){
 		return events[1];
 	}
 
-	Event* removeMin()
+	Event removeMin()
 	{
-		Event* min = events[1];
-		Event* lastEvent = events[length];
+		Event min = events[1];
+		Event lastEvent = events[length];
 		length--;
 
 		int parent = 1;
@@ -1228,23 +1644,27 @@ public:
 		{
 			int child = parent * 2;
 
-			double rightChildX = events[child + 1]->getEventPoint().getX();
-			double leftChildX = events[child]->getEventPoint().getX();
-			double rightChildY = events[child + 1]->getEventPoint().getY();
-			double leftChildY = events[child]->getEventPoint().getY();
-
-			if (child != length && (rightChildX < leftChildX
-				|| (fabs(rightChildX - leftChildX) < POINT_EPSILON && rightChildY < leftChildY)))
+			// Slots past the end of the heap may hold stale entries, so only look at the right child if it exists.
+			if (child != length)
 			{
-				child++;
+				double rightChildX = events[child + 1].getEventPoint().getX();
+				double leftChildX = events[child].getEventPoint().getX();
+				double rightChildY = events[child + 1].getEventPoint().getY();
+				double leftChildY = events[child].getEventPoint().getY();
+
+				if (rightChildX < leftChildX
+					|| (fabs(rightChildX - leftChildX) < POINT_EPSILON && rightChildY < leftChildY))
+				{
+					child++;
+				}
 			}
 
-			double childX = events[child]->getEventPoint().getX();
-			double childY = events[child]->getEventPoint().getY();
+			double childX = events[child].getEventPoint().getX();
+			double childY = events[child].getEventPoint().getY();
 
-			if (childX < lastEvent->getEventPoint().getX()
-				|| (fabs(childX - lastEvent->getEventPoint().getX()) < POINT_EPSILON
-					&& childY < lastEvent->getEventPoint().getY()))
+			if (childX < lastEvent.getEventPoint().getX()
+				|| (fabs(childX - lastEvent.getEventPoint().getX()) < POINT_EPSILON
+					&& childY < lastEvent.getEventPoint().getY()))
 			{
 				events[parent] = events[child];
 			}
@@ -1260,4 +1680,68 @@ public:
 
 		return min;
 	}
-};
\ No newline at end of file
+
+	int getLength() {
+		return length;
+	}
+
+	// Bytes taken by the largest number of events held at once.
+	size_t getPeakBytes() {
+		return (size_t)(peakLength + 1) * sizeof(Event);
+	}
+};
+
+/*
+ * The endpoint events of all segments, sorted once in sweep order and then consumed through a cursor. Since endpoint
+ * events are all known before the sweep starts, only intersection events, which are discovered during the sweep, need
+ * to go through an EventQueue.
+ */
+class EndpointStream {
+private:
+	vector<Event> events;
+	size_t cursor;
+
+public:
+	EndpointStream(vector<Event>& unsorted) {
+		vector<RadixRecord> records(unsorted.size());
+		sweepMemory.allocate(MemoryCategory::EVENTS, records.size() * sizeof(RadixRecord), 0);
+
+		for (size_t i = 0; i < unsorted.size(); i++)
+		{
+			records[i].primary = sortableBits(unsorted[i].getEventPoint().getX());
+			records[i].secondary = sortableBits(unsorted[i].getEventPoint().getY());
+			records[i].index = (uint32_t)i;
+		}
+
+		parallelRadixSort(records);
+
+		events = vector<Event>(records.size());
+		sweepMemory.allocate(MemoryCategory::EVENTS, events.size() * sizeof(Event), (long long)events.size());
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			events[i] = unsorted[records[i].index];
+		}
+
+		sweepMemory.release(MemoryCategory::EVENTS, records.size() * sizeof(RadixRecord), 0);
+		cursor = 0;
+	}
+
+	~EndpointStream() {
+		sweepMemory.release(MemoryCategory::EVENTS, events.size() * sizeof(Event), (long long)events.size());
+	}
+
+	EndpointStream(const EndpointStream&) = delete;
+	EndpointStream& operator=(const EndpointStream&) = delete;
+
+	bool isEmpty() {
+		return cursor == events.size();
+	}
+
+	Event& peek() {
+		return events[cursor];
+	}
+
+	Event next() {
+		return events[cursor++];
+	}
+};
@@ -0,0 +1,94 @@
+// SweepApi.cpp : The C interface of SweepApi.h, on top of SweepEngine.
+//
+
+#include <new>
+#include "SweepApi.h"
+#include "SweepEngine.h"
+
+struct bo_engine {
+	SweepEngine<double, DefaultTolerance, CallbackSink> engine;
+};
+
+namespace {
+	// Where a call wants its intersections: the caller's buffer, the caller's callback, or nowhere.
+	struct Output {
+		int64_t count;
+		bo_intersection* buffer;
+		size_t capacity;
+		bo_callback callback;
+		void* context;
+	};
+
+	void report(double x, double y, uint32_t lowerId, uint32_t upperId, void* context) {
+		Output* output = (Output*)context;
+
+		if ((uint64_t)output->count < output->capacity)
+		{
+			output->buffer[output->count] = { x, y, lowerId, upperId };
+		}
+		if (output->callback != nullptr)
+		{
+			output->callback(x, y, lowerId, upperId, output->context);
+		}
+
+		output->count++;
+	}
+
+	int64_t run(bo_engine* engine, const double* coordinates, size_t count, size_t stride, Output& output) {
+		if (engine == nullptr || (coordinates == nullptr && count > 0) || stride < 4 * sizeof(double)
+			|| count > (size_t)UINT32_MAX || (output.buffer == nullptr && output.capacity > 0))
+		{
+			return BO_ERROR_INVALID_ARGUMENT;
+		}
+
+		try
+		{
+			engine->engine.getSink().callback = report;
+			engine->engine.getSink().context = &output;
+			engine->engine.run(SegmentView<double>(coordinates, count, stride));
+			return output.count;
+		}
+		catch (const bad_alloc&)
+		{
+			return BO_ERROR_OUT_OF_MEMORY;
+		}
+		catch (...)
+		{
+			return BO_ERROR_INTERNAL;
+		}
+	}
+}
+
+int bo_version(void) {
+	return BO_API_VERSION;
+}
+
+bo_engine* bo_create(void) {
+	return new (nothrow) bo_engine();
+}
+
+void bo_destroy(bo_engine* engine) {
+	delete engine;
+}
+
+int64_t bo_count(bo_engine* engine, const double* coordinates, size_t count, size_t stride) {
+	Output output = { 0, nullptr, 0, nullptr, nullptr };
+	return run(engine, coordinates, count, stride, output);
+}
+
+int64_t bo_intersect(bo_engine* engine, const double* coordinates, size_t count, size_t stride,
+	bo_intersection* out, size_t capacity) {
+	Output output = { 0, out, capacity, nullptr, nullptr };
+	return run(engine, coordinates, count, stride, output);
+}
+
+int64_t bo_intersect_each(bo_engine* engine, const double* coordinates, size_t count, size_t stride,
+	bo_callback callback, void* context) {
+	if (callback == nullptr)
+	{
+		return BO_ERROR_INVALID_ARGUMENT;
+	}
+
+	Output output = { 0, nullptr, 0, callback, context };
+	return run(engine, coordinates, count, stride, output);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface to the sweep, for use in process from other languages through their foreign function interfaces.
+ *
+ * Segments are read in place from the caller's memory: segment i is the four doubles x1, y1, x2, y2 starting at
+ * byte i * stride of coordinates, so flat arrays (stride 32) and arrays of larger records both work without a copy.
+ * Intersections are proper crossings only, as everywhere else in this program, and are reported in sweep order with
+ * the indices of the two segments.
+ *
+ * An engine keeps its buffers between calls, so running it again on inputs of similar size does not allocate. An
+ * engine must not be used by two threads at once; separate engines are independent. No C++ exception crosses this
+ * interface: failures are returned as negative status codes.
+ *
+ * Build with BO_SHARED defined to export the functions from a shared library, and also BO_EXPORTS when building it.
+ * The sweep_api project of the solution builds the library as a DLL that way, and sweep_api_example is a C program
+ * calling it with records of its own and a buffer smaller than the result.
+ */
+
+#if defined(BO_SHARED) && defined(_WIN32)
+#ifdef BO_EXPORTS
+#define BO_API __declspec(dllexport)
+#else
+#define BO_API __declspec(dllimport)
+#endif
+#elif defined(BO_SHARED) && defined(__GNUC__)
+#define BO_API __attribute__((visibility("default")))
+#else
+#define BO_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BO_API_VERSION 1
+
+// Status codes, returned in place of a count.
+#define BO_ERROR_INVALID_ARGUMENT -1
+#define BO_ERROR_OUT_OF_MEMORY -2
+#define BO_ERROR_INTERNAL -3
+
+typedef struct bo_engine bo_engine;
+
+typedef struct bo_intersection {
+	double x;
+	double y;
+	uint32_t lower; // index of the segment below the other just left of the crossing
+	uint32_t upper;
+} bo_intersection;
+
+typedef void (*bo_callback)(double x, double y, uint32_t lower, uint32_t upper, void* context);
+
+// BO_API_VERSION of the library, to check against the header a caller was built with.
+BO_API int bo_version(void);
+
+// Creates an engine, or returns NULL if out of memory.
+BO_API bo_engine* bo_create(void);
+
+BO_API void bo_destroy(bo_engine* engine);
+
+// Counts the intersections of count segments.
+BO_API int64_t bo_count(bo_engine* engine, const double* coordinates, size_t count, size_t stride);
+
+/*
+ * Finds the intersections of count segments, writing the first capacity of them to out. Returns the total number of
+ * intersections, which may exceed capacity; the call can then be repeated with a buffer of that size.
+ */
+BO_API int64_t bo_intersect(bo_engine* engine, const double* coordinates, size_t count, size_t stride,
+	bo_intersection* out, size_t capacity);
+
+// Finds the intersections of count segments, calling callback with context for each. Returns their number.
+BO_API int64_t bo_intersect_each(bo_engine* engine, const double* coordinates, size_t count, size_t stride,
+	bo_callback callback, void* context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,428 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SweepEngine.h"
+#include "InversionSweep.h"
+#include "OrthogonalSweep.h"
+
+/*
+ * What the dispatcher predicts about an input before sweeping it, from one pass over the segments and a random sample
+ * of segment pairs:
+ *  - the number of intersections, as the fraction of sampled pairs crossing times the number of pairs, with its
+ *    standard error. Sampling n pairs sees a few crossings once there are a few per segment, below which SweepEngine
+ *    wins whatever the exact number,
+ *  - the status size profile: the mean number of segments crossing each of the bins the x extent is cut into, taken
+ *    from the exact length of each segment inside each bin, along with the endpoints and sampled crossings of the bin,
+ *  - the fraction of horizontal and vertical segments.
+ */
+struct SweepEstimate {
+	size_t segments = 0;
+	double minX = 0.0;
+	double maxX = 0.0;
+	double crossings = 0.0;
+	double crossingsError = 0.0;
+	long long sampledPairs = 0;
+	double orthogonalFraction = 0.0;
+	double meanStatus = 0.0;
+	double peakStatus = 0.0;
+	vector<double> status; // segments crossing each bin, on average over its width
+	vector<double> endpoints; // of each bin
+	vector<double> binCrossings; // estimated intersections in each bin
+	double ms = 0.0;
+
+	double binWidth() const {
+		return (maxX - minX) / status.size();
+	}
+};
+
+inline SweepEstimate estimateSweep(const SegmentView<double>& input, size_t binCount = 64, unsigned seed = 1) {
+	auto start = chrono::high_resolution_clock::now();
+	SweepEstimate estimate;
+	size_t n = input.size();
+	estimate.segments = n;
+	estimate.status.assign(binCount, 0.0);
+	estimate.endpoints.assign(binCount, 0.0);
+	estimate.binCrossings.assign(binCount, 0.0);
+	if (n == 0)
+	{
+		return estimate;
+	}
+
+	estimate.minX = HUGE_VAL;
+	estimate.maxX = -HUGE_VAL;
+	for (size_t i = 0; i < n; i++)
+	{
+		const double* c = input[i];
+		estimate.minX = min(estimate.minX, min(c[0], c[2]));
+		estimate.maxX = max(estimate.maxX, max(c[0], c[2]));
+	}
+	if (estimate.maxX == estimate.minX)
+	{
+		estimate.maxX = estimate.minX + 1.0;
+	}
+
+	// Bins fully crossed by a segment are counted through a difference array, the two partly crossed ones directly.
+	double binWidth = estimate.binWidth();
+	vector<double> spanning(binCount + 1, 0.0);
+	long long orthogonal = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const double* c = input[i];
+		double left = (min(c[0], c[2]) - estimate.minX) / binWidth;
+		double right = (max(c[0], c[2]) - estimate.minX) / binWidth;
+		size_t first = min(binCount - 1, (size_t)left);
+		size_t last = min(binCount - 1, (size_t)right);
+
+		estimate.endpoints[first]++;
+		estimate.endpoints[last]++;
+		if (first == last)
+		{
+			estimate.status[first] += right - left;
+		}
+		else
+		{
+			estimate.status[first] += first + 1 - left;
+			estimate.status[last] += right - last;
+			spanning[first + 1]++;
+			spanning[last]--;
+		}
+
+		if (c[0] == c[2] || c[1] == c[3])
+		{
+			orthogonal++;
+		}
+	}
+
+	double spans = 0.0;
+	for (size_t b = 0; b < binCount; b++)
+	{
+		spans += spanning[b];
+		estimate.status[b] += spans;
+		estimate.meanStatus += estimate.status[b] / binCount;
+		estimate.peakStatus = max(estimate.peakStatus, estimate.status[b]);
+	}
+	estimate.orthogonalFraction = (double)orthogonal / n;
+
+	// Uniform pairs of distinct segments, the crossings found spread over the bins they fall in.
+	double pairs = (double)n * (n - 1) / 2;
+	long long samples = n < 2 ? 0 : (long long)min((double)(1 << 22), max(4096.0, (double)n));
+	long long hits = 0;
+	mt19937_64 generator(seed);
+	uniform_int_distribution<size_t> pick(0, n - 1);
+
+	for (long long s = 0; s < samples; s++)
+	{
+		size_t i = pick(generator), j = pick(generator);
+		if (i == j)
+		{
+			continue;
+		}
+
+		const double* a = input[i];
+		const double* b = input[j];
+		double x, y;
+		if (SweepGeometry<double, DefaultTolerance>::crossing(a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3], x, y))
+		{
+			hits++;
+			estimate.binCrossings[min(binCount - 1, (size_t)max(0.0, (x - estimate.minX) / binWidth))]++;
+		}
+	}
+
+	if (samples > 0)
+	{
+		double p = (double)hits / samples;
+		estimate.crossings = p * pairs;
+		estimate.crossingsError = sqrt(p * (1 - p) / samples) * pairs;
+		for (double& crossings : estimate.binCrossings)
+		{
+			crossings *= pairs / samples;
+		}
+	}
+	estimate.sampledPairs = samples;
+
+	auto elapsed = chrono::high_resolution_clock::now() - start;
+	estimate.ms = (double)chrono::duration_cast<chrono::microseconds>(elapsed).count() / 1e3;
+	return estimate;
+}
+
+enum class SweepChoice { SWEEP, SLABS, INVERSIONS, ORTHOGONAL };
+
+inline const char* sweepChoiceName(SweepChoice choice) {
+	static const char* names[4] = { "sweep", "slabs", "inversions", "orthogonal" };
+	return names[(int)choice];
+}
+
+struct SweepDecision {
+	SweepChoice engine = SweepChoice::SWEEP;
+	size_t slabs = 1;
+	vector<double> boundaries; // x between consecutive slabs
+	double sweepMs = 0.0; // predicted for each engine
+	double slabsMs = 0.0;
+	double inversionsMs = 0.0;
+};
+
+/*
+ * Picks the engine for an input from its SweepEstimate, with a cost model fitted to "--bench dispatch" runs:
+ * SweepEngine pays a constant and a logarithm of the status size per endpoint and a logarithm of the status size per
+ * crossing, while InversionSweep pays a constant per endpoint and squared logarithm of the segment count and a
+ * smaller constant per crossing. Parallel slabs of SweepEngine::runRange split the sweep work evenly along x, each
+ * slab also paying a pass over the input and the sort of the segments stabbing its left edge; the slab count is the
+ * one with the lowest predicted wall-clock time on the cores available. Inputs made only of horizontal and vertical
+ * segments always go to OrthogonalSweep, which needs no intersection events and so is the fastest there; every engine
+ * finds the same crossings, which "--bench orthogonal" checks.
+ */
+class SweepCostModel {
+private:
+	static constexpr double ENDPOINT_NS = 48.0; // per endpoint of SweepEngine, sorting included
+	static constexpr double STATUS_NS = 48.0; // per endpoint and bit of the status size
+	static constexpr double CROSSING_NS = 45.0; // per crossing and bit of the status size
+	static constexpr double STRIP_ENDPOINT_NS = 3.5; // per endpoint of InversionSweep and squared bit of the segments
+	static constexpr double SWAP_NS = 35.0; // per crossing of InversionSweep
+	static constexpr double SCAN_NS = 3.0; // per segment and slab
+	static constexpr double SORT_NS = 3.0; // per segment stabbing a slab and bit of their number
+	static constexpr double THREAD_NS = 50000.0;
+
+	// Predicted sweep time of each bin, in nanoseconds.
+	static vector<double> binCosts(const SweepEstimate& estimate) {
+		vector<double> costs(estimate.status.size());
+		for (size_t b = 0; b < costs.size(); b++)
+		{
+			double statusBits = log2(estimate.status[b] + 2);
+			costs[b] = estimate.endpoints[b] * (ENDPOINT_NS + STATUS_NS * statusBits)
+				+ estimate.binCrossings[b] * CROSSING_NS * statusBits;
+		}
+		return costs;
+	}
+
+	// Cuts the bins into slabs of even cost, returning the wall-clock time of the slowest and the cut positions.
+	static double slabCost(const SweepEstimate& estimate, const vector<double>& costs, size_t slabs,
+		vector<double>& boundaries) {
+		double total = 0.0;
+		for (double cost : costs)
+		{
+			total += cost;
+		}
+
+		boundaries.clear();
+		double slowest = 0.0, slab = 0.0, done = 0.0;
+		double stabbing = 0.0; // segments stabbing the left edge of the current slab
+		for (size_t b = 0; b < costs.size(); b++)
+		{
+			slab += costs[b];
+			done += costs[b];
+			bool cut = b + 1 < costs.size() && boundaries.size() + 1 < slabs
+				&& done >= total * (boundaries.size() + 1) / slabs;
+
+			if (cut || b + 1 == costs.size())
+			{
+				slowest = max(slowest, slab + estimate.segments * SCAN_NS + stabbing * log2(stabbing + 2) * SORT_NS);
+				slab = 0.0;
+			}
+			if (cut)
+			{
+				boundaries.push_back(estimate.minX + (b + 1) * estimate.binWidth());
+				stabbing = estimate.status[b];
+			}
+		}
+
+		return slowest + THREAD_NS * slabs;
+	}
+
+public:
+	static SweepDecision decide(const SweepEstimate& estimate, size_t cores) {
+		SweepDecision decision;
+		vector<double> costs = binCosts(estimate);
+		double sweepNs = 0.0;
+		for (double cost : costs)
+		{
+			sweepNs += cost;
+		}
+
+		decision.sweepMs = sweepNs / 1e6;
+		double segmentBits = log2(estimate.segments + 2);
+		decision.inversionsMs = (2.0 * estimate.segments * STRIP_ENDPOINT_NS * segmentBits * segmentBits
+			+ estimate.crossings * SWAP_NS) / 1e6;
+		decision.slabsMs = decision.sweepMs;
+
+		vector<double> boundaries;
+		for (size_t slabs = 2; slabs <= max((size_t)1, cores); slabs++)
+		{
+			double ms = slabCost(estimate, costs, slabs, boundaries) / 1e6;
+			if (ms < decision.slabsMs && boundaries.size() + 1 == slabs)
+			{
+				decision.slabsMs = ms;
+				decision.slabs = slabs;
+				decision.boundaries = boundaries;
+			}
+		}
+
+		if (estimate.segments > 0 && estimate.orthogonalFraction == 1.0)
+		{
+			decision.engine = SweepChoice::ORTHOGONAL;
+			decision.slabs = 1;
+			decision.boundaries.clear();
+		}
+		else if (decision.inversionsMs < min(decision.sweepMs, decision.slabsMs))
+		{
+			decision.engine = SweepChoice::INVERSIONS;
+			decision.slabs = 1;
+			decision.boundaries.clear();
+		}
+		else if (decision.slabs > 1)
+		{
+			decision.engine = SweepChoice::SLABS;
+		}
+
+		return decision;
+	}
+};
+
+// Collects the intersections left of end, so that a crossing on the edge between two slabs is kept by one of them.
+struct DispatchSink {
+	vector<SweepPoint<double>> points;
+	long long count = 0;
+	double end = HUGE_VAL;
+	bool collect = true;
+
+	template <typename Real>
+	void report(Real x, Real y, uint32_t /*lowerId*/, uint32_t /*upperId*/) {
+		if ((double)x >= end)
+		{
+			return;
+		}
+
+		count++;
+		if (collect)
+		{
+			points.push_back({ (double)x, (double)y });
+		}
+	}
+};
+
+/*
+ * Runs the engine a SweepCostModel predicts to be fastest on an input, estimating it first. Intersections are kept
+ * in sweep order, slab after slab, unless only their number is wanted. The estimate, the decision and the time of
+ * each step are reported by getMetricsJson.
+ */
+class SweepDispatcher {
+private:
+	bool collect;
+	size_t cores;
+	SweepEstimate estimate;
+	SweepDecision decision;
+	vector<SweepPoint<double>> points;
+	long long count;
+	double runMs;
+
+public:
+	SweepDispatcher(bool collect = true, size_t cores = thread::hardware_concurrency()) {
+		this->collect = collect;
+		this->cores = max((size_t)1, cores);
+		this->count = 0;
+		this->runMs = 0.0;
+	}
+
+	void run(const SegmentView<double>& input) {
+		estimate = estimateSweep(input);
+		decision = SweepCostModel::decide(estimate, cores);
+		points.clear();
+		count = 0;
+
+		auto start = chrono::high_resolution_clock::now();
+		DispatchSink sink;
+		sink.collect = collect;
+
+		if (decision.engine == SweepChoice::ORTHOGONAL)
+		{
+			OrthogonalSweep<DispatchSink> engine(sink);
+			engine.run(input);
+			points = move(engine.getSink().points);
+			count = engine.getSink().count;
+		}
+		else if (decision.engine == SweepChoice::INVERSIONS)
+		{
+			InversionSweep<DispatchSink> engine(sink);
+			engine.run(input);
+			points = move(engine.getSink().points);
+			count = engine.getSink().count;
+		}
+		else if (decision.engine == SweepChoice::SWEEP)
+		{
+			SweepEngine<double, DefaultTolerance, DispatchSink> engine(sink);
+			engine.run(input);
+			points = move(engine.getSink().points);
+			count = engine.getSink().count;
+		}
+		else
+		{
+			size_t slabs = decision.slabs;
+			vector<SweepEngine<double, DefaultTolerance, DispatchSink>> engines(slabs);
+			vector<thread> threads;
+			for (size_t i = 0; i < slabs; i++)
+			{
+				double x0 = i == 0 ? estimate.minX : decision.boundaries[i - 1];
+				double x1 = i + 1 == slabs ? estimate.maxX : decision.boundaries[i];
+				engines[i].getSink().collect = collect;
+				engines[i].getSink().end = i + 1 == slabs ? HUGE_VAL : x1;
+				threads.push_back(thread([&input, &engines, i, x0, x1] { engines[i].runRange(input, x0, x1); }));
+			}
+
+			for (size_t i = 0; i < slabs; i++)
+			{
+				threads[i].join();
+				DispatchSink& slab = engines[i].getSink();
+				points.insert(points.end(), slab.points.begin(), slab.points.end());
+				count += slab.count;
+			}
+		}
+
+		runMs = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() / 1e6;
+	}
+
+	long long getCount() {
+		return count;
+	}
+
+	vector<SweepPoint<double>>& getPoints() {
+		return points;
+	}
+
+	SweepEstimate& getEstimate() {
+		return estimate;
+	}
+
+	SweepDecision& getDecision() {
+		return decision;
+	}
+
+	// Time of the chosen engine in the last run, without the estimate.
+	double getRunMs() {
+		return runMs;
+	}
+
+	// The estimate, the decision with the predicted time of each engine, and the outcome, as a JSON object.
+	string getMetricsJson() {
+		ostringstream json;
+		json << "{\"segments\": " << estimate.segments << ", \"estimated_crossings\": " << estimate.crossings
+			<< ", \"crossings_error\": " << estimate.crossingsError << ", \"sampled_pairs\": " << estimate.sampledPairs
+			<< ", \"orthogonal_fraction\": " << estimate.orthogonalFraction << ", \"mean_status\": "
+			<< estimate.meanStatus << ", \"peak_status\": " << estimate.peakStatus << ", \"status_profile\": [";
+		for (size_t b = 0; b < estimate.status.size(); b++)
+		{
+			json << (b > 0 ? ", " : "") << round(estimate.status[b]);
+		}
+
+		json << "], \"estimate_ms\": " << estimate.ms << ", \"engine\": \"" << sweepChoiceName(decision.engine)
+			<< "\", \"slabs\": " << decision.slabs << ", \"cores\": " << cores << ", \"predicted_ms\": {\"sweep\": "
+			<< decision.sweepMs << ", \"slabs\": " << decision.slabsMs << ", \"inversions\": " << decision.inversionsMs
+			<< "}, \"crossings\": " << count << ", \"run_ms\": " << runMs << "}";
+		return json.str();
+	}
+};
@@ -0,0 +1,14 @@
+// SweepEngine.cpp : Compiles the combinations of SweepEngine policies used by this program.
+//
+
+#include "SweepEngine.h"
+
+template class SweepEngine<float, ExactTolerance, CountSink>;
+template class SweepEngine<double, ExactTolerance, CountSink>;
+template class SweepEngine<double, DefaultTolerance, CountSink>;
+template class SweepEngine<double, DefaultTolerance, CollectSink<double>>;
+template class SweepEngine<double, DefaultTolerance, PairSink>;
+template class SweepEngine<double, DefaultTolerance, CallbackSink>;
+template class SweepEngine<int64_t, ExactTolerance, CountSink>;
+template class SweepEngine<int64_t, ExactTolerance, PairSink>;
+template class SweepEngine<long double, DefaultTolerance, CollectSink<long double>>;
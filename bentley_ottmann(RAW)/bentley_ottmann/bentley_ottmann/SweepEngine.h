@@ -0,0 +1,909 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include "Structures.h"
+#include "SweepStatusTree.h"
+#include "IntersectionKernel.h"
+
+/*
+ * Sweep engine specialised at compile time by three policies:
+ *  - the coordinate type of the input: float, double, int64_t or long double,
+ *  - a tolerance policy deciding when an orientation counts as zero: ExactTolerance or an EpsilonTolerance,
+ *  - an output sink receiving each intersection: CountSink, CollectSink, CallbackSink or PairSink.
+ *
+ * Orientation tests and crossing points are computed in the coordinate type, and every sink call is inlined, so a
+ * counting run on floats carries neither the storage nor the branches of a collecting run on doubles. The sweep
+ * status is a SweepStatusTree, which keys segments by double whatever the coordinate type. Intersections are proper
+ * crossings only, as in LineSegment::getIntersectionPointWith: pairs sharing an endpoint, touching or collinear
+ * pairs are not reported.
+ */
+
+/*
+ * The types in which a coordinate type is computed: Product for orientation tests and Real for crossing points.
+ * int64_t coordinates are tested exactly as long as they stay within +-2^30, so that no product overflows.
+ */
+template <typename Coord>
+struct CoordTraits {
+	typedef Coord Product;
+	typedef Coord Real;
+};
+
+template <>
+struct CoordTraits<int64_t> {
+	typedef int64_t Product;
+	typedef double Real;
+};
+
+// Orientations are zero only when they are exactly zero.
+struct ExactTolerance {
+	template <typename T>
+	static bool isZero(T value) {
+		return value == 0;
+	}
+};
+
+// Orientations are zero when their magnitude is below Numerator / Denominator.
+template <long long Numerator, long long Denominator>
+struct EpsilonTolerance {
+	static constexpr double EPSILON = (double)Numerator / Denominator;
+
+	template <typename T>
+	static bool isZero(T value) {
+		return value < EPSILON && value > -EPSILON;
+	}
+};
+
+// The tolerance of LineSegment, POINT_EPSILON.
+typedef EpsilonTolerance<1, 1000000000> DefaultTolerance;
+
+template <typename Real>
+struct SweepPoint {
+	Real x;
+	Real y;
+};
+
+// Counts the intersections.
+struct CountSink {
+	long long count = 0;
+
+	template <typename Real>
+	void report(Real /*x*/, Real /*y*/, uint32_t /*lowerId*/, uint32_t /*upperId*/) {
+		count++;
+	}
+};
+
+// Keeps every intersection point.
+template <typename Real>
+struct CollectSink {
+	vector<SweepPoint<Real>> points;
+
+	void report(Real x, Real y, uint32_t /*lowerId*/, uint32_t /*upperId*/) {
+		points.push_back({ x, y });
+	}
+};
+
+// Keeps the ids of every intersecting pair, the lower segment before the crossing first.
+struct PairSink {
+	vector<pair<uint32_t, uint32_t>> pairs;
+
+	template <typename Real>
+	void report(Real /*x*/, Real /*y*/, uint32_t lowerId, uint32_t upperId) {
+		pairs.push_back(make_pair(lowerId, upperId));
+	}
+};
+
+// Passes every intersection to a function along with a caller supplied context.
+struct CallbackSink {
+	typedef void (*Callback)(double x, double y, uint32_t lowerId, uint32_t upperId, void* context);
+
+	Callback callback = nullptr;
+	void* context = nullptr;
+
+	template <typename Real>
+	void report(Real x, Real y, uint32_t lowerId, uint32_t upperId) {
+		callback((double)x, (double)y, lowerId, upperId, context);
+	}
+};
+
+/*
+ * Read-only view of segments stored as x1, y1, x2, y2 at a fixed stride in bytes, so that arrays of structures from
+ * the caller are read in place. The default stride is that of a tightly packed array of four coordinates.
+ */
+template <typename Coord>
+class SegmentView {
+private:
+	const unsigned char* base;
+	size_t stride;
+	size_t count;
+
+public:
+	SegmentView(const Coord* data, size_t count, size_t stride = 4 * sizeof(Coord)) {
+		this->base = (const unsigned char*)data;
+		this->count = count;
+		this->stride = stride;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	// The four coordinates of segment i.
+	const Coord* operator[](size_t i) const {
+		return (const Coord*)(base + i * stride);
+	}
+};
+
+// Copies the endpoints of line segments as x1, y1, x2, y2 each, the layout a SegmentView reads by default.
+inline vector<double> toCoordinates(const vector<LineSegment*>& segments) {
+	vector<double> coordinates;
+	coordinates.reserve(4 * segments.size());
+	for (LineSegment* segment : segments)
+	{
+		coordinates.push_back(segment->getP1().getX());
+		coordinates.push_back(segment->getP1().getY());
+		coordinates.push_back(segment->getP2().getX());
+		coordinates.push_back(segment->getP2().getY());
+	}
+
+	return coordinates;
+}
+
+/*
+ * Read-only view of polylines and polygon rings, called chains, stored as their vertices one chain after the other:
+ * x and y of each vertex, the index of the first vertex of each chain followed by the total vertex count, and whether
+ * each chain is closed. Consecutive vertices of a chain must differ. Edge i of the input runs from vertex i to the
+ * next vertex of its chain; the last vertex of an open chain starts no edge.
+ */
+template <typename Coord>
+class ChainView {
+private:
+	const Coord* vertices;
+	const uint32_t* starts;
+	const bool* closed;
+	size_t count;
+
+public:
+	ChainView(const Coord* vertices, const uint32_t* starts, const bool* closed, size_t count) {
+		this->vertices = vertices;
+		this->starts = starts;
+		this->closed = closed;
+		this->count = count;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	size_t vertexCount() const {
+		return count > 0 ? starts[count] : 0;
+	}
+
+	// Vertices of chain i, from first to past the last, a ring of fewer than three being taken as open.
+	uint32_t first(size_t i) const {
+		return starts[i];
+	}
+
+	uint32_t end(size_t i) const {
+		return starts[i + 1];
+	}
+
+	bool isClosed(size_t i) const {
+		return closed[i] && starts[i + 1] - starts[i] >= 3;
+	}
+
+	const Coord* vertex(size_t v) const {
+		return vertices + 2 * v;
+	}
+};
+
+// Crossing test shared by the engines, computed in the types of CoordTraits<Coord> with the tolerance policy.
+template <typename Coord, typename Tolerance>
+struct SweepGeometry {
+	typedef typename CoordTraits<Coord>::Product Product;
+	typedef typename CoordTraits<Coord>::Real Real;
+
+	static Product orientation(Coord ax, Coord ay, Coord bx, Coord by, Coord cx, Coord cy) {
+		return (Product)(bx - ax) * (Product)(cy - ay) - (Product)(by - ay) * (Product)(cx - ax);
+	}
+
+	static bool opposite(Product a, Product b) {
+		return (a < 0 && b > 0) || (a > 0 && b < 0);
+	}
+
+	/*
+	 * Tests whether segments a and b cross at a single interior point, and finds the point. Both must straddle the
+	 * line of the other with no orientation counted as zero, which rules out shared endpoints, touching and collinear
+	 * segments.
+	 */
+	static bool crossing(Coord ax1, Coord ay1, Coord ax2, Coord ay2, Coord bx1, Coord by1, Coord bx2, Coord by2,
+		Real& x, Real& y) {
+		Product bStart = orientation(ax1, ay1, ax2, ay2, bx1, by1);
+		Product bEnd = orientation(ax1, ay1, ax2, ay2, bx2, by2);
+		if (Tolerance::isZero(bStart) || Tolerance::isZero(bEnd) || !opposite(bStart, bEnd))
+		{
+			return false;
+		}
+
+		Product aStart = orientation(bx1, by1, bx2, by2, ax1, ay1);
+		Product aEnd = orientation(bx1, by1, bx2, by2, ax2, ay2);
+		if (Tolerance::isZero(aStart) || Tolerance::isZero(aEnd) || !opposite(aStart, aEnd))
+		{
+			return false;
+		}
+
+		Real t = (Real)aStart / ((Real)aStart - (Real)aEnd);
+		x = (Real)ax1 + t * ((Real)ax2 - (Real)ax1);
+		y = (Real)ay1 + t * ((Real)ay2 - (Real)ay1);
+
+		// On a vertical or horizontal segment one coordinate is known exactly. Taking it, and the other from the
+		// other segment's line, keeps the crossings on one such line in order with each other and with its endpoints.
+		if (ax1 == ax2 || bx1 == bx2)
+		{
+			x = ax1 == ax2 ? (Real)ax1 : (Real)bx1;
+			y = ax1 == ax2 ? yOn(bx1, by1, bx2, by2, x) : yOn(ax1, ay1, ax2, ay2, x);
+		}
+		else if (ay1 == ay2 || by1 == by2)
+		{
+			y = ay1 == ay2 ? (Real)ay1 : (Real)by1;
+		}
+		return true;
+	}
+
+	static Real yOn(Coord x1, Coord y1, Coord x2, Coord y2, Real x) {
+		return y1 == y2 ? (Real)y1 : (Real)y1 + (x - (Real)x1) * ((Real)y2 - (Real)y1) / ((Real)x2 - (Real)x1);
+	}
+};
+
+/*
+ * Order in which SweepEngine stores the segments of a run. The sweep reaches segments in order of their left x, so in
+ * input order each status comparison and crossing test on a large input loads a segment from anywhere in the store.
+ * SWEEP renumbers them in the order the sweep first meets them, and HILBERT along a Hilbert curve through their
+ * midpoints. Renumbering takes one pass over the sorted endpoints; ids given to the sink stay those of the input.
+ */
+enum class SegmentOrder { INPUT, SWEEP, HILBERT };
+
+// Position of the cell (x, y) of a 65536 by 65536 grid along the Hilbert curve through it.
+inline uint64_t hilbertIndex(uint32_t x, uint32_t y) {
+	uint64_t index = 0;
+	for (uint32_t half = 1u << 15; half > 0; half >>= 1)
+	{
+		uint32_t rx = (x & half) > 0, ry = (y & half) > 0;
+		index += (uint64_t)half * half * ((3 * rx) ^ ry);
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = half - 1 - (x & (half - 1));
+				y = half - 1 - (y & (half - 1));
+			}
+			swap(x, y);
+		}
+		x &= half - 1;
+		y &= half - 1;
+	}
+	return index;
+}
+
+template <typename Coord, typename Tolerance = DefaultTolerance, typename Sink = CountSink>
+class SweepEngine {
+public:
+	typedef typename CoordTraits<Coord>::Product Product;
+	typedef typename CoordTraits<Coord>::Real Real;
+
+private:
+	// A segment with its endpoints in sweep order.
+	struct Segment {
+		Coord x1, y1, x2, y2;
+
+		// Segments of length 0 cross nothing, and would end before they start, so they never enter the status.
+		bool isPoint() const {
+			return x1 == x2 && y1 == y2;
+		}
+	};
+
+	struct Endpoint {
+		Coord x;
+		Coord y;
+		uint32_t id;
+		uint32_t type; // Type::LEFT or Type::RIGHT
+	};
+
+	struct Crossing {
+		Real x;
+		Real y;
+		uint32_t lowerId;
+		uint32_t upperId;
+	};
+
+	static const uint32_t NO_EDGE = UINT32_MAX;
+
+	Sink sink;
+	vector<Segment> segments;
+	vector<Endpoint> endpoints;
+	vector<uint32_t> chainNext; // of a chain run: vertex ending each edge, or NO_EDGE where no edge starts
+	vector<uint32_t> chainPrevious; // of a chain run: edge ending at each vertex, or NO_EDGE
+	vector<uint32_t> pendingEdges; // of a chain run: edges starting at pendingAt, inserted after the crossings there
+	Endpoint pendingAt;
+	SegmentOrder order;
+	vector<uint32_t> originalId; // input index of each stored segment, empty when stored in input order
+	vector<uint32_t> storedId; // the reverse, while renumbering
+	vector<Segment> renumbered;
+	vector<StatusEntry> stabbing; // segments crossing the start of a range sweep, in order along it
+	SegmentBatch stabbingBatch; // the stabbing segments, in the same order, for the crossing kernel
+	vector<int> pairLower, pairUpper;
+	vector<unsigned char> pairHits;
+	vector<Crossing> crossings; // binary heap, earliest first
+	SweepStatusTree status;
+	size_t peakCrossings;
+	Real rangeEnd; // crossings right of it are not scheduled
+
+	static bool endpointPrecedes(const Endpoint& a, const Endpoint& b) {
+		if (a.x != b.x)
+		{
+			return a.x < b.x;
+		}
+		else if (a.y != b.y)
+		{
+			return a.y < b.y;
+		}
+		else if (a.type != b.type)
+		{
+			return a.type != (uint32_t)Type::LEFT;
+		}
+
+		return a.id < b.id;
+	}
+
+	static bool crossingAfter(const Crossing& a, const Crossing& b) {
+		return a.x != b.x ? a.x > b.x : a.y > b.y;
+	}
+
+	static bool pointPrecedes(Real ax, Real ay, Real bx, Real by) {
+		return ax != bx ? ax < bx : ay < by;
+	}
+
+	/*
+	 * At one point, segments ending there leave first, then the crossings there are processed, then the segments
+	 * starting there enter. The segments crossing at a point are then adjacent when their crossing is processed, and
+	 * already in their order past it when the new segments are placed against them.
+	 */
+	static bool crossingFirst(const Crossing& c, const Endpoint& e) {
+		return pointPrecedes(c.x, c.y, (Real)e.x, (Real)e.y)
+			|| (c.x == (Real)e.x && c.y == (Real)e.y && e.type == (uint32_t)Type::LEFT);
+	}
+
+	// Whether two edges follow each other in a chain, sharing a vertex and so never crossing.
+	bool chained(int a, int b) {
+		return !chainNext.empty() && (chainNext[a] == (uint32_t)b || chainNext[b] == (uint32_t)a);
+	}
+
+	/*
+	 * Whether a segment directly below another rises more steeply, as it must to cross it ahead of the sweep point.
+	 * Where several segments pass through one point, a pair swapped there can become adjacent again in its new order,
+	 * with its crossing at the sweep point itself; this keeps it from being swapped back.
+	 */
+	static bool converging(const Segment& lower, const Segment& upper) {
+		return (Product)(lower.x2 - lower.x1) * (Product)(upper.y2 - upper.y1)
+			< (Product)(lower.y2 - lower.y1) * (Product)(upper.x2 - upper.x1);
+	}
+
+	/*
+	 * Schedules the crossing of two adjacent segments if they converge. A converging pair crosses at or ahead of the
+	 * sweep point, so a crossing computed behind it is one through the sweep point put there by rounding, and is
+	 * scheduled at the sweep point; only at the start of a range sweep, whose sweep point has no y, is it dropped.
+	 */
+	void checkCrossing(int lowerId, int upperId, Real sweepX, Real sweepY) {
+		if (lowerId == -1 || upperId == -1 || chained(lowerId, upperId))
+		{
+			return;
+		}
+
+		Segment& a = segments[lowerId];
+		Segment& b = segments[upperId];
+		Real x, y;
+		if (!SweepGeometry<Coord, Tolerance>::crossing(a.x1, a.y1, a.x2, a.y2, b.x1, b.y1, b.x2, b.y2, x, y)
+			|| x > rangeEnd || !converging(a, b))
+		{
+			return;
+		}
+
+		if (pointPrecedes(x, y, sweepX, sweepY))
+		{
+			if (sweepY == (Real)-HUGE_VAL)
+			{
+				return;
+			}
+			x = sweepX;
+			y = sweepY;
+		}
+
+		crossings.push_back({ x, y, (uint32_t)lowerId, (uint32_t)upperId });
+		push_heap(crossings.begin(), crossings.end(), crossingAfter);
+		peakCrossings = max(peakCrossings, crossings.size());
+	}
+
+	/*
+	 * Checks the adjacent stabbing segments of a range sweep for crossings. On doubles with the default tolerance the
+	 * pairs are first tested all at once by IntersectionKernel, whose sweep rules match SweepGeometry::crossing, and
+	 * only its hits go through checkCrossing; other engines check each pair directly.
+	 */
+	void checkStabbingPairs(Real x0) {
+		if constexpr (is_same<Coord, double>::value && is_same<Tolerance, DefaultTolerance>::value)
+		{
+			stabbingBatch.clear();
+			pairLower.clear();
+			pairUpper.clear();
+			for (size_t i = 0; i < stabbing.size(); i++)
+			{
+				Segment& s = segments[stabbing[i].id];
+				stabbingBatch.add(s.x1, s.y1, s.x2, s.y2);
+				if (i > 0)
+				{
+					pairLower.push_back((int)i - 1);
+					pairUpper.push_back((int)i);
+				}
+			}
+
+			pairHits.resize(pairLower.size());
+			IntersectionKernel::testPairs(stabbingBatch, pairLower.data(), pairUpper.data(), (int)pairLower.size(),
+				pairHits.data(), IntersectionKernel::bestLevel(), KernelRules::SWEEP);
+			for (size_t p = 0; p < pairHits.size(); p++)
+			{
+				if (pairHits[p])
+				{
+					checkCrossing(stabbing[p].id, stabbing[p + 1].id, x0, (Real)-HUGE_VAL);
+				}
+			}
+		}
+		else
+		{
+			for (size_t i = 1; i < stabbing.size(); i++)
+			{
+				checkCrossing(stabbing[i - 1].id, stabbing[i].id, x0, (Real)-HUGE_VAL);
+			}
+		}
+	}
+
+	void loadSegment(const SegmentView<Coord>& input, size_t i) {
+		const Coord* c = input[i];
+		bool inOrder = c[0] < c[2] || (c[0] == c[2] && c[1] <= c[3]);
+
+		if (inOrder)
+		{
+			segments[i] = { c[0], c[1], c[2], c[3] };
+		}
+		else
+		{
+			segments[i] = { c[2], c[3], c[0], c[1] };
+		}
+	}
+
+	void load(const SegmentView<Coord>& input) {
+		size_t n = input.size();
+		segments.resize(n);
+		endpoints.resize(2 * n);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			loadSegment(input, i);
+			Segment& s = segments[i];
+			endpoints[2 * i] = { s.x1, s.y1, (uint32_t)i, (uint32_t)Type::LEFT };
+			endpoints[2 * i + 1] = { s.x2, s.y2, (uint32_t)i, (uint32_t)Type::RIGHT };
+		}
+
+		sort(endpoints.begin(), endpoints.end(), endpointPrecedes);
+		stabbing.clear();
+		renumber();
+	}
+
+	/*
+	 * Moves the loaded segments to the order set by setOrder, keeping only those the sweep meets. The endpoints keep
+	 * their order and only change ids, so the sweep makes the same steps as in input order.
+	 */
+	void renumber() {
+		originalId.clear();
+		if (order == SegmentOrder::INPUT)
+		{
+			return;
+		}
+
+		// Order in which the sweep first meets the segments: stabbing the start of a range, then by left endpoint.
+		storedId.assign(segments.size(), UINT32_MAX);
+		for (const StatusEntry& entry : stabbing)
+		{
+			storedId[entry.id] = (uint32_t)originalId.size();
+			originalId.push_back((uint32_t)entry.id);
+		}
+		for (const Endpoint& e : endpoints)
+		{
+			if (storedId[e.id] == UINT32_MAX)
+			{
+				storedId[e.id] = (uint32_t)originalId.size();
+				originalId.push_back(e.id);
+			}
+		}
+
+		if (order == SegmentOrder::HILBERT && !originalId.empty())
+		{
+			double minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+			for (uint32_t id : originalId)
+			{
+				Segment& s = segments[id];
+				minX = min(minX, (double)s.x1);
+				maxX = max(maxX, (double)s.x2);
+				minY = min(minY, (double)min(s.y1, s.y2));
+				maxY = max(maxY, (double)max(s.y1, s.y2));
+			}
+
+			double scaleX = 65535.0 / max(maxX - minX, 1e-300), scaleY = 65535.0 / max(maxY - minY, 1e-300);
+			vector<pair<uint64_t, uint32_t>> keys(originalId.size());
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				Segment& s = segments[originalId[i]];
+				uint32_t cellX = (uint32_t)((((double)s.x1 + (double)s.x2) / 2 - minX) * scaleX);
+				uint32_t cellY = (uint32_t)((((double)s.y1 + (double)s.y2) / 2 - minY) * scaleY);
+				keys[i] = make_pair(hilbertIndex(min(cellX, 65535u), min(cellY, 65535u)), originalId[i]);
+			}
+			sort(keys.begin(), keys.end());
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				originalId[i] = keys[i].second;
+				storedId[keys[i].second] = (uint32_t)i;
+			}
+		}
+
+		renumbered.resize(originalId.size());
+		for (size_t i = 0; i < originalId.size(); i++)
+		{
+			renumbered[i] = segments[originalId[i]];
+		}
+		segments.swap(renumbered);
+		for (Endpoint& e : endpoints)
+		{
+			e.id = storedId[e.id];
+		}
+		for (StatusEntry& entry : stabbing)
+		{
+			entry.id = (int)storedId[entry.id];
+		}
+	}
+
+	/*
+	 * Loads the edges of chains, with one VERTEX event per vertex in place of the two endpoint events of each edge,
+	 * and links the edges of each chain.
+	 */
+	void loadChains(const ChainView<Coord>& input) {
+		size_t n = input.vertexCount();
+		segments.resize(n);
+		endpoints.resize(n);
+		chainNext.assign(n, (uint32_t)NO_EDGE);
+		chainPrevious.assign(n, (uint32_t)NO_EDGE);
+		originalId.clear();
+
+		for (size_t c = 0; c < input.size(); c++)
+		{
+			uint32_t first = input.first(c), end = input.end(c);
+			for (uint32_t v = first; v < end; v++)
+			{
+				uint32_t next = v + 1 < end ? v + 1 : (input.isClosed(c) ? first : NO_EDGE);
+				const Coord* a = input.vertex(v);
+				endpoints[v] = { a[0], a[1], v, (uint32_t)Type::VERTEX };
+				if (next == NO_EDGE)
+				{
+					continue;
+				}
+
+				const Coord* b = input.vertex(next);
+				bool inOrder = a[0] < b[0] || (a[0] == b[0] && a[1] <= b[1]);
+				segments[v] = inOrder ? Segment{ a[0], a[1], b[0], b[1] } : Segment{ b[0], b[1], a[0], a[1] };
+				chainNext[v] = next;
+				chainPrevious[next] = v;
+			}
+		}
+
+		sort(endpoints.begin(), endpoints.end(), endpointPrecedes);
+	}
+
+	/*
+	 * Loads the segments for a sweep of x0 <= x <= x1: the endpoints inside the range are sorted, and the segments
+	 * stabbing x = x0 from its left go straight into the status, in their order just left of x0.
+	 */
+	void loadRange(const SegmentView<Coord>& input, Coord x0, Coord x1) {
+		size_t n = input.size();
+		segments.resize(n);
+		endpoints.clear();
+		stabbing.clear();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			loadSegment(input, i);
+			Segment& s = segments[i];
+			if (s.x2 < x0 || s.x1 > x1)
+			{
+				continue;
+			}
+
+			if (s.x1 < x0)
+			{
+				stabbing.push_back(makeStatusEntry((int)i, Point((double)s.x1, (double)s.y1),
+					Point((double)s.x2, (double)s.y2)));
+			}
+			else
+			{
+				endpoints.push_back({ s.x1, s.y1, (uint32_t)i, (uint32_t)Type::LEFT });
+			}
+
+			if (s.x2 <= x1)
+			{
+				endpoints.push_back({ s.x2, s.y2, (uint32_t)i, (uint32_t)Type::RIGHT });
+			}
+		}
+
+		sort(endpoints.begin(), endpoints.end(), endpointPrecedes);
+
+		// Segments through the same point of x = x0 are ordered by decreasing slope, their order before crossing there.
+		double x = (double)x0;
+		sort(stabbing.begin(), stabbing.end(), [x](const StatusEntry& a, const StatusEntry& b) {
+			double ya = a.yAt(x), yb = b.yAt(x);
+			return fabs(ya - yb) >= POINT_EPSILON ? ya < yb : a.slope > b.slope;
+		});
+		renumber();
+	}
+
+	void processCrossing() {
+		Crossing c = crossings.front();
+		pop_heap(crossings.begin(), crossings.end(), crossingAfter);
+		crossings.pop_back();
+
+		// Events are not removed when their segments stop being adjacent, so check that the pair is still adjacent
+		// and in its order before the crossing. This also discards duplicates of an event.
+		if (!status.contains(c.upperId) || status.below(c.upperId) != (int)c.lowerId)
+		{
+			return;
+		}
+
+		if (originalId.empty())
+		{
+			sink.report(c.x, c.y, c.lowerId, c.upperId);
+		}
+		else
+		{
+			sink.report(c.x, c.y, originalId[c.lowerId], originalId[c.upperId]);
+		}
+
+		status.swap(c.lowerId, c.upperId);
+		checkCrossing(status.below(c.upperId), c.upperId, c.x, c.y);
+		checkCrossing(c.lowerId, status.above(c.lowerId), c.x, c.y);
+	}
+
+	void insertEdge(uint32_t id) {
+		Segment& s = segments[id];
+		status.insert(makeStatusEntry(id, Point((double)s.x1, (double)s.y1), Point((double)s.x2, (double)s.y2)),
+			(double)s.x1, (double)s.y1);
+	}
+
+	void processEndpoint(const Endpoint& e) {
+		if (e.type == (uint32_t)Type::LEFT)
+		{
+			if (segments[e.id].isPoint())
+			{
+				return;
+			}
+
+			insertEdge(e.id);
+			checkCrossing(e.id, status.above(e.id), (Real)e.x, (Real)e.y);
+			checkCrossing(status.below(e.id), e.id, (Real)e.x, (Real)e.y);
+		}
+		else if (status.contains(e.id))
+		{
+			int above = status.above(e.id);
+			int below = status.below(e.id);
+			status.remove(e.id);
+			checkCrossing(below, above, (Real)e.x, (Real)e.y);
+		}
+	}
+
+	// Whether a segment in the status, next to one ending at a chain vertex, also passes through the vertex.
+	bool passesThrough(int id, const Endpoint& e) {
+		StatusEntry& entry = status.entryOf(id);
+		return isinf(entry.slope) || fabs(entry.yAt((double)e.x) - (double)e.y) < POINT_EPSILON;
+	}
+
+	/*
+	 * Processes a chain vertex, where the edge before it and the edge after it each start or end. An edge ending
+	 * where the other starts is replaced by it in place, at its position in the status, so only the new edge meets
+	 * new neighbours. That is only sound when no other segment passes through the vertex: such a segment may separate
+	 * the two edges, or cross others there. Otherwise, and for two starting or two ending edges, the ending edges are
+	 * removed now and the starting ones wait in pendingEdges for the crossings at the vertex, as LEFT endpoints do.
+	 */
+	void processVertex(const Endpoint& e) {
+		uint32_t edges[2] = { chainPrevious[e.id], chainNext[e.id] != NO_EDGE ? e.id : NO_EDGE };
+		uint32_t starting[2], ending[2];
+		int starts = 0, ends = 0;
+		for (uint32_t id : edges)
+		{
+			if (id == NO_EDGE || segments[id].isPoint())
+			{
+				continue;
+			}
+
+			if (segments[id].x1 == e.x && segments[id].y1 == e.y)
+			{
+				starting[starts++] = id;
+			}
+			else if (status.contains(id))
+			{
+				ending[ends++] = id;
+			}
+		}
+
+		if (starts == 1 && ends == 1)
+		{
+			int above = status.above(ending[0]);
+			int below = status.below(ending[0]);
+			if ((above < 0 || !passesThrough(above, e)) && (below < 0 || !passesThrough(below, e)))
+			{
+				Segment& s = segments[starting[0]];
+				status.replace(ending[0], makeStatusEntry(starting[0], Point((double)s.x1, (double)s.y1),
+					Point((double)s.x2, (double)s.y2)));
+				checkCrossing(starting[0], status.above(starting[0]), (Real)e.x, (Real)e.y);
+				checkCrossing(status.below(starting[0]), starting[0], (Real)e.x, (Real)e.y);
+				return;
+			}
+		}
+
+		for (int i = 0; i < ends; i++)
+		{
+			int above = status.above(ending[i]);
+			int below = status.below(ending[i]);
+			status.remove(ending[i]);
+			checkCrossing(below, above, (Real)e.x, (Real)e.y);
+		}
+
+		for (int i = 0; i < starts; i++)
+		{
+			pendingEdges.push_back(starting[i]);
+		}
+		pendingAt = e;
+	}
+
+	// Whether the next event still comes before the edges waiting to start at pendingAt: a crossing there, or an
+	// endpoint there other than a LEFT one.
+	bool pendingWaits(size_t next) {
+		if (!crossings.empty() && crossings.front().x == (Real)pendingAt.x && crossings.front().y == (Real)pendingAt.y)
+		{
+			return true;
+		}
+
+		return next < endpoints.size() && endpoints[next].x == pendingAt.x && endpoints[next].y == pendingAt.y
+			&& endpoints[next].type != (uint32_t)Type::LEFT;
+	}
+
+	void insertPendingEdges() {
+		for (uint32_t id : pendingEdges)
+		{
+			insertEdge(id);
+		}
+		for (uint32_t id : pendingEdges)
+		{
+			checkCrossing(id, status.above(id), (Real)pendingAt.x, (Real)pendingAt.y);
+			checkCrossing(status.below(id), id, (Real)pendingAt.x, (Real)pendingAt.y);
+		}
+		pendingEdges.clear();
+	}
+
+	// Processes the loaded endpoints and the crossings they lead to, in sweep order.
+	void sweep() {
+		size_t next = 0;
+		pendingEdges.clear();
+		while (next < endpoints.size() || !crossings.empty() || !pendingEdges.empty())
+		{
+			if (!pendingEdges.empty() && !pendingWaits(next))
+			{
+				insertPendingEdges();
+			}
+			else if (!crossings.empty()
+				&& (next == endpoints.size() || crossingFirst(crossings.front(), endpoints[next])))
+			{
+				processCrossing();
+			}
+			else if (endpoints[next].type == (uint32_t)Type::VERTEX)
+			{
+				processVertex(endpoints[next++]);
+			}
+			else
+			{
+				processEndpoint(endpoints[next++]);
+			}
+		}
+	}
+
+public:
+	SweepEngine(Sink sink = Sink()) : sink(sink) {
+		order = SegmentOrder::SWEEP;
+		peakCrossings = 0;
+		rangeEnd = (Real)HUGE_VAL;
+	}
+
+	/*
+	 * Reports every intersection of the segments to the sink, with segments identified by their index in the view.
+	 * Buffers are kept between runs, so an engine reused on inputs of similar size does not allocate.
+	 */
+	void run(const SegmentView<Coord>& input) {
+		load(input);
+		chainNext.clear();
+		chainPrevious.clear();
+		crossings.clear();
+		status.clear();
+		peakCrossings = 0;
+		rangeEnd = (Real)HUGE_VAL;
+		sweep();
+	}
+
+	/*
+	 * Reports the intersections with x0 <= x <= x1, like run. Rather than replaying the events left of x0, the status
+	 * is built directly from the segments stabbing x = x0, sorted by their y there, and only the events inside the
+	 * range are sorted and processed. Apart from one pass over the input, the cost follows the segments and crossings
+	 * inside the range.
+	 */
+	void runRange(const SegmentView<Coord>& input, Coord x0, Coord x1) {
+		loadRange(input, x0, x1);
+		chainNext.clear();
+		chainPrevious.clear();
+		crossings.clear();
+		status.clear();
+		peakCrossings = 0;
+		rangeEnd = (Real)x1;
+
+		status.build(stabbing);
+		checkStabbingPairs((Real)x0);
+		sweep();
+	}
+
+	/*
+	 * Reports every intersection of the edges of the chains, identified by their index as in ChainView. Each vertex
+	 * is a single event, so a ring of n edges costs n events rather than 2n, and edges following each other in a
+	 * chain are never tested against each other.
+	 */
+	void runChains(const ChainView<Coord>& input) {
+		loadChains(input);
+		crossings.clear();
+		status.clear();
+		peakCrossings = 0;
+		rangeEnd = (Real)HUGE_VAL;
+		sweep();
+	}
+
+	// Order of the segment store in the following runs, SegmentOrder::SWEEP unless set. Chain runs keep input order.
+	void setOrder(SegmentOrder order) {
+		this->order = order;
+	}
+
+	Sink& getSink() {
+		return sink;
+	}
+
+	// Number of endpoint or vertex events in the last run.
+	size_t getEventCount() {
+		return endpoints.size();
+	}
+
+	// Largest number of pending intersection events during the last run.
+	size_t getPeakCrossings() {
+		return peakCrossings;
+	}
+};
+
+// The combinations used by this program are compiled once, in SweepEngine.cpp.
+extern template class SweepEngine<float, ExactTolerance, CountSink>;
+extern template class SweepEngine<double, ExactTolerance, CountSink>;
+extern template class SweepEngine<double, DefaultTolerance, CountSink>;
+extern template class SweepEngine<double, DefaultTolerance, CollectSink<double>>;
+extern template class SweepEngine<double, DefaultTolerance, PairSink>;
+extern template class SweepEngine<double, DefaultTolerance, CallbackSink>;
+extern template class SweepEngine<int64_t, ExactTolerance, CountSink>;
+extern template class SweepEngine<int64_t, ExactTolerance, PairSink>;
+extern template class SweepEngine<long double, DefaultTolerance, CollectSink<long double>>;
@@ -0,0 +1,486 @@
+#pragma once
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <fcntl.h>
+#include <io.h>
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ExternalSweep.h"
+#include "Pipeline.h"
+#include "SweepEngine.h"
+
+/*
+ * Wire format of the server. Every request is a RequestHeader followed by its payload, and is answered by a
+ * ResponseHeader followed by its payload, all in the byte order of the machine:
+ *  - SEGMENTS: count segments follow as x1, y1, x2, y2 doubles. The answer carries the intersections as
+ *    IntersectionRecords, the format of ExternalSweep, or only their number with REQUEST_COUNT_ONLY.
+ *  - DATASET: the same for the dataset preloaded under the given id, without a payload.
+ *  - STATS: the answer carries the statistics of the server as a JSON object of bytes bytes.
+ * REQUEST_RANGE limits either sweep to the intersections with x0 <= x <= x1. Segments with a coordinate that is not
+ * finite, and range bounds that are NaN, are answered with BAD_REQUEST without sweeping.
+ */
+enum class RequestType : uint32_t { SEGMENTS = 1, DATASET = 2, STATS = 3 };
+
+const uint32_t REQUEST_COUNT_ONLY = 1;
+const uint32_t REQUEST_RANGE = 2;
+
+struct RequestHeader {
+	uint32_t type;
+	uint32_t flags;
+	uint32_t count; // segments in the payload
+	uint32_t dataset;
+	double x0;
+	double x1;
+};
+
+enum class ResponseStatus : int32_t { OK = 0, BAD_REQUEST = 1, UNKNOWN_DATASET = 2, OUT_OF_MEMORY = 3 };
+
+struct ResponseHeader {
+	int32_t status;
+	uint32_t reserved;
+	uint64_t count; // intersections found
+	uint64_t bytes; // of the payload
+};
+
+// Requests with more segments than this are refused rather than allocated for.
+const uint32_t MAX_REQUEST_SEGMENTS = 1 << 24;
+
+#ifdef _WIN32
+typedef SOCKET ServerSocket;
+const ServerSocket NO_SOCKET = INVALID_SOCKET;
+
+inline void closeSocket(ServerSocket s) {
+	closesocket(s);
+}
+#else
+typedef int ServerSocket;
+const ServerSocket NO_SOCKET = -1;
+
+inline void closeSocket(ServerSocket s) {
+	close(s);
+}
+#endif
+
+/*
+ * Long-running server answering intersection queries, so that small interactive queries do not pay for starting the
+ * program and loading their datasets every time. Clients connect to a Unix domain socket and are served by a fixed
+ * pool of worker threads, each connection by one worker until it closes; connections beyond the pool wait in a queue.
+ * A single client can also talk to the server over stdin and stdout.
+ *
+ * Each worker keeps its own SweepEngine and buffers, which stay allocated between requests, and datasets are parsed
+ * once at startup and shared read-only by all workers.
+ */
+class SweepServer {
+private:
+	typedef SweepEngine<double, DefaultTolerance, CallbackSink> Engine;
+
+	// Either a pair of streams or a socket, read and written in whole messages.
+	struct Channel {
+		FILE* in;
+		FILE* out;
+		ServerSocket socket;
+
+		bool read(void* data, size_t size) {
+			if (in != nullptr)
+			{
+				return fread(data, 1, size, in) == size;
+			}
+
+			char* bytes = (char*)data;
+			while (size > 0)
+			{
+				int received = (int)recv(socket, bytes, (int)min(size, (size_t)(1 << 20)), 0);
+				if (received <= 0)
+				{
+					return false;
+				}
+
+				bytes += received;
+				size -= received;
+			}
+			return true;
+		}
+
+		bool write(const void* data, size_t size) {
+			if (out != nullptr)
+			{
+				return fwrite(data, 1, size, out) == size;
+			}
+
+			const char* bytes = (const char*)data;
+			while (size > 0)
+			{
+				int sent = (int)send(socket, bytes, (int)min(size, (size_t)(1 << 20)), 0);
+				if (sent <= 0)
+				{
+					return false;
+				}
+
+				bytes += sent;
+				size -= sent;
+			}
+			return true;
+		}
+
+		bool flush() {
+			return out == nullptr || fflush(out) == 0;
+		}
+	};
+
+	struct Worker {
+		Engine engine;
+		vector<double> coordinates;
+		vector<IntersectionRecord> records;
+		bool countOnly;
+		uint64_t count;
+	};
+
+	static const size_t LATENCY_WINDOW = 4096; // requests kept for the percentiles
+
+	size_t threadCount;
+	vector<vector<double>> datasets; // x1, y1, x2, y2 of each segment
+	BoundedQueue<ServerSocket> clients;
+	atomic<long long> queued;
+	atomic<long long> activeClients;
+
+	mutex statsLock;
+	vector<double> latencies; // of the last requests, in milliseconds, as a ring
+	size_t nextLatency;
+	long long requests;
+	long long failedRequests;
+	long long peakQueued;
+
+	static void report(double x, double y, uint32_t lowerId, uint32_t upperId, void* context) {
+		Worker* worker = (Worker*)context;
+		if (!worker->countOnly)
+		{
+			worker->records.push_back({ x, y, lowerId, upperId });
+		}
+		worker->count++;
+	}
+
+	void recordRequest(double ms, bool failed) {
+		lock_guard<mutex> guard(statsLock);
+		if (latencies.size() < LATENCY_WINDOW)
+		{
+			latencies.push_back(ms);
+		}
+		else
+		{
+			latencies[nextLatency] = ms;
+		}
+
+		nextLatency = (nextLatency + 1) % LATENCY_WINDOW;
+		requests++;
+		if (failed)
+		{
+			failedRequests++;
+		}
+	}
+
+	bool respond(Channel& channel, ResponseStatus status, uint64_t count, const void* payload, uint64_t bytes) {
+		ResponseHeader header = { (int32_t)status, 0, count, bytes };
+		return channel.write(&header, sizeof(header)) && (bytes == 0 || channel.write(payload, (size_t)bytes))
+			&& channel.flush();
+	}
+
+	static bool allFinite(const vector<double>& coordinates) {
+		for (double c : coordinates)
+		{
+			if (!isfinite(c))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	ResponseStatus sweep(Worker& worker, const RequestHeader& request, const vector<double>& coordinates) {
+		worker.countOnly = (request.flags & REQUEST_COUNT_ONLY) != 0;
+		worker.count = 0;
+		worker.records.clear();
+
+		try
+		{
+			SegmentView<double> view(coordinates.data(), coordinates.size() / 4);
+			if (request.flags & REQUEST_RANGE)
+			{
+				worker.engine.runRange(view, request.x0, request.x1);
+			}
+			else
+			{
+				worker.engine.run(view);
+			}
+		}
+		catch (const bad_alloc&)
+		{
+			return ResponseStatus::OUT_OF_MEMORY;
+		}
+
+		return ResponseStatus::OK;
+	}
+
+	// Answers one request. Returns false once the client is gone or the stream can no longer be read in step.
+	bool handle(Worker& worker, Channel& channel) {
+		RequestHeader request;
+		if (!channel.read(&request, sizeof(request)))
+		{
+			return false;
+		}
+
+		auto start = chrono::high_resolution_clock::now();
+		ResponseStatus status = ResponseStatus::OK;
+		const vector<double>* coordinates = &worker.coordinates;
+
+		if (request.type == (uint32_t)RequestType::STATS)
+		{
+			string stats = getStatsJson();
+			return respond(channel, ResponseStatus::OK, 0, stats.data(), stats.size());
+		}
+		else if (request.type == (uint32_t)RequestType::SEGMENTS)
+		{
+			if (request.count > MAX_REQUEST_SEGMENTS)
+			{
+				respond(channel, ResponseStatus::BAD_REQUEST, 0, nullptr, 0);
+				return false; // the payload cannot be skipped without reading it
+			}
+
+			worker.coordinates.resize(4 * (size_t)request.count);
+			if (!channel.read(worker.coordinates.data(), worker.coordinates.size() * sizeof(double)))
+			{
+				return false;
+			}
+			else if (!allFinite(worker.coordinates))
+			{
+				status = ResponseStatus::BAD_REQUEST;
+			}
+		}
+		else if (request.type == (uint32_t)RequestType::DATASET)
+		{
+			if (request.dataset < datasets.size())
+			{
+				coordinates = &datasets[request.dataset];
+			}
+			else
+			{
+				status = ResponseStatus::UNKNOWN_DATASET;
+			}
+		}
+		else
+		{
+			status = ResponseStatus::BAD_REQUEST;
+		}
+
+		if (status == ResponseStatus::OK && (request.flags & REQUEST_RANGE) && (isnan(request.x0) || isnan(request.x1)))
+		{
+			status = ResponseStatus::BAD_REQUEST;
+		}
+
+		if (status == ResponseStatus::OK)
+		{
+			status = sweep(worker, request, *coordinates);
+		}
+
+		bool sent;
+		if (status == ResponseStatus::OK)
+		{
+			sent = respond(channel, status, worker.count, worker.records.data(),
+				worker.records.size() * sizeof(IntersectionRecord));
+		}
+		else
+		{
+			sent = respond(channel, status, 0, nullptr, 0);
+		}
+
+		recordRequest(chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count()
+			/ 1e6, status != ResponseStatus::OK);
+		return sent;
+	}
+
+	void serveClients() {
+		Worker worker;
+		worker.engine.getSink().callback = report;
+		worker.engine.getSink().context = &worker;
+		ServerSocket client;
+
+		while (clients.pop(client))
+		{
+			queued--;
+			activeClients++;
+
+			Channel channel = { nullptr, nullptr, client };
+			while (handle(worker, channel))
+			{
+			}
+
+			closeSocket(client);
+			activeClients--;
+		}
+	}
+
+public:
+	// Prepares a server with the given number of worker threads and at most queueDepth connections waiting for one.
+	SweepServer(size_t threadCount, size_t queueDepth = 64) : clients(max((size_t)1, queueDepth)) {
+		this->threadCount = max((size_t)1, threadCount);
+		this->nextLatency = 0;
+		this->requests = 0;
+		this->failedRequests = 0;
+		this->peakQueued = 0;
+		queued = 0;
+		activeClients = 0;
+	}
+
+	// Parses a file in the format of in.txt and keeps its segments in memory. Returns its dataset id, or -1.
+	int loadDataset(string path) {
+		FILE* stream;
+		if (fopen_s(&stream, path.c_str(), "r") != 0 || stream == nullptr)
+		{
+			cerr << "Could not open " << path << endl;
+			return -1;
+		}
+
+		vector<double> coordinates;
+		int n;
+		if (fscanf_s(stream, "%d", &n) == 1)
+		{
+			coordinates.reserve(4 * (size_t)max(n, 0));
+			double x1, y1, x2, y2;
+			for (int i = 0; i < n && fscanf_s(stream, "%lf%lf%lf%lf", &x1, &y1, &x2, &y2) == 4; i++)
+			{
+				coordinates.insert(coordinates.end(), { x1, y1, x2, y2 });
+			}
+		}
+
+		fclose(stream);
+		if (!allFinite(coordinates))
+		{
+			cerr << "Coordinates that are not finite in " << path << endl;
+			return -1;
+		}
+
+		datasets.push_back(move(coordinates));
+		return (int)datasets.size() - 1;
+	}
+
+	// Answers the requests read from in on out, one at a time, until in ends.
+	void serveStream(FILE* in, FILE* out) {
+#ifdef _WIN32
+		_setmode(_fileno(in), _O_BINARY);
+		_setmode(_fileno(out), _O_BINARY);
+#endif
+		Worker worker;
+		worker.engine.getSink().callback = report;
+		worker.engine.getSink().context = &worker;
+
+		Channel channel = { in, out, NO_SOCKET };
+		while (handle(worker, channel))
+		{
+		}
+	}
+
+	/*
+	 * Listens on a Unix domain socket at path and serves its clients until accepting fails. Returns false if the socket
+	 * could not be set up.
+	 */
+	bool serveSocket(string path) {
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		{
+			return false;
+		}
+#else
+		signal(SIGPIPE, SIG_IGN); // a client leaving mid-answer shows as a failed send instead
+#endif
+
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			cerr << "Socket path too long: " << path << endl;
+			return false;
+		}
+		copy(path.begin(), path.end(), address.sun_path);
+
+		ServerSocket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		remove(path.c_str());
+		if (listener == NO_SOCKET || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0
+			|| listen(listener, SOMAXCONN) != 0)
+		{
+			cerr << "Could not listen on " << path << endl;
+			if (listener != NO_SOCKET)
+			{
+				closeSocket(listener);
+			}
+			return false;
+		}
+
+		vector<thread> workers;
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			workers.push_back(thread(&SweepServer::serveClients, this));
+		}
+
+		ServerSocket client;
+		while ((client = accept(listener, nullptr, nullptr)) != NO_SOCKET)
+		{
+			long long waiting = ++queued;
+			{
+				lock_guard<mutex> guard(statsLock);
+				peakQueued = max(peakQueued, waiting);
+			}
+			clients.push(client);
+		}
+
+		clients.close();
+		for (thread& worker : workers)
+		{
+			worker.join();
+		}
+
+		closeSocket(listener);
+		remove(path.c_str());
+		return true;
+	}
+
+	// Request count, latency percentiles over the last requests and queue depth, as a JSON object.
+	string getStatsJson() {
+		lock_guard<mutex> guard(statsLock);
+		vector<double> sorted = latencies;
+		sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](double p) {
+			return sorted.empty() ? 0.0 : sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+		};
+
+		ostringstream json;
+		json << "{\"requests\": " << requests << ", \"failed_requests\": " << failedRequests << ", \"threads\": "
+			<< threadCount << ", \"datasets\": " << datasets.size() << ", \"active_clients\": " << activeClients.load()
+			<< ", \"queue_depth\": " << queued.load() << ", \"peak_queue_depth\": " << peakQueued
+			<< ", \"latency_ms\": {\"p50\": " << percentile(0.5) << ", \"p90\": " << percentile(0.9) << ", \"p99\": "
+			<< percentile(0.99) << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << "}}";
+		return json.str();
+	}
+};
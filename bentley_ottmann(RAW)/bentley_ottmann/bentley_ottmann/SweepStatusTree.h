@@ -0,0 +1,700 @@
+#pragma once
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "Structures.h"
+
+/*
+ * A segment as stored in the sweep status: its id and the coefficients of its supporting line, so that its y at the
+ * sweep line is found without dereferencing the segment. Vertical segments have an infinite slope; one is in the
+ * status only while the sweep point climbs it, so it is ordered at the y of the sweep point, above the other segments
+ * through that point.
+ */
+struct StatusEntry {
+	double x0; // x of the left endpoint
+	double y0; // y of the left endpoint
+	double slope;
+	int id;
+
+	double yAt(double x) const {
+		return isinf(slope) ? y0 : y0 + slope * (x - x0);
+	}
+
+	/*
+	 * Orders two entries by their y at the sweep point (x, sweepY). Entries passing through the same point are ordered
+	 * by slope, which is their order just right of the sweep line.
+	 */
+	int compareAt(const StatusEntry& other, double x, double sweepY) const {
+		double y = isinf(slope) ? sweepY : yAt(x);
+		double otherY = isinf(other.slope) ? sweepY : other.yAt(x);
+
+		if (fabs(y - otherY) >= POINT_EPSILON)
+		{
+			return y < otherY ? -1 : 1;
+		}
+		else if (slope != other.slope)
+		{
+			return slope < other.slope ? -1 : 1;
+		}
+
+		return 0;
+	}
+};
+
+inline StatusEntry makeStatusEntry(int id, Point left, Point right) {
+	StatusEntry entry;
+	entry.id = id;
+	entry.x0 = left.getX();
+	entry.y0 = left.getY();
+
+	if (fabs(right.getX() - left.getX()) < POINT_EPSILON)
+	{
+		entry.slope = HUGE_VAL;
+		entry.y0 = left.getY() < right.getY() ? left.getY() : right.getY();
+	}
+	else
+	{
+		entry.slope = (right.getY() - left.getY()) / (right.getX() - left.getX());
+	}
+
+	return entry;
+}
+
+/*
+ * Sweep status kept as a B+-tree whose nodes span a fixed number of cache lines. Leaves store the status entries
+ * inline, in sweep order, and are linked to each other, so the segments directly above and below any segment are
+ * found in O(1). Inner nodes store a copy of the last entry of each child but the last one as separator.
+ *
+ * Segments are located by id through a table of the leaf holding each of them, so that removals and swaps never
+ * compare geometry; only insertion descends the tree. Removal frees empty nodes but does not merge underfull ones,
+ * as the status of a sweep shrinks back to empty anyway.
+ */
+class SweepStatusTree {
+public:
+	static const int CACHE_LINE = 64;
+	static const int NODE_LINES = 8;
+
+private:
+	struct InnerNode;
+
+	struct alignas(CACHE_LINE) Leaf {
+		static const int CAPACITY = (NODE_LINES * CACHE_LINE - 32) / sizeof(StatusEntry);
+
+		int count;
+		InnerNode* parent;
+		Leaf* prev;
+		Leaf* next;
+		StatusEntry entries[CAPACITY];
+	};
+
+	struct alignas(CACHE_LINE) InnerNode {
+		static const int CAPACITY = (NODE_LINES * CACHE_LINE - 16) / (sizeof(StatusEntry) + sizeof(void*));
+
+		int count; // number of children
+		bool leafChildren;
+		InnerNode* parent;
+		StatusEntry separators[CAPACITY - 1];
+		void* children[CAPACITY];
+	};
+
+	void* root;
+	bool rootIsLeaf;
+	int entryCount;
+	vector<Leaf*> leafOf; // leaf holding each segment id, nullptr if not in the status
+
+	static int slotOf(Leaf* leaf, int id) {
+		for (int i = 0; i < leaf->count; i++)
+		{
+			if (leaf->entries[i].id == id)
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	static int childIndex(InnerNode* parent, void* child) {
+		for (int i = 0; i < parent->count; i++)
+		{
+			if (parent->children[i] == child)
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	static void setParent(void* child, bool isLeaf, InnerNode* parent) {
+		if (isLeaf)
+		{
+			((Leaf*)child)->parent = parent;
+		}
+		else
+		{
+			((InnerNode*)child)->parent = parent;
+		}
+	}
+
+	// Copies the last entry of a leaf into the separator of the first ancestor it is the maximum of.
+	void refreshMax(Leaf* leaf) {
+		if (leaf->count == 0)
+		{
+			return;
+		}
+
+		StatusEntry max = leaf->entries[leaf->count - 1];
+		void* child = leaf;
+		InnerNode* parent = leaf->parent;
+
+		while (parent != nullptr)
+		{
+			int index = childIndex(parent, child);
+
+			if (index < parent->count - 1)
+			{
+				parent->separators[index] = max;
+				return;
+			}
+
+			child = parent;
+			parent = parent->parent;
+		}
+	}
+
+	// Adds a child right after the child at index in parent, splitting the parent if it is full.
+	void insertChild(InnerNode* parent, int index, StatusEntry separator, void* child, bool isLeaf) {
+		if (parent->count < InnerNode::CAPACITY)
+		{
+			for (int i = parent->count; i > index + 1; i--)
+			{
+				parent->children[i] = parent->children[i - 1];
+			}
+			for (int i = parent->count - 1; i > index; i--)
+			{
+				parent->separators[i] = parent->separators[i - 1];
+			}
+
+			parent->children[index + 1] = child;
+			parent->separators[index] = separator;
+			parent->count++;
+			setParent(child, isLeaf, parent);
+			return;
+		}
+
+		// Gather all children and separators, then divide them between the node and a new sibling.
+		void* children[InnerNode::CAPACITY + 1];
+		StatusEntry separators[InnerNode::CAPACITY];
+		int total = 0;
+
+		for (int i = 0; i < parent->count; i++)
+		{
+			children[total] = parent->children[i];
+			if (i < parent->count - 1)
+			{
+				separators[total] = parent->separators[i];
+			}
+			total++;
+
+			if (i == index)
+			{
+				separators[total - 1] = separator;
+				children[total] = child;
+				if (i < parent->count - 1)
+				{
+					separators[total] = parent->separators[i];
+				}
+				total++;
+			}
+		}
+
+		int leftCount = total / 2;
+		InnerNode* sibling = new InnerNode();
+		sibling->leafChildren = isLeaf;
+		sibling->count = total - leftCount;
+
+		parent->count = leftCount;
+		for (int i = 0; i < leftCount; i++)
+		{
+			parent->children[i] = children[i];
+			setParent(children[i], isLeaf, parent);
+		}
+		for (int i = 0; i < leftCount - 1; i++)
+		{
+			parent->separators[i] = separators[i];
+		}
+
+		for (int i = 0; i < sibling->count; i++)
+		{
+			sibling->children[i] = children[leftCount + i];
+			setParent(children[leftCount + i], isLeaf, sibling);
+		}
+		for (int i = 0; i < sibling->count - 1; i++)
+		{
+			sibling->separators[i] = separators[leftCount + i];
+		}
+
+		addSibling(parent, separators[leftCount - 1], sibling, false);
+	}
+
+	// Links a new right sibling of node into the tree, growing a new root if node was the root.
+	void addSibling(void* node, StatusEntry separator, void* sibling, bool isLeaf) {
+		InnerNode* parent = isLeaf ? ((Leaf*)node)->parent : ((InnerNode*)node)->parent;
+
+		if (parent == nullptr)
+		{
+			InnerNode* newRoot = new InnerNode();
+			newRoot->parent = nullptr;
+			newRoot->leafChildren = isLeaf;
+			newRoot->count = 2;
+			newRoot->children[0] = node;
+			newRoot->children[1] = sibling;
+			newRoot->separators[0] = separator;
+			setParent(node, isLeaf, newRoot);
+			setParent(sibling, isLeaf, newRoot);
+
+			root = newRoot;
+			rootIsLeaf = false;
+		}
+		else
+		{
+			insertChild(parent, childIndex(parent, node), separator, sibling, isLeaf);
+		}
+	}
+
+	// Unlinks an empty node from its parent, freeing ancestors that become empty in turn.
+	void removeChild(void* child, bool isLeaf) {
+		InnerNode* parent = isLeaf ? ((Leaf*)child)->parent : ((InnerNode*)child)->parent;
+		int index = parent != nullptr ? childIndex(parent, child) : 0;
+
+		if (isLeaf)
+		{
+			delete (Leaf*)child;
+		}
+		else
+		{
+			delete (InnerNode*)child;
+		}
+
+		if (parent == nullptr)
+		{
+			root = nullptr;
+			rootIsLeaf = true;
+			return;
+		}
+
+		if (parent->count == 1)
+		{
+			parent->count = 0;
+			removeChild(parent, false);
+			return;
+		}
+
+		for (int i = index; i < parent->count - 1; i++)
+		{
+			parent->children[i] = parent->children[i + 1];
+		}
+
+		// The separator after the removed child goes with it, unless it was the last child, whose left neighbour
+		// then becomes the last child and gives up its separator instead.
+		int separatorIndex = index < parent->count - 1 ? index : index - 1;
+		for (int i = separatorIndex; i < parent->count - 2; i++)
+		{
+			parent->separators[i] = parent->separators[i + 1];
+		}
+
+		parent->count--;
+
+		if (index == parent->count)
+		{
+			// The subtree's maximum changed, so the separator above it must follow.
+			refreshMax(lastLeafOf(parent));
+		}
+
+		// Collapse a root left with a single child.
+		while (!rootIsLeaf && ((InnerNode*)root)->count == 1)
+		{
+			InnerNode* oldRoot = (InnerNode*)root;
+			root = oldRoot->children[0];
+			rootIsLeaf = oldRoot->leafChildren;
+			setParent(root, rootIsLeaf, nullptr);
+			delete oldRoot;
+		}
+	}
+
+	static Leaf* lastLeafOf(InnerNode* node) {
+		while (!node->leafChildren)
+		{
+			node = (InnerNode*)node->children[node->count - 1];
+		}
+
+		return (Leaf*)node->children[node->count - 1];
+	}
+
+	void setLeafOf(int id, Leaf* leaf) {
+		if (id >= (int)leafOf.size())
+		{
+			leafOf.resize(id + 1, nullptr);
+		}
+
+		leafOf[id] = leaf;
+	}
+
+	void destroy(void* node, bool isLeaf) {
+		if (node == nullptr)
+		{
+			return;
+		}
+
+		if (isLeaf)
+		{
+			delete (Leaf*)node;
+		}
+		else
+		{
+			InnerNode* inner = (InnerNode*)node;
+			for (int i = 0; i < inner->count; i++)
+			{
+				destroy(inner->children[i], inner->leafChildren);
+			}
+			delete inner;
+		}
+	}
+
+public:
+	SweepStatusTree() {
+		root = nullptr;
+		rootIsLeaf = true;
+		entryCount = 0;
+	}
+
+	~SweepStatusTree() {
+		destroy(root, rootIsLeaf);
+	}
+
+	SweepStatusTree(const SweepStatusTree&) = delete;
+	SweepStatusTree& operator=(const SweepStatusTree&) = delete;
+
+	void clear() {
+		destroy(root, rootIsLeaf);
+		root = nullptr;
+		rootIsLeaf = true;
+		entryCount = 0;
+		fill(leafOf.begin(), leafOf.end(), nullptr);
+	}
+
+	/*
+	 * Replaces the contents with entries already in order along the sweep line, building the tree bottom-up in linear
+	 * time. Nodes are filled to three quarters so that the first insertions do not split them.
+	 */
+	void build(vector<StatusEntry>& sorted) {
+		clear();
+		if (sorted.empty())
+		{
+			return;
+		}
+
+		size_t leafCount = (sorted.size() + Leaf::CAPACITY * 3 / 4 - 1) / (Leaf::CAPACITY * 3 / 4);
+		vector<void*> level(leafCount);
+		vector<StatusEntry> maxima(leafCount);
+		Leaf* prev = nullptr;
+
+		for (size_t i = 0; i < leafCount; i++)
+		{
+			size_t first = i * sorted.size() / leafCount, last = (i + 1) * sorted.size() / leafCount;
+			Leaf* leaf = new Leaf();
+			leaf->count = (int)(last - first);
+			leaf->parent = nullptr;
+			leaf->prev = prev;
+			leaf->next = nullptr;
+			if (prev != nullptr)
+			{
+				prev->next = leaf;
+			}
+
+			for (size_t j = first; j < last; j++)
+			{
+				leaf->entries[j - first] = sorted[j];
+				setLeafOf(sorted[j].id, leaf);
+			}
+
+			level[i] = leaf;
+			maxima[i] = sorted[last - 1];
+			prev = leaf;
+		}
+
+		bool isLeaf = true;
+		while (level.size() > 1)
+		{
+			size_t nodeCount = (level.size() + InnerNode::CAPACITY * 3 / 4 - 1) / (InnerNode::CAPACITY * 3 / 4);
+			vector<void*> upper(nodeCount);
+			vector<StatusEntry> upperMaxima(nodeCount);
+
+			for (size_t i = 0; i < nodeCount; i++)
+			{
+				size_t first = i * level.size() / nodeCount, last = (i + 1) * level.size() / nodeCount;
+				InnerNode* node = new InnerNode();
+				node->count = (int)(last - first);
+				node->leafChildren = isLeaf;
+				node->parent = nullptr;
+
+				for (size_t j = first; j < last; j++)
+				{
+					node->children[j - first] = level[j];
+					setParent(level[j], isLeaf, node);
+					if (j < last - 1)
+					{
+						node->separators[j - first] = maxima[j];
+					}
+				}
+
+				upper[i] = node;
+				upperMaxima[i] = maxima[last - 1];
+			}
+
+			level.swap(upper);
+			maxima.swap(upperMaxima);
+			isLeaf = false;
+		}
+
+		root = level[0];
+		rootIsLeaf = isLeaf;
+		entryCount = (int)sorted.size();
+	}
+
+	// Inserts a segment at its position along the sweep line x, for the sweep point (x, y).
+	void insert(StatusEntry entry, double x, double y) {
+		if (root == nullptr)
+		{
+			Leaf* leaf = new Leaf();
+			leaf->count = 1;
+			leaf->parent = nullptr;
+			leaf->prev = leaf->next = nullptr;
+			leaf->entries[0] = entry;
+			root = leaf;
+			rootIsLeaf = true;
+			setLeafOf(entry.id, leaf);
+			entryCount++;
+			return;
+		}
+
+		// Descend to the leaf that should hold the entry.
+		void* node = root;
+		bool isLeaf = rootIsLeaf;
+		while (!isLeaf)
+		{
+			InnerNode* inner = (InnerNode*)node;
+			int i = 0;
+			while (i < inner->count - 1 && entry.compareAt(inner->separators[i], x, y) > 0)
+			{
+				i++;
+			}
+			node = inner->children[i];
+			isLeaf = inner->leafChildren;
+		}
+
+		Leaf* leaf = (Leaf*)node;
+		int position = 0;
+		while (position < leaf->count && entry.compareAt(leaf->entries[position], x, y) > 0)
+		{
+			position++;
+		}
+
+		if (leaf->count == Leaf::CAPACITY)
+		{
+			// Split the full leaf in half and insert into whichever half the position falls in.
+			Leaf* sibling = new Leaf();
+			int leftCount = Leaf::CAPACITY / 2;
+			sibling->count = leaf->count - leftCount;
+			for (int i = 0; i < sibling->count; i++)
+			{
+				sibling->entries[i] = leaf->entries[leftCount + i];
+				leafOf[sibling->entries[i].id] = sibling;
+			}
+			leaf->count = leftCount;
+
+			sibling->parent = leaf->parent;
+			sibling->prev = leaf;
+			sibling->next = leaf->next;
+			if (leaf->next != nullptr)
+			{
+				leaf->next->prev = sibling;
+			}
+			leaf->next = sibling;
+
+			addSibling(leaf, leaf->entries[leftCount - 1], sibling, true);
+
+			if (position > leftCount)
+			{
+				position -= leftCount;
+				leaf = sibling;
+			}
+		}
+
+		for (int i = leaf->count; i > position; i--)
+		{
+			leaf->entries[i] = leaf->entries[i - 1];
+		}
+		leaf->entries[position] = entry;
+		leaf->count++;
+		setLeafOf(entry.id, leaf);
+		entryCount++;
+
+		if (position == leaf->count - 1)
+		{
+			refreshMax(leaf);
+		}
+	}
+
+	void remove(int id) {
+		if (!contains(id))
+		{
+			return;
+		}
+
+		Leaf* leaf = leafOf[id];
+		int slot = slotOf(leaf, id);
+
+		for (int i = slot; i < leaf->count - 1; i++)
+		{
+			leaf->entries[i] = leaf->entries[i + 1];
+		}
+		leaf->count--;
+		leafOf[id] = nullptr;
+		entryCount--;
+
+		if (leaf->count == 0)
+		{
+			if (leaf->prev != nullptr)
+			{
+				leaf->prev->next = leaf->next;
+			}
+			if (leaf->next != nullptr)
+			{
+				leaf->next->prev = leaf->prev;
+			}
+
+			removeChild(leaf, true);
+		}
+		else if (slot == leaf->count)
+		{
+			refreshMax(leaf);
+		}
+	}
+
+	bool contains(int id) {
+		return id >= 0 && id < (int)leafOf.size() && leafOf[id] != nullptr;
+	}
+
+	// Id of the segment directly above the given one, or -1 if it is the topmost.
+	int above(int id) {
+		Leaf* leaf = leafOf[id];
+		int slot = slotOf(leaf, id);
+
+		if (slot + 1 < leaf->count)
+		{
+			return leaf->entries[slot + 1].id;
+		}
+
+		return leaf->next != nullptr ? leaf->next->entries[0].id : -1;
+	}
+
+	// Id of the segment directly below the given one, or -1 if it is the bottommost.
+	int below(int id) {
+		Leaf* leaf = leafOf[id];
+		int slot = slotOf(leaf, id);
+
+		if (slot > 0)
+		{
+			return leaf->entries[slot - 1].id;
+		}
+
+		return leaf->prev != nullptr ? leaf->prev->entries[leaf->prev->count - 1].id : -1;
+	}
+
+	/*
+	 * Exchanges the positions of two segments, as when the sweep line passes their crossing point. Only the entries
+	 * move; the tree shape does not change.
+	 */
+	void swap(int a, int b) {
+		Leaf* leafA = leafOf[a];
+		Leaf* leafB = leafOf[b];
+		int slotA = slotOf(leafA, a);
+		int slotB = slotOf(leafB, b);
+
+		StatusEntry entry = leafA->entries[slotA];
+		leafA->entries[slotA] = leafB->entries[slotB];
+		leafB->entries[slotB] = entry;
+		leafOf[a] = leafB;
+		leafOf[b] = leafA;
+
+		if (slotA == leafA->count - 1)
+		{
+			refreshMax(leafA);
+		}
+		if (slotB == leafB->count - 1)
+		{
+			refreshMax(leafB);
+		}
+	}
+
+	/*
+	 * Puts a segment in the place of one in the status, as when the sweep line reaches a vertex joining the two. The
+	 * new segment must have the same position along the sweep line, so the tree shape does not change.
+	 */
+	void replace(int id, StatusEntry entry) {
+		Leaf* leaf = leafOf[id];
+		int slot = slotOf(leaf, id);
+
+		leaf->entries[slot] = entry;
+		leafOf[id] = nullptr;
+		setLeafOf(entry.id, leaf);
+
+		if (slot == leaf->count - 1)
+		{
+			refreshMax(leaf);
+		}
+	}
+
+	// Entry of a segment in the status, which must contain it.
+	StatusEntry& entryOf(int id) {
+		Leaf* leaf = leafOf[id];
+		return leaf->entries[slotOf(leaf, id)];
+	}
+
+	// Ids of all segments in the status, from bottom to top.
+	vector<int> ids() {
+		vector<int> result;
+		if (root == nullptr)
+		{
+			return result;
+		}
+
+		void* node = root;
+		bool isLeaf = rootIsLeaf;
+		while (!isLeaf)
+		{
+			isLeaf = ((InnerNode*)node)->leafChildren;
+			node = ((InnerNode*)node)->children[0];
+		}
+
+		for (Leaf* leaf = (Leaf*)node; leaf != nullptr; leaf = leaf->next)
+		{
+			for (int i = 0; i < leaf->count; i++)
+			{
+				result.push_back(leaf->entries[i].id);
+			}
+		}
+
+		return result;
+	}
+
+	int getCount() {
+		return entryCount;
+	}
+
+	bool isEmpty() {
+		return entryCount == 0;
+	}
+};
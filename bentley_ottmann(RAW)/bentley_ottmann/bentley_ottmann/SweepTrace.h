@@ -0,0 +1,430 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Structures.h"
+#include "SweepEngine.h"
+
+/*
+ * Opt-in trace of a sweep, recording every processed event along with the event queue operations it caused, so that a
+ * slow or misbehaving input can be profiled offline without the rest of the program. Records go either straight to a
+ * file through a buffer, or to a ring buffer holding the last events that is saved when the sweep ends.
+ *
+ * A trace file is a TraceHeader, the segments of the sweep as four doubles each in id order, then TraceRecords.
+ */
+
+// What a trace record stands for. The first three are processed events and share the values of Type.
+enum class TraceOperation : uint32_t { LEFT, RIGHT, INTERSECTION, QUEUE_ADD, QUEUE_DELETE };
+
+struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t complete; // 0 if a ring buffer dropped the earliest records
+	uint64_t segmentCount;
+};
+
+struct TraceRecord {
+	double x;
+	double y;
+	uint32_t segmentId;
+	uint32_t otherId; // segment it intersects with, or NO_SEGMENT
+	uint32_t operation;
+	uint32_t statusSize; // segments on the sweep line once the event is processed
+	uint64_t startNs; // since the start of the sweep
+	uint64_t durationNs; // 0 for queue operations
+};
+
+/*
+ * An event is recorded when it starts being processed, ahead of the queue operations it causes, and completed with
+ * its duration when it ends, so that records are in the order of the operations a replay has to repeat.
+ */
+class SweepTrace {
+public:
+	static const uint32_t NO_SEGMENT = 0xFFFFFFFF;
+	static const uint32_t VERSION = 1;
+
+private:
+	string path;
+	FILE* file; // nullptr for a ring buffer
+	vector<TraceRecord> records;
+	size_t ringCapacity;
+	uint64_t recorded;
+	uint64_t openEvent; // number of the record of the event being processed, or NO_EVENT
+	vector<double> coordinates;
+	chrono::steady_clock::time_point origin;
+
+	static const uint64_t NO_EVENT = ~0ULL;
+
+	SweepTrace(string path, size_t ringCapacity) {
+		this->path = path;
+		this->ringCapacity = ringCapacity;
+		file = nullptr;
+		recorded = 0;
+		openEvent = NO_EVENT;
+	}
+
+	static uint32_t idOf(LineSegment* segment) {
+		return segment != nullptr ? (uint32_t)segment->getId() : NO_SEGMENT;
+	}
+
+	void writeHeader(FILE* out, bool complete) {
+		TraceHeader header;
+		memcpy(header.magic, "BOTRACE", 8);
+		header.version = VERSION;
+		header.complete = complete ? 1 : 0;
+		header.segmentCount = coordinates.size() / 4;
+		fwrite(&header, sizeof(header), 1, out);
+		fwrite(coordinates.data(), sizeof(double), coordinates.size(), out);
+	}
+
+	void flush() {
+		fwrite(records.data(), sizeof(TraceRecord), records.size(), file);
+		records.clear();
+	}
+
+	void add(const TraceRecord& record) {
+		if (file != nullptr)
+		{
+			records.push_back(record);
+			if (records.size() >= 4096 && openEvent == NO_EVENT)
+			{
+				flush();
+			}
+		}
+		else if (records.size() < ringCapacity)
+		{
+			records.push_back(record);
+		}
+		else
+		{
+			records[recorded % ringCapacity] = record;
+		}
+
+		recorded++;
+	}
+
+	// Record with the given number, or nullptr if it has already been written out or overwritten.
+	TraceRecord* recordNumber(uint64_t number) {
+		if (file != nullptr)
+		{
+			uint64_t first = recorded - records.size();
+			return number >= first ? &records[(size_t)(number - first)] : nullptr;
+		}
+
+		return recorded - number <= ringCapacity ? &records[(size_t)(number % ringCapacity)] : nullptr;
+	}
+
+	uint64_t sinceOrigin(chrono::steady_clock::time_point t) {
+		return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(t - origin).count();
+	}
+
+public:
+	// Writes every record to the file at path as the sweep goes.
+	static SweepTrace* toFile(string path) {
+		return new SweepTrace(path, 0);
+	}
+
+	// Keeps the last capacity records, written to the file at path by finish.
+	static SweepTrace* toRing(string path, size_t capacity) {
+		return new SweepTrace(path, capacity > 0 ? capacity : 1);
+	}
+
+	~SweepTrace() {
+		if (file != nullptr)
+		{
+			fclose(file);
+		}
+	}
+
+	// Starts the trace of a sweep over segments, which must already have their ids.
+	bool start(vector<LineSegment*>& segments) {
+		coordinates = toCoordinates(segments);
+
+		if (ringCapacity == 0)
+		{
+			if (fopen_s(&file, path.c_str(), "wb") != 0 || file == nullptr)
+			{
+				cerr << "Cannot write trace file " << path << endl;
+				file = nullptr;
+				return false;
+			}
+			writeHeader(file, true);
+		}
+
+		records.clear();
+		recorded = 0;
+		openEvent = NO_EVENT;
+		origin = chrono::steady_clock::now();
+		return true;
+	}
+
+	chrono::steady_clock::time_point now() {
+		return chrono::steady_clock::now();
+	}
+
+	// Records an event of the sweep as it starts being processed.
+	void beginEvent(Event& e) {
+		openEvent = recorded;
+		add({ e.getX(), e.getY(), idOf(e.getSegment()), idOf(e.getIntersectionSegment()), (uint32_t)e.getEventType(),
+			0, sinceOrigin(now()), 0 });
+	}
+
+	// Completes the record of the event being processed with its duration and the resulting status size.
+	void endEvent(int statusSize) {
+		TraceRecord* record = recordNumber(openEvent);
+		if (record != nullptr)
+		{
+			record->durationNs = sinceOrigin(now()) - record->startNs;
+			record->statusSize = (uint32_t)statusSize;
+		}
+
+		openEvent = NO_EVENT;
+		if (file != nullptr && records.size() >= 4096)
+		{
+			flush();
+		}
+	}
+
+	// Records an intersection event added to the event queue.
+	void queueAdd(Event& e) {
+		add({ e.getX(), e.getY(), idOf(e.getSegment()), idOf(e.getIntersectionSegment()),
+			(uint32_t)TraceOperation::QUEUE_ADD, 0, sinceOrigin(now()), 0 });
+	}
+
+	// Records a deletion of the event at a point from the event queue.
+	void queueDelete(Point p) {
+		add({ p.getX(), p.getY(), NO_SEGMENT, NO_SEGMENT, (uint32_t)TraceOperation::QUEUE_DELETE, 0,
+			sinceOrigin(now()), 0 });
+	}
+
+	// Ends the trace, writing the ring buffer out if there is one.
+	void finish() {
+		if (file != nullptr)
+		{
+			flush();
+			fclose(file);
+			file = nullptr;
+			return;
+		}
+
+		FILE* out;
+		if (fopen_s(&out, path.c_str(), "wb") != 0 || out == nullptr)
+		{
+			cerr << "Cannot write trace file " << path << endl;
+			return;
+		}
+
+		bool complete = recorded <= ringCapacity;
+		writeHeader(out, complete);
+
+		// Oldest record first.
+		size_t first = complete ? 0 : (size_t)(recorded % ringCapacity);
+		fwrite(records.data() + first, sizeof(TraceRecord), records.size() - first, out);
+		fwrite(records.data(), sizeof(TraceRecord), first, out);
+		fclose(out);
+	}
+
+	uint64_t getRecordCount() {
+		return recorded;
+	}
+};
+
+/*
+ * A trace read back from a file.
+ */
+struct LoadedTrace {
+	TraceHeader header;
+	vector<LineSegment*> segments;
+	vector<TraceRecord> records;
+};
+
+inline bool loadTrace(string path, LoadedTrace& trace) {
+	FILE* in;
+	if (fopen_s(&in, path.c_str(), "rb") != 0 || in == nullptr)
+	{
+		cerr << "Cannot read trace file " << path << endl;
+		return false;
+	}
+
+	if (fread(&trace.header, sizeof(TraceHeader), 1, in) != 1 || memcmp(trace.header.magic, "BOTRACE", 8) != 0
+		|| trace.header.version != SweepTrace::VERSION)
+	{
+		cerr << path << " is not a sweep trace" << endl;
+		fclose(in);
+		return false;
+	}
+
+	vector<double> coordinates((size_t)trace.header.segmentCount * 4);
+	if (fread(coordinates.data(), sizeof(double), coordinates.size(), in) != coordinates.size())
+	{
+		cerr << "Trace file " << path << " is truncated" << endl;
+		fclose(in);
+		return false;
+	}
+
+	trace.segments.clear();
+	for (size_t i = 0; i < coordinates.size(); i += 4)
+	{
+		trace.segments.push_back(new LineSegment(Point(coordinates[i], coordinates[i + 1]),
+			Point(coordinates[i + 2], coordinates[i + 3])));
+	}
+
+	TraceRecord record;
+	trace.records.clear();
+	while (fread(&record, sizeof(TraceRecord), 1, in) == 1)
+	{
+		trace.records.push_back(record);
+	}
+
+	fclose(in);
+	return true;
+}
+
+inline const char* traceOperationName(uint32_t operation) {
+	static const char* names[] = { "LEFT", "RIGHT", "INTERSECTION", "QUEUE_ADD", "QUEUE_DELETE" };
+	return operation < 5 ? names[operation] : "UNKNOWN";
+}
+
+/*
+ * Writes the processed events of a trace in the Chrome trace event format, as complete events on a single thread,
+ * for chrome://tracing or Perfetto. Queue operations are written as instant events.
+ */
+inline bool exportChromeTrace(LoadedTrace& trace, string path) {
+	FILE* out;
+	if (fopen_s(&out, path.c_str(), "w") != 0 || out == nullptr)
+	{
+		cerr << "Cannot write " << path << endl;
+		return false;
+	}
+
+	fprintf(out, "{\"traceEvents\": [\n");
+	for (size_t i = 0; i < trace.records.size(); i++)
+	{
+		TraceRecord& r = trace.records[i];
+		bool processed = r.operation <= (uint32_t)TraceOperation::INTERSECTION;
+
+		fprintf(out, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%s\", \"ts\": %.3f, ", i > 0 ? ",\n" : "",
+			traceOperationName(r.operation), processed ? "event" : "queue", processed ? "X" : "i", r.startNs / 1000.0);
+		if (processed)
+		{
+			fprintf(out, "\"dur\": %.3f, ", r.durationNs / 1000.0);
+		}
+		else
+		{
+			fprintf(out, "\"s\": \"t\", ");
+		}
+		fprintf(out, "\"pid\": 1, \"tid\": 1, \"args\": {\"x\": %.17g, \"y\": %.17g, \"segment\": %d, \"other\": %d, "
+			"\"status_size\": %u}}", r.x, r.y, (int)r.segmentId, (int)r.otherId, r.statusSize);
+	}
+	fprintf(out, "\n]}\n");
+	fclose(out);
+	return true;
+}
+
+/*
+ * Re-runs the event queue and sweep line operations of a trace on a fresh EventQueue and BinarySearchTree, timing
+ * each kind of operation, so that the sweep can be profiled without reading the input or reporting output. A trace
+ * from a ring buffer that dropped records starts mid-sweep, so operations on segments it never inserted are skipped.
+ * Prints one JSON object per operation kind.
+ */
+inline void replayTrace(LoadedTrace& trace) {
+	storeSegments(trace.segments);
+	EventQueue queue(1);
+	BinarySearchTree sweepLine;
+	vector<bool> active(trace.segments.size(), false);
+	double totalNs[5] = {};
+	long long counts[5] = {};
+	long long skipped = 0;
+
+	auto segmentOf = [&trace](uint32_t id) {
+		return id < trace.segments.size() ? trace.segments[id] : nullptr;
+	};
+
+	for (TraceRecord& r : trace.records)
+	{
+		Point p(r.x, r.y);
+		LineSegment* segment = segmentOf(r.segmentId);
+		LineSegment* other = segmentOf(r.otherId);
+		bool done = true;
+		auto start = chrono::steady_clock::now();
+
+		switch ((TraceOperation)r.operation)
+		{
+		case TraceOperation::QUEUE_ADD:
+			queue.add(Event(p, segment, other, Type::INTERSECTION));
+			break;
+		case TraceOperation::QUEUE_DELETE:
+			queue.deleteEventPoint(p);
+			break;
+		case TraceOperation::LEFT:
+		{
+			Node* current = sweepLine.add(segment, p);
+			current->getSuccessor();
+			current->getPredecessor();
+			active[r.segmentId] = true;
+			break;
+		}
+		case TraceOperation::RIGHT:
+			if (!active[r.segmentId])
+			{
+				done = false;
+				break;
+			}
+			sweepLine.findNode(segment, p);
+			sweepLine.remove(segment, p);
+			active[r.segmentId] = false;
+			break;
+		case TraceOperation::INTERSECTION:
+		{
+			if (!queue.isEmpty())
+			{
+				queue.removeMin();
+			}
+			if (segment == nullptr || other == nullptr || !active[r.segmentId] || !active[r.otherId])
+			{
+				done = false;
+				break;
+			}
+
+			bool segmentAbove = segment->compareTo(other, p) == 1;
+			Node* above = sweepLine.findNode(segmentAbove ? segment : other, p);
+			Node* below = sweepLine.findNode(segmentAbove ? other : segment, p);
+			if (above == nullptr || below == nullptr)
+			{
+				done = false;
+				break;
+			}
+			sweepLine.swapNodeInfo(above, below);
+			break;
+		}
+		default:
+			done = false;
+		}
+
+		double ns = (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		if (done)
+		{
+			totalNs[r.operation] += ns;
+			counts[r.operation]++;
+		}
+		else
+		{
+			skipped++;
+		}
+	}
+
+	for (uint32_t operation = 0; operation < 5; operation++)
+	{
+		cout << "{\"replay\": \"" << traceOperationName(operation) << "\", \"count\": " << counts[operation]
+			<< ", \"total_ms\": " << totalNs[operation] / 1e6 << ", \"mean_ns\": "
+			<< (counts[operation] > 0 ? totalNs[operation] / counts[operation] : 0.0) << "}" << endl;
+	}
+
+	if (skipped > 0)
+	{
+		cout << "{\"replay\": \"skipped\", \"count\": " << skipped << "}" << endl;
+	}
+}
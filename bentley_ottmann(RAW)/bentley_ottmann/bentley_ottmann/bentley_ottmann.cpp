@@ -3,185 +3,727 @@
 
 #include <iostream>
 #include "Structures.h"
+#include "IntersectionKernel.h"
+#include "Benchmark.h"
+#include "ExternalSweep.h"
+#include "BoundingBoxFilter.h"
+#include "SweepEngine.h"
+#include "SweepTrace.h"
+#include "SpatialIndex.h"
+#include "InversionSweep.h"
+#include "Arrangement.h"
+#include "SnapRounding.h"
+#include "Pipeline.h"
+#include "SweepServer.h"
+#include "SweepDispatcher.h"
+#include "PersistentStatus.h"
+#include <memory>
+#include <random>
+#include <string>
 #include <vector>
 using namespace std;
 
-vector<Event*> events;
+vector<Event> events;
+EndpointStream* endpoints;
 EventQueue* eq;
 BinarySearchTree* sweepLine;
+BoundingBoxFilter* boxFilter = nullptr; // set by --prefilter
+SweepTrace* sweepTrace = nullptr; // set by --trace or --trace-ring
+Arrangement* arrangement = nullptr; // set by --arrangement
+SnapRounding* snapRounding = nullptr; // set by --snap
+int activeCount; // segments on the sweep line
 int tot;
 
 void init(vector<LineSegment*> segments){
+	// Segments left out of the sweep are still snap rounded, so they are handed over first.
+	if (snapRounding != nullptr)
+	{
+		snapRounding->start(segments);
+	}
+
+	// Segments whose bounding box overlaps no other one cannot intersect anything and never enter the sweep.
+	if (boxFilter != nullptr)
+	{
+		segments = boxFilter->filter(segments);
+	}
 	int segmentCount = segments.size();
-	events = vector<Event*>(segmentCount * 2);
+	storeSegments(segments);
+	sweepMemory.reset();
+	sweepMemory.track(MemoryCategory::SEGMENTS,
+		segmentCount * sizeof(LineSegment) + segmentStore.capacity() * sizeof(LineSegment*), segmentCount);
+	events = vector<Event>(segmentCount * 2);
+	sweepMemory.allocate(MemoryCategory::EVENTS, events.size() * sizeof(Event), (long long)events.size());
 	tot = 0;
+	activeCount = 0;
+
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->start(segments);
+	}
+
+	if (arrangement != nullptr)
+	{
+		arrangement->start();
+	}
 
 	int j = 0;
 	for (int i = 0; i < segmentCount; i++)
 	{
-		events[j] = new Event(segments[i]->getLeftEndpoint(), segments[i], Type::LEFT);
-		events[j + 1] = new Event(segments[i]->getRightEndpoint(), segments[i], Type::RIGHT);
+		events[j] = Event(segments[i]->getLeftEndpoint(), segments[i], Type::LEFT);
+		events[j + 1] = Event(segments[i]->getRightEndpoint(), segments[i], Type::RIGHT);
 		j += 2;
 	}
 
-	eq = new EventQueue(events);
+	endpoints = new EndpointStream(events);
+
+	// The stream keeps its own sorted copy of the endpoint events.
+	sweepMemory.release(MemoryCategory::EVENTS, events.size() * sizeof(Event), (long long)events.size());
+	vector<Event>().swap(events);
+
+	eq = new EventQueue(segmentCount + 1);
 	sweepLine = new BinarySearchTree();
+	intersectionCache = new IntersectionCache(segmentCount);
 }
 
-vector<Point> findIntersections(){
-	vector<Point> intersections;
+// Takes the next event in sweep order, from either the sorted endpoints or the queue of intersection events.
+Event nextEvent() {
+	if (eq->isEmpty())
+	{
+		return endpoints->next();
+	}
+	else if (endpoints->isEmpty() || precedes(eq->min().getEventPoint(), endpoints->peek().getEventPoint()))
+	{
+		return eq->removeMin();
+	}
+	else
+	{
+		return endpoints->next();
+	}
+}
+
+// Adds an intersection event to the queue, recording it in the trace if there is one.
+void schedule(Event e) {
+	eq->add(e);
+	sweepMemory.pending(eq->getLength());
+
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->queueAdd(e);
+	}
+}
+
+// Deletes the intersection event at a point from the queue, recording it in the trace if there is one.
+void unschedule(Point p) {
+	eq->deleteEventPoint(p);
+
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->queueDelete(p);
+	}
+}
+
+bool sweepDone() {
+	return eq->isEmpty() && endpoints->isEmpty();
+}
+
+// Processes the next event of the sweep. Returns true if it was an intersection, which is then stored in found.
+bool sweepStep(Point& found) {
+	Event event = nextEvent();
+	bool crossed = false;
+
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->beginEvent(event);
+	}
 
-	while (!eq->isEmpty())
+	if (event.getEventType() == Type::LEFT)
 	{
-		Event* event = eq->removeMin();
+		Node* current = sweepLine->add(event.getSegment(), event.getEventPoint());
+		activeCount++;
 
-		if (event->getEventType() == Type::LEFT)
+		if (arrangement != nullptr)
 		{
-			Node* current = sweepLine->add(event->getSegment(), event->getEventPoint());
-			Node* above = current->getSuccessor();
-			Node* below = current->getPredecessor();
+			arrangement->openSegment(event.getSegment());
+		}
 
-			if (above != nullptr)
-			{
-				Point* crossingPoint = current->getSegment()->getIntersectionPointWith(above->getSegment());
+		Node* above = current->getSuccessor();
+		Node* below = current->getPredecessor();
 
-				if (crossingPoint != nullptr)
-				{
-					eq->add(new Event(*crossingPoint, current->getSegment(), above->getSegment(), Type::INTERSECTION));
-				}
-			}
+		if (above != nullptr)
+		{
+			Point crossingPoint;
 
-			if (below != nullptr)
+			if (findCrossing(current->getSegment(), above->getSegment(), crossingPoint))
 			{
-				Point* crossingPoint = current->getSegment()->getIntersectionPointWith(below->getSegment());
+				schedule(Event(crossingPoint, current->getSegment(), above->getSegment(), Type::INTERSECTION));
+			}
+		}
 
-				if (crossingPoint != nullptr)
-				{
-					eq->add(new Event(*crossingPoint, current->getSegment(), below->getSegment(),
-						Type::INTERSECTION));
+		if (below != nullptr)
+		{
+			Point crossingPoint;
+
+			if (findCrossing(current->getSegment(), below->getSegment(), crossingPoint))
+			{
+				schedule(Event(crossingPoint, current->getSegment(), below->getSegment(),
+					Type::INTERSECTION));
 
-				}
 			}
+		}
 
-			if (above != nullptr && below != nullptr)
-			{
-				Point* crossingPoint = above->getSegment()->getIntersectionPointWith(below->getSegment());
+		if (above != nullptr && below != nullptr)
+		{
+			Point crossingPoint;
 
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->deleteEventPoint(*crossingPoint);
-				}
+			if (findCrossing(above->getSegment(), below->getSegment(), crossingPoint)
+				&& crossingPoint.getX() > event.getEventPoint().getX())
+			{
+				unschedule(crossingPoint);
 			}
+		}
+
+	}
+	else if (event.getEventType() == Type::RIGHT)
+	{
+		// event.getSegment().setBoundaryColor(Color.red);
+		// Tester.frame.repaint();
+
+		// The neighbours are kept as segments, as their nodes may be freed or reused by the removal.
+		Node* removed = sweepLine->locateNode(event.getSegment(), event.getEventPoint());
+		LineSegment* above = nullptr;
+		LineSegment* below = nullptr;
 
+		if (removed != nullptr)
+		{
+			above = removed->getSuccessor() != nullptr ? removed->getSuccessor()->getSegment() : nullptr;
+			below = removed->getPredecessor() != nullptr ? removed->getPredecessor()->getSegment() : nullptr;
+			sweepLine->removeNode(removed);
+			activeCount--;
 		}
-		else if (event->getEventType() == Type::RIGHT)
+
+		if (arrangement != nullptr)
 		{
-			// event.getSegment().setBoundaryColor(Color.red);
-			// Tester.frame.repaint();
+			arrangement->closeSegment(event.getSegment());
+		}
 
-			Node* removed = sweepLine->findNode(event->getSegment(), event->getEventPoint());
-			Node* above = removed->getSuccessor();
-			Node* below = removed->getPredecessor();
+		intersectionCache->retire(event.getSegment());
 
-			sweepLine->remove(event->getSegment(), event->getEventPoint());
+		if (above != nullptr && below != nullptr)
+		{
+			Point crossingPoint;
 
-			if (above != nullptr && below != nullptr)
+			if (findCrossing(above, below, crossingPoint) && crossingPoint.getX() > event.getEventPoint().getX())
 			{
-				Point* crossingPoint = above->getSegment()->getIntersectionPointWith(below->getSegment());
-
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->add(new Event(*crossingPoint, above->getSegment(), below->getSegment(),
-						Type::INTERSECTION));
+				schedule(Event(crossingPoint, above, below, Type::INTERSECTION));
 
-				}
 			}
 		}
+	}
+	else
+	{
+		// Report the intersecting pair.
+		++tot;
+		found = event.getEventPoint();
+		crossed = true;
+
+		if (snapRounding != nullptr)
+		{
+			snapRounding->addCrossing(event.getEventPoint());
+		}
+
+		LineSegment* aboveSegment, *belowSegment;
+
+		if (event.getSegment()->compareTo(event.getIntersectionSegment(), event.getEventPoint()) == 1)
+		{
+			aboveSegment = event.getSegment();
+			belowSegment = event.getIntersectionSegment();
+		}
 		else
 		{
-			// Report the intersecting pair.
-			++tot;
-			intersections.push_back(event->getEventPoint());
+			aboveSegment = event.getIntersectionSegment();
+			belowSegment = event.getSegment();
+		}
 
-			LineSegment* aboveSegment, *belowSegment;
+		Node* above = sweepLine->locateNode(aboveSegment, event.getEventPoint());
+		Node* below = sweepLine->locateNode(belowSegment, event.getEventPoint());
 
-			if (event->getSegment()->compareTo(event->getIntersectionSegment(), event->getEventPoint()) == 1)
-			{
-				aboveSegment = event->getSegment();
-				belowSegment = event->getIntersectionSegment();
-			}
-			else
+		if (arrangement != nullptr)
+		{
+			arrangement->cross(belowSegment, aboveSegment, event.getEventPoint());
+		}
+
+		// The comparison ties at a point shared by more segments, so the status decides which of the two is below.
+		if (above != nullptr && below != nullptr && above->getSuccessor() == below)
+		{
+			swap(above, below);
+		}
+
+		// A pair that is no longer adjacent was reordered by an earlier swap at the same point; it is reported, but
+		// swapping it again would undo that order.
+		if (above == nullptr || below == nullptr || below->getSuccessor() != above)
+		{
+			if (sweepTrace != nullptr)
 			{
-				aboveSegment = event->getIntersectionSegment();
-				belowSegment = event->getSegment();
+				sweepTrace->endEvent(activeCount);
 			}
 
-			Node* above = sweepLine->findNode(aboveSegment, event->getEventPoint());
-			Node* below = sweepLine->findNode(belowSegment, event->getEventPoint());
-			sweepLine->swapNodeInfo(above, below);
+			return crossed;
+		}
+
+		sweepLine->swapNodeInfo(above, below);
 
-			Node* top = above->getSuccessor();
-			Node* bottom = below->getPredecessor();
+		Node* top = above->getSuccessor();
+		Node* bottom = below->getPredecessor();
 
-			if (top != nullptr)
+		if (top != nullptr)
+		{
+			Point crossingPoint;
+
+			if (findCrossing(above->getSegment(), top->getSegment(), crossingPoint)
+				&& crossingPoint.getX() > event.getEventPoint().getX())
 			{
-				Point* crossingPoint = above->getSegment()->getIntersectionPointWith(top->getSegment());
+				schedule(Event(crossingPoint, above->getSegment(), top->getSegment(), Type::INTERSECTION));
 
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->add(new Event(*crossingPoint, above->getSegment(), top->getSegment(), Type::INTERSECTION));
+			}
 
-				}
+			if (findCrossing(below->getSegment(), top->getSegment(), crossingPoint)
+				&& crossingPoint.getX() > event.getEventPoint().getX())
+			{
+				unschedule(crossingPoint);
+			}
+		}
 
-				crossingPoint = below->getSegment()->getIntersectionPointWith(top->getSegment());
+		if (bottom != nullptr)
+		{
+			Point crossingPoint;
+
+			if (findCrossing(below->getSegment(), bottom->getSegment(), crossingPoint)
+				&& crossingPoint.getX() > event.getEventPoint().getX())
+			{
+				schedule(Event(crossingPoint, below->getSegment(), bottom->getSegment(),
+					Type::INTERSECTION));
 
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->deleteEventPoint(*crossingPoint);
-				}
 			}
 
-			if (bottom != nullptr)
+			if (findCrossing(above->getSegment(), bottom->getSegment(), crossingPoint)
+				&& crossingPoint.getX() > event.getEventPoint().getX())
 			{
-				Point* crossingPoint = below->getSegment()->getIntersectionPointWith(bottom->getSegment());
+				unschedule(crossingPoint);
+			}
+		}
+	}
 
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->add(new Event(*crossingPoint, below->getSegment(), bottom->getSegment(),
-						Type::INTERSECTION));
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->endEvent(activeCount);
+	}
 
-				}
+	return crossed;
+}
 
-				crossingPoint = above->getSegment()->getIntersectionPointWith(bottom->getSegment());
+// Releases the sweep state of init, whether or not the sweep ran to the end.
+void releaseSweep() {
+	delete endpoints;
+	delete eq;
+	delete sweepLine;
+	delete intersectionCache;
+	endpoints = nullptr;
+	eq = nullptr;
+	sweepLine = nullptr;
+	intersectionCache = nullptr;
+}
 
-				if (crossingPoint != nullptr && crossingPoint->getX() > event->getEventPoint().getX())
-				{
-					eq->deleteEventPoint(*crossingPoint);
-				}
-			}
+vector<Point> findIntersections(){
+	vector<Point> intersections;
+	Point found;
+
+	while (!sweepDone())
+	{
+		if (sweepStep(found))
+		{
+			intersections.push_back(found);
+			sweepMemory.track(MemoryCategory::OUTPUT, intersections.capacity() * sizeof(Point),
+				(long long)intersections.size());
 		}
 	}
 	cout << "Total intersections: " << tot;
 	return intersections;
 }
 
+/*
+ * Pulls the intersections of the segments one at a time in sweep order, running the sweep only as far as the next
+ * one. Nothing is buffered, so memory does not grow with the number of intersections taken, and stopping early
+ * releases the sweep state without processing the remaining events. The sweep state is global, so one generator runs
+ * at a time, and none alongside findIntersections.
+ */
+class IntersectionGenerator {
+public:
+	IntersectionGenerator(vector<LineSegment*>& segments) {
+		init(segments);
+	}
+
+	~IntersectionGenerator() {
+		stop();
+	}
+
+	// Advances the sweep to the next intersection. Returns false once there are none left.
+	bool next(Point& intersection) {
+		while (eq != nullptr && !sweepDone())
+		{
+			if (sweepStep(intersection))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void stop() {
+		if (eq != nullptr)
+		{
+			releaseSweep();
+		}
+	}
+};
+
+// Runs the sweep without keeping the intersections, leaving the figures of its memory use in sweepMemory.
+long long countIntersections(vector<LineSegment*>& segments) {
+	IntersectionGenerator generator(segments);
+	Point p;
+	long long count = 0;
+
+	while (generator.next(p))
+	{
+		count++;
+	}
+
+	return count;
+}
+
 void setSegments(vector<LineSegment*> segments){
 	int segmentCount = segments.size();
-	events = vector<Event*>(segmentCount * 2);
+	storeSegments(segments);
+	events = vector<Event>(segmentCount * 2);
 
 	int j = 0;
 	for (int i = 0; i < segmentCount; i++)
 	{
-		events[j] = new Event(segments[i]->getLeftEndpoint(), segments[i], Type::LEFT);
-		events[j + 1] = new Event(segments[i]->getRightEndpoint(), segments[i], Type::RIGHT);
+		events[j] = Event(segments[i]->getLeftEndpoint(), segments[i], Type::LEFT);
+		events[j + 1] = Event(segments[i]->getRightEndpoint(), segments[i], Type::RIGHT);
 		j += 2;
 	}
 
-	eq = new EventQueue(events);
+	endpoints = new EndpointStream(events);
+	eq = new EventQueue(segmentCount + 1);
 }
 
-int main()
+/*
+ * Reads chains for --chains: the number of chains, then for each its vertex count, 1 if it is a closed ring or 0 if
+ * not, and the x and y of its vertices.
+ */
+bool loadChains(const char* path, vector<double>& vertices, vector<uint32_t>& starts, vector<bool>& closed) {
+	FILE* file;
+	if (fopen_s(&file, path, "r") != 0)
+	{
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+
+	int count;
+	bool valid = fscanf_s(file, "%d", &count) == 1 && count >= 0;
+	for (int c = 0; valid && c < count; c++)
+	{
+		int vertexCount, ring;
+		valid = fscanf_s(file, "%d%d", &vertexCount, &ring) == 2 && vertexCount >= 0;
+		starts.push_back((uint32_t)(vertices.size() / 2));
+		closed.push_back(ring != 0);
+
+		for (int v = 0; valid && v < vertexCount; v++)
+		{
+			double x, y;
+			valid = fscanf_s(file, "%lf%lf", &x, &y) == 2;
+			vertices.push_back(x);
+			vertices.push_back(y);
+		}
+	}
+	starts.push_back((uint32_t)(vertices.size() / 2));
+	fclose(file);
+
+	if (!valid)
+	{
+		cerr << "Malformed chain file " << path << endl;
+	}
+	return valid;
+}
+
+/*
+ * Checks SweepEngine against brute force for --validate on a generated grid layout: horizontal, vertical and diagonal
+ * segments with integer endpoints on a small grid, so that many of them share endpoints, cross at endpoints, or meet
+ * three or more at one point.
+ */
+bool validateGrid() {
+	mt19937 generator(33);
+	uniform_int_distribution<int> position(0, 99);
+	uniform_int_distribution<int> length(1, 30);
+	vector<double> coordinates;
+	vector<LineSegment*> segments;
+	for (int i = 0; i < 3000; i++)
+	{
+		double x = position(generator), y = position(generator), l = length(generator);
+		double x2 = i % 3 == 1 ? x : x + l;
+		double y2 = i % 3 == 0 ? y : i % 3 == 1 ? y + l : y + (i % 2 == 0 ? l : -l);
+		coordinates.insert(coordinates.end(), { x, y, x2, y2 });
+		segments.push_back(new LineSegment(Point(x, y), Point(x2, y2)));
+	}
+
+	long long expected = bruteForceIntersectionCount(segments);
+	SweepEngine<double, DefaultTolerance, CountSink> engine;
+	engine.run(SegmentView<double>(coordinates.data(), segments.size()));
+	cout << endl << "Grid layout intersections: " << engine.getSink().count;
+
+	for (LineSegment* segment : segments)
+	{
+		delete segment;
+	}
+
+	if (expected != engine.getSink().count)
+	{
+		cerr << "Validation failed: SweepEngine found " << engine.getSink().count
+			<< " intersections on the grid layout, brute force found " << expected << endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
 {
+	if (argc > 2 && string(argv[1]) == "--bench")
+	{
+		return runBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+	}
+
+	if (argc > 3 && string(argv[1]) == "--external")
+	{
+		// --external <input> <output> [memory budget in MB] [directory for temporary files]
+		size_t budget = (size_t)(argc > 4 ? atoi(argv[4]) : 256) << 20;
+		ExternalSweep sweep(budget, argc > 5 ? argv[5] : ".");
+		long long count = sweep.run(argv[2], argv[3]);
+		if (count < 0)
+		{
+			return 1;
+		}
+
+		cout << "Total intersections: " << count << endl;
+		cout << "Peak active segments: " << sweep.getPeakActiveSegments() << endl;
+		cout << "Intersection events spilled to disk: " << sweep.getSpilledEventCount() << endl;
+		cout << "Bands of y swept: " << sweep.getBandCount() << endl;
+		return 0;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--pipeline")
+	{
+		// --pipeline <input> [<input> ...] writes the intersections of each input to <input>.out
+		vector<string> inputs(argv + 2, argv + argc);
+		auto makeSegment = [](double x1, double y1, double x2, double y2) {
+			return new LineSegment(Point(x1, y1), Point(x2, y2));
+		};
+		SweepPipeline<LineSegment, decltype(makeSegment)> pipeline(inputs, makeSegment);
+		auto start = chrono::high_resolution_clock::now();
+
+		pipeline.run([](vector<LineSegment*>& segments, SweepPipeline<LineSegment, decltype(makeSegment)>& output) {
+			IntersectionGenerator generator(segments);
+			Point p;
+			while (generator.next(p))
+			{
+				output.emit(p.getX(), p.getY());
+			}
+		});
+
+		// A file that could not be read fails the run, although the other files are still written.
+		int result = 0;
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			cout << inputs[i] << ": " << pipeline.getCounts()[i] << " intersections" << endl;
+			if (pipeline.getCounts()[i] < 0)
+			{
+				result = 1;
+			}
+		}
+		cout << "Parse: " << pipeline.getParseMs() << " ms, sweep: " << pipeline.getSweepMs() << " ms, write: "
+			<< pipeline.getWriteMs() << " ms, wall clock: " << elapsedNs(start) / 1e6 << " ms" << endl;
+		return result;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--serve")
+	{
+		// --serve <socket path, or - for stdin and stdout> [worker threads] [dataset ...], datasets numbered from 0
+		SweepServer server(argc > 3 ? atoi(argv[3]) : thread::hardware_concurrency());
+		for (int i = 4; i < argc; i++)
+		{
+			if (server.loadDataset(argv[i]) < 0)
+			{
+				return 1;
+			}
+		}
+
+		if (string(argv[2]) == "-")
+		{
+			server.serveStream(stdin, stdout);
+			return 0;
+		}
+
+		return server.serveSocket(argv[2]) ? 0 : 1;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--chains")
+	{
+		// --chains <file> intersects the edges of polylines and polygon rings, vertex events shared between edges
+		vector<double> vertices;
+		vector<uint32_t> starts;
+		vector<bool> closed;
+		if (!loadChains(argv[2], vertices, starts, closed))
+		{
+			return 1;
+		}
+
+		unique_ptr<bool[]> closedFlags(new bool[closed.size()]);
+		copy(closed.begin(), closed.end(), closedFlags.get());
+		ChainView<double> chains(vertices.data(), starts.data(), closedFlags.get(), closed.size());
+
+		SweepEngine<double, DefaultTolerance, CollectSink<double>> engine;
+		engine.runChains(chains);
+		for (SweepPoint<double>& p : engine.getSink().points)
+		{
+			cout << "(" << p.x << ", " << p.y << ")" << endl;
+		}
+		cout << "Total intersections: " << engine.getSink().points.size() << endl;
+
+		// The same edges as separate segments, for the event count and as a check.
+		vector<double> edges;
+		for (size_t c = 0; c < chains.size(); c++)
+		{
+			for (uint32_t v = chains.first(c); v < chains.end(c); v++)
+			{
+				uint32_t next = v + 1 < chains.end(c) ? v + 1 : chains.first(c);
+				if (v + 1 < chains.end(c) || chains.isClosed(c))
+				{
+					edges.insert(edges.end(), chains.vertex(v), chains.vertex(v) + 2);
+					edges.insert(edges.end(), chains.vertex(next), chains.vertex(next) + 2);
+				}
+			}
+		}
+
+		SweepEngine<double, DefaultTolerance, CountSink> separate;
+		separate.run(SegmentView<double>(edges.data(), edges.size() / 4));
+		cout << "Events: " << engine.getEventCount() << " vertices, against " << separate.getEventCount()
+			<< " endpoints of " << edges.size() / 4 << " separate edges" << endl;
+		cout << "Intersections of separate edges: " << separate.getSink().count << endl;
+		return 0;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--replay")
+	{
+		// --replay <trace> [Chrome trace JSON to write]
+		LoadedTrace trace;
+		if (!loadTrace(argv[2], trace))
+		{
+			return 1;
+		}
+
+		if (argc > 3 && !exportChromeTrace(trace, argv[3]))
+		{
+			return 1;
+		}
+
+		replayTrace(trace);
+		return 0;
+	}
+
+	// [--validate] [--trace <file> | --trace-ring <last events to keep> <file>] [--window <left bottom right top>]
+	// [--inversions] [--arrangement] [--snap <pixel size> <file>] [--first <number of intersections>]
+	// [--range <x0> <x1>] [--memory] [--dispatch] [--stab <x> [<y>]] [--prefilter]
+	bool validate = false;
+	bool inversions = false;
+	bool dispatch = false;
+	bool memory = false;
+	vector<double> window;
+	vector<double> range;
+	vector<double> stab;
+	string snapPath;
+	long long first = -1;
+	for (int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+
+		if (option == "--validate")
+		{
+			validate = true;
+		}
+		else if (option == "--trace" && i + 1 < argc)
+		{
+			sweepTrace = SweepTrace::toFile(argv[++i]);
+		}
+		else if (option == "--trace-ring" && i + 2 < argc)
+		{
+			size_t capacity = (size_t)atoll(argv[i + 1]);
+			sweepTrace = SweepTrace::toRing(argv[i + 2], capacity);
+			i += 2;
+		}
+		else if (option == "--prefilter")
+		{
+			boxFilter = new BoundingBoxFilter();
+		}
+		else if (option == "--arrangement")
+		{
+			arrangement = new Arrangement();
+		}
+		else if (option == "--snap" && i + 2 < argc)
+		{
+			snapRounding = new SnapRounding(atof(argv[i + 1]));
+			snapPath = argv[i + 2];
+			i += 2;
+		}
+		else if (option == "--first" && i + 1 < argc)
+		{
+			first = atoll(argv[++i]);
+		}
+		else if (option == "--inversions")
+		{
+			inversions = true;
+		}
+		else if (option == "--memory")
+		{
+			memory = true;
+		}
+		else if (option == "--dispatch")
+		{
+			dispatch = true;
+		}
+		else if (option == "--stab" && i + 1 < argc)
+		{
+			stab.push_back(atof(argv[++i]));
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				stab.push_back(atof(argv[++i]));
+			}
+		}
+		else if (option == "--range" && i + 2 < argc)
+		{
+			range.push_back(atof(argv[i + 1]));
+			range.push_back(atof(argv[i + 2]));
+			i += 2;
+		}
+		else if (option == "--window" && i + 4 < argc)
+		{
+			for (int j = 1; j <= 4; j++)
+			{
+				window.push_back(atof(argv[i + j]));
+			}
+			i += 4;
+		}
+	}
+
 	vector<LineSegment*> segments;
 
 	FILE* stream;
@@ -201,8 +743,170 @@ int main()
 		segments.push_back(segment);
 	}
 
+	if (!window.empty())
+	{
+		SpatialIndex index(segments);
+		vector<WindowIntersection> found = index.query(window[0], window[1], window[2], window[3]);
+
+		for (WindowIntersection& w : found)
+		{
+			cout << "(" << w.x << ", " << w.y << ")" << endl;
+		}
+		cout << "Window intersections: " << found.size();
+		return 0;
+	}
+
+	if (!range.empty())
+	{
+		vector<double> coordinates = toCoordinates(segments);
+
+		SweepEngine<double, DefaultTolerance, CollectSink<double>> engine;
+		engine.runRange(SegmentView<double>(coordinates.data(), segments.size()), range[0], range[1]);
+
+		for (SweepPoint<double>& p : engine.getSink().points)
+		{
+			cout << "(" << p.x << ", " << p.y << ")" << endl;
+		}
+		cout << "Range intersections: " << engine.getSink().points.size();
+		return 0;
+	}
+
+	if (!stab.empty())
+	{
+		vector<double> coordinates = toCoordinates(segments);
+
+		PersistentStatus status;
+		status.build(SegmentView<double>(coordinates.data(), segments.size()));
+
+		vector<uint32_t> ids;
+		status.stab(stab[0], ids);
+		for (uint32_t id : ids)
+		{
+			cout << id << endl;
+		}
+		cout << "Segments crossing x = " << stab[0] << ": " << ids.size();
+		if (stab.size() > 1)
+		{
+			cout << endl << "Above: " << status.above(stab[0], stab[1]) << ", below: "
+				<< status.below(stab[0], stab[1]);
+		}
+		return 0;
+	}
+
+	if (dispatch)
+	{
+		vector<double> coordinates = toCoordinates(segments);
+
+		SweepDispatcher dispatcher;
+		dispatcher.run(SegmentView<double>(coordinates.data(), segments.size()));
+
+		for (SweepPoint<double>& p : dispatcher.getPoints())
+		{
+			cout << "(" << p.x << ", " << p.y << ")" << endl;
+		}
+		cout << "Total intersections: " << dispatcher.getCount();
+		cout << endl << "Dispatch: " << dispatcher.getMetricsJson();
+		return 0;
+	}
+
+	if (inversions)
+	{
+		vector<Point> points = findIntersectionsByInversions(segments);
+		cout << "Total intersections: " << points.size();
+		return 0;
+	}
+
+	if (first >= 0)
+	{
+		IntersectionGenerator generator(segments);
+		Point p;
+		long long taken = 0;
+
+		while (taken < first && generator.next(p))
+		{
+			cout << "(" << p.getX() << ", " << p.getY() << ")" << endl;
+			taken++;
+		}
+		cout << "First intersections: " << taken;
+		return 0;
+	}
+
 	init(segments);
 
 	vector<Point> points = findIntersections();
+
+	if (sweepTrace != nullptr)
+	{
+		sweepTrace->finish();
+	}
+
+	if (arrangement != nullptr)
+	{
+		arrangement->finish();
+		cout << endl << "Arrangement: " << arrangement->getVertices().size() << " vertices, "
+			<< arrangement->getHalfEdges().size() / 2 << " edges, " << arrangement->getBoundedFaceCount()
+			<< " bounded faces" << (arrangement->isValid() ? "" : " (inconsistent)");
+	}
+
+	if (snapRounding != nullptr)
+	{
+		vector<GridSegment>& snapped = snapRounding->finish();
+		snapRounding->write(snapPath);
+		cout << endl << "Snap rounding: " << snapRounding->getHotPixelCount() << " hot pixels, " << snapped.size()
+			<< " grid segments";
+	}
+
+	if (memory)
+	{
+		cout << endl << "Memory: " << sweepMemory.toJson();
+		cerr << "Intersection cache hit rate: " << intersectionCache->getHitRate() * 100 << "% of "
+			<< intersectionCache->getLookups() << " lookups" << endl;
+	}
+
+	if (boxFilter != nullptr)
+	{
+		cerr << "Pruned segments: " << boxFilter->getPrunedFraction() * 100 << "%" << endl;
+	}
+
+	if (validate)
+	{
+		long long expected = bruteForceIntersectionCount(segments);
+		cout << endl << "Brute force intersections: " << expected;
+
+		vector<double> coordinates = toCoordinates(segments);
+
+		SweepEngine<double, DefaultTolerance, CountSink> engine;
+		engine.run(SegmentView<double>(coordinates.data(), segments.size()));
+		cout << endl << "SweepEngine intersections: " << engine.getSink().count;
+
+		if (expected != engine.getSink().count)
+		{
+			cerr << "Validation failed: SweepEngine found " << engine.getSink().count
+				<< " intersections, brute force found " << expected << endl;
+			return 1;
+		}
+
+		InversionSweep<CountSink> inversionSweep;
+		inversionSweep.run(SegmentView<double>(coordinates.data(), segments.size()));
+		cout << endl << "InversionSweep intersections: " << inversionSweep.getSink().count;
+
+		if (expected != inversionSweep.getSink().count)
+		{
+			cerr << "Validation failed: InversionSweep found " << inversionSweep.getSink().count
+				<< " intersections, brute force found " << expected << endl;
+			return 1;
+		}
+
+		if (expected != tot)
+		{
+			cerr << "Validation failed: sweep found " << tot << " intersections, brute force found " << expected << endl;
+			return 1;
+		}
+
+		if (!validateGrid())
+		{
+			return 1;
+		}
+	}
 }
 
@@ -0,0 +1,85 @@
+// sweep_api_example.c : A C program calling bo_intersect of the sweep_api library, as a foreign caller would.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SweepApi.h"
+
+/*
+ * The caller's own record, of which the sweep only reads the four coordinates: segment i starts at the x1 of record i,
+ * and the records are sizeof(Road) bytes apart rather than the 32 of a flat array.
+ */
+typedef struct Road {
+	int number;
+	double x1, y1, x2, y2;
+	char name[12];
+} Road;
+
+#define ROAD_COUNT 6
+#define FIRST_CAPACITY 4
+
+int main(void) {
+	Road roads[ROAD_COUNT];
+	bo_intersection first[FIRST_CAPACITY];
+	bo_intersection* all;
+	bo_engine* engine;
+	int64_t total, again;
+	int i;
+
+	if (bo_version() != BO_API_VERSION)
+	{
+		fprintf(stderr, "sweep_api is version %d, this program was built for %d\n", bo_version(), BO_API_VERSION);
+		return 1;
+	}
+
+	// Three parallel rising roads and three parallel falling ones, each rising road crossing every falling one.
+	for (i = 0; i < ROAD_COUNT; i++)
+	{
+		int k = i % 3;
+		roads[i].number = i;
+		roads[i].x1 = 0.0;
+		roads[i].x2 = 10.0;
+		roads[i].y1 = i < 3 ? k : 10.0 + k;
+		roads[i].y2 = i < 3 ? 10.0 + k : k;
+		snprintf(roads[i].name, sizeof(roads[i].name), "road %d", i);
+	}
+
+	engine = bo_create();
+	if (engine == NULL)
+	{
+		fprintf(stderr, "Could not create an engine\n");
+		return 1;
+	}
+
+	// The buffer is too small on purpose: the call fills it and returns the total, here 9.
+	total = bo_intersect(engine, &roads[0].x1, ROAD_COUNT, sizeof(Road), first, FIRST_CAPACITY);
+	if (total < 0)
+	{
+		fprintf(stderr, "bo_intersect failed with %lld\n", (long long)total);
+		bo_destroy(engine);
+		return 1;
+	}
+
+	printf("%lld intersections, the first %d of them:\n", (long long)total, FIRST_CAPACITY);
+	for (i = 0; i < FIRST_CAPACITY && i < total; i++)
+	{
+		printf("(%g, %g) of %s and %s\n", first[i].x, first[i].y, roads[first[i].lower].name,
+			roads[first[i].upper].name);
+	}
+
+	// Repeating the call with a buffer of the size returned gets them all.
+	all = (bo_intersection*)malloc((size_t)total * sizeof(bo_intersection));
+	if (all == NULL)
+	{
+		bo_destroy(engine);
+		return 1;
+	}
+
+	again = bo_intersect(engine, &roads[0].x1, ROAD_COUNT, sizeof(Road), all, (size_t)total);
+	printf("%lld intersections on the second call, the last at (%g, %g)\n", (long long)again, all[again - 1].x,
+		all[again - 1].y);
+
+	free(all);
+	bo_destroy(engine);
+	return again == total && total == 9 ? 0 : 1;
+}
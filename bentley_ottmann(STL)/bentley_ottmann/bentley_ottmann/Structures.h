@@ -1,3 +1,5 @@
+#pragma once
+#include <stdint.h>
 #include <vector>
 #include <queue>
 #include <set>
@@ -37,14 +39,24 @@ private:
 	Point p_1;
 	Point p_2;
 	double value;
+	int id;
 
 public:
 	Segment(Point p_1, Point p_2) {
 		this->p_1 = p_1;
 		this->p_2 = p_2;
+		this->id = -1;
 		this->calculate_value(this->first().get_x_coord());
 	}
 
+	int get_id() {
+		return this->id;
+	}
+
+	void set_id(int id) {
+		this->id = id;
+	}
+
 	Point first() {
 		if (p_1.get_x_coord() <= p_2.get_x_coord()) {
 			return p_1;
@@ -68,6 +80,11 @@ public:
 		double x2 = this->second().get_x_coord();
 		double y1 = this->first().get_y_coord();
 		double y2 = this->second().get_y_coord();
+		if (x1 == x2) {
+			// A vertical segment has no single y at its x, so it is keyed by its lower end rather than divided by zero.
+			this->value = y1 < y2 ? y1 : y2;
+			return;
+		}
 		this->value = y1 + (((y2 - y1) / (x2 - x1)) * (value - x1));
 	}
 
@@ -80,55 +97,58 @@ public:
 	}
 };
 
+// Segments of the current sweep indexed by id, events refer to their segments through these ids.
+vector<Segment*> segment_store;
+
+void store_segments(vector<Segment*>& segments) {
+	segment_store = segments;
+	for (int i = 0; i < (int)segments.size(); i++) {
+		segments[i]->set_id(i);
+	}
+}
+
+// An event is kept by value in 24 bytes: its point, the ids of its one or two segments, and its type packed into the
+// top two bits of the second id.
 class Event {
 private:
+	static const uint32_t ID_MASK = 0x3FFFFFFF;
+	static const uint32_t NO_SEGMENT = ID_MASK;
+
 	Point point;
-	vector<Segment*> segments;
-	double value;
-	int type;
+	uint32_t first_id;
+	uint32_t second_id_and_type;
 public:
+	Event() {}
 	Event(Point p, Segment* s, int type) {
 		this->point = p;
-		this->segments.push_back(s);
-		this->value = p.get_x_coord();
-		this->type = type;
-	}
-	Event(Point p, vector<Segment*> s, int type) {
-		this->point = p;
-		this->segments = s;
-		this->value = p.get_x_coord();
-		this->type = type;
+		this->first_id = s->get_id();
+		this->second_id_and_type = NO_SEGMENT | ((uint32_t)type << 30);
 	}
-	void add_point(Point p) {
+	Event(Point p, Segment* s_1, Segment* s_2, int type) {
 		this->point = p;
+		this->first_id = s_1->get_id();
+		this->second_id_and_type = s_2->get_id() | ((uint32_t)type << 30);
 	}
 
 	Point get_point() {
 		return this->point;
 	}
 
-	void add_segment(Segment* s) {
-		this->segments.push_back(s);
-	}
-
-	vector<Segment*> get_segments() {
-		return this->segments;
-	}
-
-	void set_type(int type) {
-		this->type = type;
+	int get_type() {
+		return this->second_id_and_type >> 30;
 	}
 
-	int get_type() {
-		return this->type;
+	double get_value() {
+		return this->point.get_x_coord();
 	}
 
-	void set_value(double value) {
-		this->value = value;
+	int get_segment_count() {
+		return (this->second_id_and_type & ID_MASK) == NO_SEGMENT ? 1 : 2;
 	}
 
-	double get_value() {
-		return this->value;
+	Segment* get_segment(int i) {
+		return segment_store[i == 0 ? this->first_id : this->second_id_and_type & ID_MASK];
 	}
 };
 
+static_assert(sizeof(Event) == 24, "Event records are expected to be 24 bytes");
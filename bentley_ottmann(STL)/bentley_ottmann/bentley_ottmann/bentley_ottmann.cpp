@@ -1,22 +1,29 @@
 
 #include "Structures.h"
+#include "RadixSort.h"
+#include "Pipeline.h"
 #include <queue>
 #include <set>
 #include <iostream>
 #include <map>
 #include <chrono>
 #include <list>
+#include <string>
 using namespace std;
 
 double MinNum = 0.0000001;
 
-auto event_comparator = [](Event* e_1, Event* e_2) {
-	if (e_1->get_value() > e_2->get_value()) {
+auto event_comparator = [](Event e_1, Event e_2) {
+	if (e_1.get_value() > e_2.get_value()) {
 		return true;
 	}
 	return false;
 };
-priority_queue<Event*, vector<Event*>, decltype(event_comparator)> Q(event_comparator);
+priority_queue<Event, vector<Event>, decltype(event_comparator)> Q(event_comparator);
+
+// Endpoint events sorted by x once in init(), Q only holds the intersection events found during the sweep.
+vector<Event> endpoints;
+size_t next_endpoint = 0;
 
 auto segment_comparator = [](Segment* s_1, Segment* s_2) {
 	if (s_1->get_value() > s_2->get_value()) {
@@ -33,13 +40,43 @@ vector<Point> tempP;
 
 
 void init(vector<Segment*> input_data) {
+	store_segments(input_data);
+
+	vector<Event> unsorted;
 	for (Segment* s : input_data) {
-		Q.push(new Event(s->first(), s, 0));
-		Q.push(new Event(s->second(), s, 1));
+		unsorted.push_back(Event(s->first(), s, 0));
+		unsorted.push_back(Event(s->second(), s, 1));
 
 		tempP.push_back(s->first());
 		tempP.push_back(s->second());
 	}
+
+	vector<RadixRecord> records(unsorted.size());
+	for (size_t i = 0; i < unsorted.size(); i++) {
+		records[i].primary = sortableBits(unsorted[i].get_value());
+		records[i].secondary = sortableBits(unsorted[i].get_point().get_y_coord());
+		records[i].index = (uint32_t)i;
+	}
+	parallelRadixSort(records);
+
+	endpoints.clear();
+	next_endpoint = 0;
+	for (RadixRecord r : records) {
+		endpoints.push_back(unsorted[r.index]);
+	}
+}
+
+// Merges the sorted endpoints with the intersection events in Q, returning whichever comes first.
+Event next_event() {
+	if (Q.empty()) {
+		return endpoints[next_endpoint++];
+	}
+	Event e = Q.top();
+	if (next_endpoint < endpoints.size() && endpoints[next_endpoint].get_value() <= e.get_value()) {
+		return endpoints[next_endpoint++];
+	}
+	Q.pop();
+	return e;
 }
 
 bool report_intersection(Segment* s_1, Segment* s_2, double L) {
@@ -59,8 +96,6 @@ bool report_intersection(Segment* s_1, Segment* s_2, double L) {
 			double x_c = x1 + t * (x2 - x1);
 			double y_c = y1 + t * (y2 - y1);
 			if (x_c > L) {
-				vector<Segment*> v_seg{ s_1, s_2 };
-
 				Point p = Point(x_c, y_c);
 
 				auto is_p = [x_c, y_c](Point pt) {
@@ -72,7 +107,7 @@ bool report_intersection(Segment* s_1, Segment* s_2, double L) {
 				if (it != end(tempP)) 
 					return false;
 
-				Q.push(new Event(p, v_seg, 2));
+				Q.push(Event(p, s_1, s_2, 2));
 				tempP.push_back(p);
 
 				return true;
@@ -111,83 +146,165 @@ vector<Point> get_intersections() {
 }
 
 
-void find_intersections() {
-	while (!Q.empty()) {
-		Event* e = Q.top();
-		Q.pop();
+bool sweep_done() {
+	return Q.empty() && next_endpoint >= endpoints.size();
+}
 
-		Point p = e->get_point();
-		double px = p.get_x_coord();
-		double py = p.get_y_coord();
-		auto is_p = [px, py](Point pt) {
-			return (fabs(pt.get_x_coord() - px) < MinNum && fabs(pt.get_y_coord() - py) < MinNum);
-		};
-		auto it = find_if(begin(tempP), end(tempP), is_p);
-		tempP.erase(it);
-
-		double L = e->get_value();
-		switch (e->get_type())
-		{
-		case 0:
-			for (Segment* s : e->get_segments()) {
-				recalculate(L);
-				T.insert(s);
-				if (--T.lower_bound(s) != T.end()) {
-					Segment* r = *--T.lower_bound(s);
-					report_intersection(r, s, L);
-				}
-				if (T.upper_bound(s) != T.end()) {
-					Segment* t = *T.upper_bound(s);
-					report_intersection(t, s, L);
-				}
-				if (--T.lower_bound(s) != T.end() && T.upper_bound(s) != T.end()) {
-					Segment* r = *--T.lower_bound(s);
-					Segment* t = *T.upper_bound(s);
-				}
+// Processes the next event of the sweep, returning true if it is an intersection, which is then stored in found.
+bool sweep_step(Point& found) {
+	Event e = next_event();
+
+	Point p = e.get_point();
+	double px = p.get_x_coord();
+	double py = p.get_y_coord();
+	auto is_p = [px, py](Point pt) {
+		return (fabs(pt.get_x_coord() - px) < MinNum && fabs(pt.get_y_coord() - py) < MinNum);
+	};
+	auto it = find_if(begin(tempP), end(tempP), is_p);
+	tempP.erase(it);
+
+	double L = e.get_value();
+	switch (e.get_type())
+	{
+	case 0:
+		for (int i = 0; i < e.get_segment_count(); i++) {
+			Segment* s = e.get_segment(i);
+			recalculate(L);
+			T.insert(s);
+			if (--T.lower_bound(s) != T.end()) {
+				Segment* r = *--T.lower_bound(s);
+				report_intersection(r, s, L);
+			}
+			if (T.upper_bound(s) != T.end()) {
+				Segment* t = *T.upper_bound(s);
+				report_intersection(t, s, L);
+			}
+			if (--T.lower_bound(s) != T.end() && T.upper_bound(s) != T.end()) {
+				Segment* r = *--T.lower_bound(s);
+				Segment* t = *T.upper_bound(s);
+			}
+		}
+		break;
+	case 1:
+		for (int i = 0; i < e.get_segment_count(); i++) {
+			Segment* s = e.get_segment(i);
+			if (--T.lower_bound(s) != T.end() && T.upper_bound(s) != T.end()) {
+				Segment* r = *--T.lower_bound(s);
+				Segment* t = *T.upper_bound(s);
+				report_intersection(r, t, L);
+			}
+			T.erase(s);
+		}
+		break;
+	case 2:
+		Segment * s_1 = e.get_segment(0);
+		Segment* s_2 = e.get_segment(1);
+		swap(s_1, s_2);
+		if (s_1->get_value() < s_2->get_value()) {
+			if (T.upper_bound(s_1) != T.end()) {
+				Segment* t = *T.upper_bound(s_1);
+				report_intersection(t, s_1, L);
 			}
-			break;
-		case 1:
-			for (Segment* s : e->get_segments()) {
-				if (--T.lower_bound(s) != T.end() && T.upper_bound(s) != T.end()) {
-					Segment* r = *--T.lower_bound(s);
-					Segment* t = *T.upper_bound(s);
-					report_intersection(r, t, L);
-				}
-				T.erase(s);
+			if (--T.lower_bound(s_2) != T.end()) {
+				Segment* r = *--T.lower_bound(s_2);
+				report_intersection(r, s_2, L);
 			}
-			break;
-		case 2:
-			Segment * s_1 = e->get_segments()[0];
-			Segment* s_2 = e->get_segments()[1];
-			swap(s_1, s_2);
-			if (s_1->get_value() < s_2->get_value()) {
-				if (T.upper_bound(s_1) != T.end()) {
-					Segment* t = *T.upper_bound(s_1);
-					report_intersection(t, s_1, L);
-				}
-				if (--T.lower_bound(s_2) != T.end()) {
-					Segment* r = *--T.lower_bound(s_2);
-					report_intersection(r, s_2, L);
-				}
+		}
+		else {
+			if (T.upper_bound(s_2) != T.end()) {
+				Segment* t = *T.upper_bound(s_2);
+				report_intersection(t, s_2, L);
 			}
-			else {
-				if (T.upper_bound(s_2) != T.end()) {
-					Segment* t = *T.upper_bound(s_2);
-					report_intersection(t, s_2, L);
-				}
-				if (--T.lower_bound(s_1) != T.end()) {
-					Segment* r = *--T.lower_bound(s_1);
-					report_intersection(r, s_1, L);
-				}
+			if (--T.lower_bound(s_1) != T.end()) {
+				Segment* r = *--T.lower_bound(s_1);
+				report_intersection(r, s_1, L);
 			}
-			X.push_back(e->get_point());
-			break;
+		}
+		found = e.get_point();
+		return true;
+	}
+	return false;
+}
+
+// Empties the sweep state, whether or not the sweep ran to the end.
+void release_sweep() {
+	while (!Q.empty()) {
+		Q.pop();
+	}
+	T.clear();
+	tempP.clear();
+	next_endpoint = endpoints.size();
+}
+
+void find_intersections() {
+	Point found;
+	while (!sweep_done()) {
+		if (sweep_step(found)) {
+			X.push_back(found);
 		}
 	}
 }
 
+// Pulls the intersections one at a time in sweep order, running the sweep only as far as the next one and keeping
+// none of them. Stopping early empties the sweep state without processing the remaining events.
+class IntersectionGenerator {
+public:
+	IntersectionGenerator(vector<Segment*> input_data) {
+		init(input_data);
+	}
+
+	~IntersectionGenerator() {
+		stop();
+	}
+
+	bool next(Point& intersection) {
+		while (!sweep_done()) {
+			if (sweep_step(intersection)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void stop() {
+		release_sweep();
+	}
+};
+
+
+int main(int argc, char* argv[]) {
+	// --pipeline <input> [<input> ...] writes the intersections of each input to <input>.out
+	if (argc > 2 && string(argv[1]) == "--pipeline") {
+		vector<string> inputs(argv + 2, argv + argc);
+		auto make_segment = [](double x1, double y1, double x2, double y2) {
+			return new Segment(Point(x1, y1), Point(x2, y2));
+		};
+		SweepPipeline<Segment, decltype(make_segment)> pipeline(inputs, make_segment);
+		auto start = std::chrono::high_resolution_clock::now();
+
+		pipeline.run([](vector<Segment*>& segments, SweepPipeline<Segment, decltype(make_segment)>& output) {
+			IntersectionGenerator generator(segments);
+			Point p;
+			while (generator.next(p)) {
+				output.emit(p.get_x_coord(), p.get_y_coord());
+			}
+		});
+
+		auto end = std::chrono::high_resolution_clock::now();
+		// A file that could not be read fails the run, although the other files are still written.
+		int result = 0;
+		for (size_t i = 0; i < inputs.size(); i++) {
+			cout << inputs[i] << ": " << pipeline.getCounts()[i] << " intersections" << endl;
+			if (pipeline.getCounts()[i] < 0) {
+				result = 1;
+			}
+		}
+		cout << "Parse: " << pipeline.getParseMs() << " ms, sweep: " << pipeline.getSweepMs() << " ms, write: "
+			<< pipeline.getWriteMs() << " ms, wall clock: "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << endl;
+		return result;
+	}
 
-int main() {
 
 	vector<Segment*> segments;
 
@@ -208,6 +325,20 @@ int main() {
 		segments.push_back(segment);
 	}
 
+	// --first <n> prints the first n intersections in sweep order without running the rest of the sweep.
+	if (argc > 2 && string(argv[1]) == "--first") {
+		long long first = atoll(argv[2]);
+		long long taken = 0;
+		IntersectionGenerator generator(segments);
+		Point p;
+		while (taken < first && generator.next(p)) {
+			cout << "(" << p.get_x_coord() << ", " << p.get_y_coord() << ")" << endl;
+			taken++;
+		}
+		cout << "First intersections: " << taken << endl;
+		return 0;
+	}
+
 	init(segments);
 
 	auto start = std::chrono::high_resolution_clock::now();
@@ -0,0 +1,278 @@
+#pragma once
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/*
+ * Queue between two pipeline stages holding at most capacity items, so that a stage running ahead waits for the next
+ * one instead of buffering without bound. The producer closes the queue once it is done, after which pop drains the
+ * items left and then fails.
+ */
+template <typename T>
+class BoundedQueue {
+private:
+	mutex lock;
+	condition_variable notFull;
+	condition_variable notEmpty;
+	deque<T> items;
+	size_t capacity;
+	bool closed;
+
+public:
+	BoundedQueue(size_t capacity) {
+		this->capacity = capacity;
+		this->closed = false;
+	}
+
+	void push(T item) {
+		unique_lock<mutex> guard(lock);
+		notFull.wait(guard, [this] { return items.size() < capacity; });
+		items.push_back(move(item));
+		notEmpty.notify_one();
+	}
+
+	// Takes the oldest item, waiting for one if needed. Returns false once the queue is closed and empty.
+	bool pop(T& item) {
+		unique_lock<mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return !items.empty() || closed; });
+		if (items.empty())
+		{
+			return false;
+		}
+
+		item = move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		lock_guard<mutex> guard(lock);
+		closed = true;
+		notEmpty.notify_all();
+	}
+};
+
+/*
+ * Driver finding the intersections of several input files, each in the format of in.txt, with its stages running
+ * side by side instead of one after the other:
+ *  - a parser thread reads the files in order and builds their segments,
+ *  - the calling thread sweeps them one file at a time, passing each intersection to emit,
+ *  - a writer thread writes the intersections of each file to <file>.out, in blocks, while the sweep goes on.
+ *
+ * The stages are linked by bounded queues, so file N + 1 is parsed while file N is swept and the sweep only waits for
+ * the disk once the writer is a few blocks behind. Over many files the wall-clock time approaches that of the slowest
+ * stage rather than the sum of all three. Within one file the sweep cannot start before its last endpoint is read,
+ * as events are processed in sorted order.
+ *
+ * Segment is the segment class of the engine, and makeSegment(x1, y1, x2, y2) returns a new Segment with those
+ * endpoints, so that the pipeline does not depend on the point class of either project. The pipeline owns and deletes
+ * the segments.
+ */
+template <typename Segment, typename MakeSegment>
+class SweepPipeline {
+private:
+	struct Input {
+		size_t file;
+		vector<Segment*> segments;
+		bool readable;
+	};
+
+	struct Block {
+		size_t file;
+		vector<double> coordinates; // x and y of each intersection
+		bool last; // whether this block ends its file
+		long long count; // intersections of the file, in its last block, or -1 if the file could not be read
+	};
+
+	vector<string> paths;
+	MakeSegment makeSegment;
+	BoundedQueue<Input> parsed;
+	BoundedQueue<Block> results;
+	size_t blockSize;
+	Block current;
+	vector<long long> counts;
+	double parseNs, sweepNs, writeNs;
+
+	static double elapsedSince(chrono::high_resolution_clock::time_point start) {
+		return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void parse() {
+		for (size_t file = 0; file < paths.size(); file++)
+		{
+			auto start = chrono::high_resolution_clock::now();
+			Input input = { file, vector<Segment*>(), false };
+			FILE* stream;
+
+			if (fopen_s(&stream, paths[file].c_str(), "r") != 0 || stream == nullptr)
+			{
+				cerr << "Could not open " << paths[file] << endl;
+			}
+			else
+			{
+				int n;
+				input.readable = fscanf_s(stream, "%d", &n) == 1 && n >= 0;
+
+				if (!input.readable)
+				{
+					cerr << "Could not read the segment count of " << paths[file] << endl;
+				}
+
+				for (int i = 0; input.readable && i < n; i++)
+				{
+					double x1, y1, x2, y2;
+					if (fscanf_s(stream, "%lf%lf%lf%lf", &x1, &y1, &x2, &y2) != 4)
+					{
+						// A file with fewer segments than its count says is not swept, as its result would be wrong.
+						cerr << paths[file] << " is truncated: " << i << " of " << n << " segments read" << endl;
+						input.readable = false;
+						break;
+					}
+
+					input.segments.push_back(makeSegment(x1, y1, x2, y2));
+				}
+
+				fclose(stream);
+			}
+
+			parseNs += elapsedSince(start);
+			parsed.push(move(input));
+		}
+
+		parsed.close();
+	}
+
+	void write() {
+		FILE* out = nullptr;
+		Block block;
+
+		while (results.pop(block))
+		{
+			auto start = chrono::high_resolution_clock::now();
+			if (block.count < 0)
+			{
+				continue;
+			}
+
+			if (out == nullptr && fopen_s(&out, (paths[block.file] + ".out").c_str(), "w") != 0)
+			{
+				cerr << "Could not open " << paths[block.file] << ".out" << endl;
+				out = nullptr;
+			}
+
+			if (out != nullptr)
+			{
+				for (size_t i = 0; i < block.coordinates.size(); i += 2)
+				{
+					fprintf(out, "(%g, %g)\n", block.coordinates[i], block.coordinates[i + 1]);
+				}
+
+				if (block.last)
+				{
+					fprintf(out, "Total intersections: %lld\n", block.count);
+					fclose(out);
+					out = nullptr;
+				}
+			}
+
+			writeNs += elapsedSince(start);
+		}
+	}
+
+	void startBlock(size_t file) {
+		current.file = file;
+		current.coordinates.clear();
+		current.coordinates.reserve(2 * blockSize);
+		current.last = false;
+		current.count = 0;
+	}
+
+public:
+	// Prepares a run over the given files, with queueDepth items between stages and blockSize intersections a block.
+	SweepPipeline(vector<string> paths, MakeSegment makeSegment, size_t queueDepth = 2, size_t blockSize = 1 << 14)
+		: makeSegment(makeSegment), parsed(queueDepth), results(queueDepth) {
+		this->paths = paths;
+		this->blockSize = blockSize;
+		counts.assign(paths.size(), -1);
+		parseNs = sweepNs = writeNs = 0.0;
+	}
+
+	/*
+	 * Runs the pipeline, calling sweep(segments, pipeline) on this thread for each file in order. The sweep reports
+	 * every intersection it finds through emit.
+	 */
+	template <typename Sweep>
+	void run(Sweep sweep) {
+		thread parser(&SweepPipeline::parse, this);
+		thread writer(&SweepPipeline::write, this);
+		Input input;
+
+		while (parsed.pop(input))
+		{
+			auto start = chrono::high_resolution_clock::now();
+			startBlock(input.file);
+
+			if (input.readable)
+			{
+				sweep(input.segments, *this);
+				counts[input.file] = current.count;
+			}
+
+			for (Segment* segment : input.segments)
+			{
+				delete segment;
+			}
+
+			current.last = true;
+			current.count = counts[input.file];
+			sweepNs += elapsedSince(start);
+			results.push(move(current));
+		}
+
+		results.close();
+		parser.join();
+		writer.join();
+	}
+
+	// Passes an intersection of the file being swept to the writer.
+	void emit(double x, double y) {
+		current.coordinates.push_back(x);
+		current.coordinates.push_back(y);
+		current.count++;
+
+		if (current.coordinates.size() >= 2 * blockSize)
+		{
+			size_t file = current.file;
+			long long count = current.count;
+			results.push(move(current));
+			startBlock(file);
+			current.count = count;
+		}
+	}
+
+	// Intersections found in each file, or -1 for files that could not be opened, or were malformed or truncated.
+	vector<long long>& getCounts() {
+		return counts;
+	}
+
+	// Time spent in each stage over the whole run, in milliseconds.
+	double getParseMs() {
+		return parseNs / 1e6;
+	}
+
+	double getSweepMs() {
+		return sweepNs / 1e6;
+	}
+
+	double getWriteMs() {
+		return writeNs / 1e6;
+	}
+};
@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/*
+ * A record to be sorted by two 64 bit keys, primary first, carrying the index of the item it stands for.
+ */
+struct RadixRecord {
+	uint64_t primary;
+	uint64_t secondary;
+	uint32_t index;
+};
+
+/*
+ * Maps a double to an unsigned integer with the same ordering, so that doubles can be radix sorted on their bit
+ * patterns: negative numbers have all bits flipped, positive numbers only the sign bit. -0.0 compares equal to +0.0,
+ * so it is mapped to the same integer rather than just below it.
+ */
+inline uint64_t sortableBits(double d) {
+	if (d == 0.0)
+	{
+		d = 0.0;
+	}
+
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+
+	return (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+}
+
+/*
+ * Sorts records by (primary, secondary) with a least significant digit radix sort on 8 bit digits, secondary key
+ * first. Each pass is split between threads: every thread counts the digits of its own slice, the counts are turned
+ * into per thread output offsets, and every thread then scatters its slice. Passes in which all records have the
+ * same digit are skipped, which removes most passes for coordinates sharing their sign and exponent. Threads are
+ * started twice per pass, so each one gets at least MIN_RECORDS_PER_THREAD records, enough for the start to cost a
+ * small fraction of its work; smaller sorts run on the calling thread alone.
+ */
+inline void parallelRadixSort(vector<RadixRecord>& records) {
+	const int BUCKETS = 256;
+	const size_t MIN_RECORDS_PER_THREAD = 1 << 16;
+	size_t n = records.size();
+	int threadCount = (int)min((size_t)thread::hardware_concurrency(), n / MIN_RECORDS_PER_THREAD);
+
+	if (threadCount < 1)
+	{
+		threadCount = 1;
+	}
+
+	vector<RadixRecord> buffer(n);
+	vector<size_t> counts((size_t)threadCount * BUCKETS);
+	vector<thread> threads;
+
+	for (int pass = 0; pass < 16; pass++)
+	{
+		bool onPrimary = pass >= 8;
+		int shift = (pass % 8) * 8;
+		size_t slice = (n + threadCount - 1) / threadCount;
+
+		auto digitOf = [onPrimary, shift](const RadixRecord& r) {
+			return (int)(((onPrimary ? r.primary : r.secondary) >> shift) & 0xFF);
+		};
+
+		auto count = [&](int t) {
+			size_t* local = &counts[(size_t)t * BUCKETS];
+			fill(local, local + BUCKETS, 0);
+
+			for (size_t i = t * slice; i < n && i < (t + 1) * slice; i++)
+			{
+				local[digitOf(records[i])]++;
+			}
+		};
+
+		if (threadCount == 1)
+		{
+			count(0);
+		}
+		else
+		{
+			threads.clear();
+			for (int t = 0; t < threadCount; t++)
+			{
+				threads.push_back(thread(count, t));
+			}
+			for (thread& th : threads)
+			{
+				th.join();
+			}
+		}
+
+		// Skip the pass if every record falls in the same bucket.
+		bool trivial = false;
+		for (int b = 0; b < BUCKETS && !trivial; b++)
+		{
+			size_t total = 0;
+			for (int t = 0; t < threadCount; t++)
+			{
+				total += counts[(size_t)t * BUCKETS + b];
+			}
+			trivial = total == n;
+		}
+
+		if (trivial)
+		{
+			continue;
+		}
+
+		// Turn the counts into the output offset of every (bucket, thread) slice, buckets first to keep it stable.
+		size_t offset = 0;
+		for (int b = 0; b < BUCKETS; b++)
+		{
+			for (int t = 0; t < threadCount; t++)
+			{
+				size_t c = counts[(size_t)t * BUCKETS + b];
+				counts[(size_t)t * BUCKETS + b] = offset;
+				offset += c;
+			}
+		}
+
+		auto scatter = [&](int t) {
+			size_t* local = &counts[(size_t)t * BUCKETS];
+
+			for (size_t i = t * slice; i < n && i < (t + 1) * slice; i++)
+			{
+				buffer[local[digitOf(records[i])]++] = records[i];
+			}
+		};
+
+		if (threadCount == 1)
+		{
+			scatter(0);
+		}
+		else
+		{
+			threads.clear();
+			for (int t = 0; t < threadCount; t++)
+			{
+				threads.push_back(thread(scatter, t));
+			}
+			for (thread& th : threads)
+			{
+				th.join();
+			}
+		}
+
+		records.swap(buffer);
+	}
+}